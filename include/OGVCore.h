@@ -8,6 +8,9 @@
 
 #pragma once
 
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
 #include <memory>
 #include <string>
 #include <vector>
@@ -83,7 +86,8 @@ namespace OGVCore {
 	};
 
 	//
-	// Currently wraps a raw pointer and does NOT copy data.
+	// Wraps a raw pointer and does NOT copy data; when the owning
+	// FrameBuffer has storage, that keeps the bytes alive.
 	//
 	struct PlaneBuffer {
 		const unsigned char *bytes;
@@ -117,6 +121,10 @@ namespace OGVCore {
 		PlaneBuffer Cb;
 		PlaneBuffer Cr;
 
+		// Pooled memory behind the planes for owned frames; null when
+		// the planes borrow the decoder's internal buffers.
+		std::shared_ptr<void> storage;
+
 		FrameBuffer(FrameLayout aLayout,
 		            double aTimestamp, double aKeyframeTimestamp,
 		            PlaneBuffer aY, PlaneBuffer aCb, PlaneBuffer aCr) :
@@ -125,7 +133,8 @@ namespace OGVCore {
 			keyframeTimestamp(aKeyframeTimestamp),
 			Y(aY),
 			Cb(aCb),
-			Cr(aCr)
+			Cr(aCr),
+			storage()
 		{}
 
 		FrameBuffer() :
@@ -134,7 +143,8 @@ namespace OGVCore {
 			keyframeTimestamp(0.0),
 			Y(),
 			Cb(),
-			Cr()
+			Cr(),
+			storage()
 		{}
 	};
 
@@ -154,34 +164,278 @@ namespace OGVCore {
 		{}
 	};
 
+	/**
+	 * How an AudioBuffer's samples are stored. Decoders hand out planar
+	 * float unless asked for something else with
+	 * Decoder::setAudioOutputFormat().
+	 */
+	enum AudioSampleFormat {
+		AUDIO_SAMPLE_FLOAT_PLANAR, // one float plane per channel
+		AUDIO_SAMPLE_FLOAT,        // interleaved float, unclipped
+		AUDIO_SAMPLE_S16,          // interleaved signed 16-bit, clipped
+		AUDIO_SAMPLE_S32           // interleaved signed 32-bit, clipped
+	};
+
+	inline size_t audioSampleSize(AudioSampleFormat aFormat)
+	{
+		switch (aFormat) {
+			case AUDIO_SAMPLE_S16: return 2;
+			case AUDIO_SAMPLE_S32: return 4;
+			default:               return sizeof(float);
+		}
+	}
+
+	/**
+	 * Speed vs passband trade-off for Decoder::setAudioOutputRate().
+	 */
+	enum ResampleQuality {
+		RESAMPLE_FAST,   // 16 taps, flat to ~85% of Nyquist
+		RESAMPLE_MEDIUM, // 32 taps, flat to ~91% of Nyquist
+		RESAMPLE_BEST    // 64 taps, flat to ~95% of Nyquist
+	};
+
+	/**
+	 * Channels share one pooled block rather than a vector each. The
+	 * old `samples` member is kept as a view onto it, so AudioFeeder
+	 * backends reading buf.samples[c][i] still work without a copy;
+	 * new code should read buf.channel(c)[i], for i below
+	 * buf.sampleCount.
+	 */
 	class AudioBuffer {
 	public:
+		/**
+		 * Compatibility accessor for the old vector-per-channel layout:
+		 * samples[c] is channel(c), in place. Planar float only.
+		 */
+		class ChannelView {
+		public:
+			explicit ChannelView(AudioBuffer *aOwner) : owner_(aOwner) {}
+			float *operator[](int aChannel) const { return owner_->channel(aChannel); }
+			size_t size() const { return (size_t)owner_->layout.channelCount; }
+
+		private:
+			AudioBuffer *owner_;
+		};
+
 		AudioLayout layout;
 		int sampleCount;
-		std::vector<std::vector<float>> samples;
+		double timestamp; // of the first sample, or -1 if not known yet
+		AudioSampleFormat format;
+
+		// Samples in one contiguous, aligned block. Planar float: channel
+		// c starts at data + c * channelStride. Interleaved formats: the
+		// block holds whole frames from data on, see interleaved().
+		float *data;
+		int channelStride;
+
+		// Owner of the block; decoder-made buffers draw it from a pool
+		// and hand it back when the last reference goes away.
+		std::shared_ptr<void> storage;
+
+		// Always views this buffer, including after a copy.
+		ChannelView samples;
 
 	public:
 		// Convenience constructor for the C library output
 		AudioBuffer(AudioLayout aLayout, int aSampleCount, const float **aSamples) :
 			layout(aLayout),
 			sampleCount(aSampleCount),
-			samples()
+			timestamp(-1),
+			format(AUDIO_SAMPLE_FLOAT_PLANAR),
+			data(0),
+			channelStride(aSampleCount),
+			storage(),
+			samples(this)
 		{
 			int n = layout.channelCount;
+			data = new float[(size_t)n * aSampleCount];
+			storage = std::shared_ptr<float>(data, std::default_delete<float[]>());
 			for (int i = 0; i < n; i++) {
-				const float *channelSamples = aSamples[i];
-				samples.emplace_back(channelSamples, channelSamples + aSampleCount);
+				std::copy(aSamples[i], aSamples[i] + aSampleCount, channel(i));
 			}
 		}
 		
 		AudioBuffer() :
 			layout(),
 			sampleCount(0),
-			samples()
+			timestamp(-1),
+			format(AUDIO_SAMPLE_FLOAT_PLANAR),
+			data(0),
+			channelStride(0),
+			storage(),
+			samples(this)
+		{}
+
+		// Copies share the block.
+		AudioBuffer(const AudioBuffer &aOther) :
+			layout(aOther.layout),
+			sampleCount(aOther.sampleCount),
+			timestamp(aOther.timestamp),
+			format(aOther.format),
+			data(aOther.data),
+			channelStride(aOther.channelStride),
+			storage(aOther.storage),
+			samples(this)
+		{}
+
+		AudioBuffer &operator=(const AudioBuffer &aOther)
+		{
+			layout = aOther.layout;
+			sampleCount = aOther.sampleCount;
+			timestamp = aOther.timestamp;
+			format = aOther.format;
+			data = aOther.data;
+			channelStride = aOther.channelStride;
+			storage = aOther.storage;
+			return *this;
+		}
+
+		/**
+		 * @return time just past the last sample, or -1 if not known yet
+		 */
+		double endTimestamp() const
+		{
+			if (timestamp < 0 || layout.sampleRate <= 0) {
+				return -1;
+			}
+			return timestamp + (double)sampleCount / layout.sampleRate;
+		}
+
+		// Planar float only.
+		float *channel(int aChannel) { return data + (size_t)aChannel * channelStride; }
+		const float *channel(int aChannel) const { return data + (size_t)aChannel * channelStride; }
+
+		// Interleaved formats only: sampleCount frames of
+		// layout.channelCount samples, audioSampleSize(format) bytes each.
+		void *interleaved() { return data; }
+		const void *interleaved() const { return data; }
+	};
+
+
+	struct DemuxStats {
+		long pagesRouted;    // delivered to the one stream that owns them
+		long pagesDiscarded; // untracked serial numbers, never parsed
+
+		DemuxStats() :
+			pagesRouted(0),
+			pagesDiscarded(0)
+		{}
+	};
+
+
+	/**
+	 * The first page since a flush to carry a timestamp, on the track
+	 * bisection seeks by: video if it's on, otherwise audio.
+	 */
+	struct TimestampedPage {
+		int64_t offset;      // from the first input after flush(), or into a mapped file
+		int64_t end;         // just past the page
+		double time;         // of the page's last complete packet
+		double keyframeTime; // video: of the keyframe that packet builds on; else time
+
+		TimestampedPage() :
+			offset(-1),
+			end(-1),
+			time(-1),
+			keyframeTime(-1)
+		{}
+	};
+
+
+	struct DecodeAheadStats {
+		int queueDepth;       // configured frame queue capacity
+		int framesQueued;     // decoded frames waiting to be popped
+		int audioQueued;      // decoded audio buffers waiting to be popped
+		int videoPacketsQueued; // split mode: demuxed, waiting on the video thread
+		int audioPacketsQueued; // split mode: demuxed, waiting on the audio thread
+		long framesDecoded;
+		long consumerStalls;  // popFrame() found nothing ready
+		long producerStalls;  // worker idled because the queues were full
+
+		DecodeAheadStats() :
+			queueDepth(0),
+			framesQueued(0),
+			audioQueued(0),
+			videoPacketsQueued(0),
+			audioPacketsQueued(0),
+			framesDecoded(0),
+			consumerStalls(0),
+			producerStalls(0)
+		{}
+	};
+
+
+	struct SchedulerStats {
+		int workers;
+		long tasksRun;
+		long tasksStolen;     // run by a worker other than the one they were queued on
+
+		SchedulerStats() :
+			workers(0),
+			tasksRun(0),
+			tasksStolen(0)
+		{}
+	};
+
+
+	struct AudioGovernorStats {
+		double lowWater;        // seconds buffered that trigger a refill...
+		double highWater;       // ...up to this many
+		long wakeups;
+		long batches;           // wakeups that decoded something
+		long underruns;         // times the output ran dry
+		double secondsDecoded;
+		double elapsed;         // seconds since the first wakeup
+		double wakeupsPerSecond;
+		double histogramBinWidth;            // seconds per bin below
+		std::vector<long> bufferedHistogram; // wakeups by buffered time found; the last bin takes the rest
+
+		AudioGovernorStats() :
+			lowWater(0),
+			highWater(0),
+			wakeups(0),
+			batches(0),
+			underruns(0),
+			secondsDecoded(0),
+			elapsed(0),
+			wakeupsPerSecond(0),
+			histogramBinWidth(0),
+			bufferedHistogram()
 		{}
 	};
 
 
+	///
+	/// Shared work-stealing thread pool for running many Decoders'
+	/// decode-ahead steps without a thread apiece.
+	///
+	class DecoderScheduler {
+	public:
+		/**
+		 * @param aWorkers worker threads; 0 or anything above the core
+		 *        count means one per core
+		 */
+		explicit DecoderScheduler(int aWorkers = 0);
+		~DecoderScheduler();
+
+		/**
+		 * Queue a task. Tasks submitted from a worker go on its own
+		 * queue; idle workers steal from the others. No ordering is
+		 * promised between tasks, so callers that need it keep only one
+		 * task in flight at a time.
+		 */
+		void submit(std::function<void()> aTask);
+
+		int workerCount() const;
+		SchedulerStats getStats() const;
+
+	private:
+		class impl; std::unique_ptr<impl> pimpl;
+	};
+
+
+	class AudioRing;
+
 	///
 	/// Platform-independent class for wrapping the decoder
 	///
@@ -203,15 +457,215 @@ namespace OGVCore {
 		std::shared_ptr<AudioLayout> getAudioLayout() const;
 		std::shared_ptr<FrameLayout> getFrameLayout() const;
 
-		void receiveInput(std::vector<unsigned char> aBuffer);
+		void receiveInput(const std::vector<unsigned char> &aBuffer);
+		void receiveInput(const unsigned char *aBytes, size_t aLength);
+
+		/**
+		 * Zero-copy input: returns space for up to aLength bytes directly
+		 * in the demuxer's sync buffer, so the producer can read into it.
+		 * No lock is held between the two calls, so the read doesn't stall
+		 * the decode-ahead worker. The pointer is only valid until the
+		 * matching commitInputBuffer(); bytes committed after a seek are
+		 * dropped.
+		 */
+		unsigned char *acquireInputBuffer(size_t aLength);
+		/**
+		 * @param aLength number of bytes actually written into the
+		 *        buffer returned by acquireInputBuffer()
+		 */
+		void commitInputBuffer(size_t aLength);
+
+		/**
+		 * Demux straight out of a memory-mapped local file instead of
+		 * pushing data with receiveInput(). Pages are found and checked
+		 * in place, so payload bytes are never copied into a sync buffer.
+		 * Each page's body is still copied once, into its stream's libogg
+		 * packet buffer, before the codec sees it; decodeSegments()
+		 * avoids that too, copying only packets that span pages.
+		 *
+		 * A keyframe index saved beside it by saveKeyframeIndex(), at
+		 * aPath + ".ogvidx", is mapped too if it still matches the file.
+		 *
+		 * @return false if the file couldn't be mapped
+		 */
+		bool openFile(const std::string &aPath);
+		/**
+		 * Move the mapped-file read position, eg to a keypoint offset.
+		 * Call flush() first as with a network seek.
+		 */
+		void seekFile(int64_t aOffset);
+
+		/**
+		 * Skip page CRC checks on openFile() input we generated ourselves.
+		 * On by default; pushed input is always checked by libogg.
+		 */
+		void setVerifyChecksums(bool aVerify);
+
+		/**
+		 * Turn decoding of the video or audio track on or off; both are on
+		 * by default. A disabled track's pages are dropped as they're
+		 * demuxed, so its packets are never buffered or decoded, and
+		 * hasVideo()/hasAudio() report false while it's off.
+		 *
+		 * Before the headers are read, a disabled track is never set up
+		 * at all and can't be turned back on. Mid-stream it can: audio
+		 * picks up at the next page, video cleanly at the next keyframe.
+		 * Any decode-ahead queues are flushed as with flush().
+		 */
+		void setVideoEnabled(bool aEnabled);
+		void setAudioEnabled(bool aEnabled);
+		bool videoEnabled() const;
+		bool audioEnabled() const;
+
 		bool process();
 
 		bool decodeFrame(std::function<void(FrameBuffer &aBuffer)> aCallback);
+		/**
+		 * Decode the next frame only to keep the decoder's reference
+		 * frames current, eg while seeking forward from a keyframe to
+		 * the target. No YCbCr output is fetched and no FrameBuffer is
+		 * built. Unlike discardFrame(), later frames still decode cleanly.
+		 */
+		bool skipFrame();
 		void discardFrame();
 
+		/**
+		 * Owned frame mode: each decoded frame is copied once into a
+		 * buffer from a preallocated, size-classed pool and handed out
+		 * ref-counted, so it stays valid after the callback and can be
+		 * queued or passed to another thread. Memory goes back to the
+		 * pool when the last reference drops.
+		 *
+		 * Off by default; then FrameBuffers borrow libtheora's memory
+		 * and are only valid during the decodeFrame() callback.
+		 *
+		 * @param aPreallocate frames to allocate up front once the
+		 *        frame size is known
+		 * @param aHugePages back large frames with huge pages if possible
+		 */
+		void setOwnedFrames(bool aOwned, int aPreallocate = 4, bool aHugePages = false);
+		/**
+		 * Decode the next frame into an owned buffer, switching on owned
+		 * frame mode if needed.
+		 *
+		 * @return the frame, or null if none could be decoded
+		 */
+		std::shared_ptr<FrameBuffer> dequeueFrame();
+
 		bool decodeAudio(std::function<void(AudioBuffer &aBuffer)> aCallback);
+		/**
+		 * Decode audio packets back to back into one contiguous pooled
+		 * buffer until at least aSampleCount samples per channel have
+		 * built up, or until the input runs out. Pages are demuxed as
+		 * needed along the way. The buffer's timestamp is its first
+		 * sample's; endTimestamp() gives the time just past its last.
+		 *
+		 * @return the batch, or null if no audio could be decoded
+		 */
+		std::shared_ptr<AudioBuffer> decodeAudioSamples(int aSampleCount);
+		/**
+		 * As decodeAudioSamples(), for at least aSeconds of audio.
+		 */
+		std::shared_ptr<AudioBuffer> decodeAudioDuration(double aSeconds);
 		void discardAudio();
 
+		/**
+		 * Have decoded audio come out in the sample format the output
+		 * device wants, converted (with clipping) in the same pass that
+		 * copies it out of the codec. Planar float by default.
+		 *
+		 * @param aDither add TPDF dither when going to 16-bit
+		 */
+		void setAudioOutputFormat(AudioSampleFormat aFormat, bool aDither = false);
+		/**
+		 * Have libopus decode at a lower rate (24000, 16000, 12000 or
+		 * 8000 Hz), which costs less CPU, eg for previews. Timestamps
+		 * stay sample-accurate. Has no effect on Vorbis. Call before
+		 * the headers are read.
+		 *
+		 * @return false if libopus can't decode at aRate
+		 */
+		bool setOpusDecodeRate(int aRate);
+		/**
+		 * Mix surround audio down to aChannels (1 or 2) as it's decoded,
+		 * or 0 to keep every channel. Streams without a known channel
+		 * layout come through as they are. Call before the headers are
+		 * read.
+		 */
+		void setAudioDownmix(int aChannels);
+		/**
+		 * Resample decoded audio to aRate, eg the output device's fixed
+		 * rate, when the stream comes at another. Runs after any downmix
+		 * and before output format conversion, carrying filter state
+		 * across packets. 0 leaves the stream's rate alone. Call before
+		 * the headers are read.
+		 */
+		void setAudioOutputRate(int aRate, ResampleQuality aQuality = RESAMPLE_MEDIUM);
+		/**
+		 * Decode audio straight into free space in aRing, with no
+		 * AudioBuffer in between, until it's too full for another packet
+		 * or input runs out. The output format must already be set to
+		 * the ring's interleaved format, at the ring's channels and rate.
+		 *
+		 * @return frames written, or -1 if the ring doesn't match the
+		 *         output or can't take a whole packet in one write
+		 */
+		int decodeAudioInto(AudioRing &aRing);
+		/**
+		 * Have audio start exactly at aTime, eg after flush() for a seek.
+		 * Packets ending well before it are dropped undecoded, those the
+		 * decoder needs to prime itself (the one before for Vorbis, 80ms
+		 * for Opus) are decoded without output, and the first buffer is
+		 * cut to the target sample and timestamped with it. Needs the
+		 * headers to have been read; a negative time cancels.
+		 */
+		void setAudioSeekTarget(double aTime);
+
+		/**
+		 * Threaded mode: a worker thread demuxes and decodes up to aDepth
+		 * owned frames ahead into a lock-free ring, along with the audio
+		 * that goes with them. While it runs, only feed input and pop
+		 * results; process()/decodeFrame()/decodeAudio() belong to the
+		 * worker, which also fires onLoadedMetadata.
+		 *
+		 * With aSplitAudioVideo, demuxing, video decoding and audio
+		 * decoding each get their own thread, connected by per-track
+		 * packet queues, so a heavy frame never holds up the audio.
+		 *
+		 * flush() stops the workers, empties the queues and restarts them.
+		 */
+		void startDecodeAhead(int aDepth, bool aSplitAudioVideo = false);
+		/**
+		 * Decode ahead as above, but as a chain of tasks on a shared
+		 * scheduler instead of a dedicated thread. At most one step of
+		 * this decoder is in flight at once, so its demux and decode
+		 * stay in order. The scheduler must outlive the decode-ahead.
+		 */
+		void startDecodeAhead(int aDepth, DecoderScheduler &aScheduler);
+		void stopDecodeAhead();
+		/**
+		 * @return the next decoded frame, or null if none is ready yet
+		 */
+		std::shared_ptr<FrameBuffer> popFrame();
+		/**
+		 * @return the next decoded audio, or null if none is ready yet
+		 */
+		std::shared_ptr<AudioBuffer> popAudio();
+		DecodeAheadStats getDecodeAheadStats() const;
+
+		/**
+		 * Batch mode: decode the whole video track of a file opened with
+		 * openFile(), splitting it at keyframes (Skeleton keypoints if
+		 * present, otherwise a page scan) and decoding the pieces on
+		 * aThreads workers. Frames come back on the calling thread in
+		 * presentation order. Needs headers loaded; doesn't touch the
+		 * regular demux position or decoder state. Audio is not decoded.
+		 *
+		 * @param aThreads worker count, or 0 for one per core
+		 * @return frames delivered, or -1 if there is no mapped video
+		 */
+		long decodeSegments(int aThreads, std::function<void(FrameBuffer &aBuffer)> aCallback);
+
 		void flush();	
 
 		/**
@@ -223,6 +677,39 @@ namespace OGVCore {
 		 */
 		double getDuration() const;
 		long getKeypointOffset(double aTime);
+		/**
+		 * For a file opened with openFile() that has no Skeleton index,
+		 * index the video keyframes (or, for audio only, the audio) from
+		 * the Ogg page headers alone, without decoding any payload.
+		 * getKeypointOffset() and getDuration() then answer from it.
+		 * Call once the headers have been read. If a saved index was
+		 * found by openFile(), there's nothing to do.
+		 *
+		 * @param aBackground scan on a thread of its own and return at
+		 *        once; until it's done, nothing changes
+		 * @return false if there's no mapped file or stream to index
+		 */
+		bool buildKeyframeIndex(bool aBackground = false);
+		bool keyframeIndexReady() const;
+		/**
+		 * Save the index built by buildKeyframeIndex() for openFile()
+		 * to pick up next time, so reopening costs no scan.
+		 *
+		 * @param aPath where to write it; by default beside the file
+		 * @return false if there's no finished index or it can't be written
+		 */
+		bool saveKeyframeIndex(const std::string &aPath = std::string());
+
+		DemuxStats getDemuxStats() const;
+
+		/**
+		 * For seeking: the first timestamped page demuxed since the last
+		 * flush(), with its exact byte range, so a search can narrow to
+		 * page boundaries rather than its probe offsets.
+		 *
+		 * @return false if none has turned up yet
+		 */
+		bool firstTimestampedPage(TimestampedPage &aPage) const;
 
 	private:
 		class impl; std::unique_ptr<impl> pimpl;
@@ -250,6 +737,75 @@ namespace OGVCore {
 		virtual void unmute() = 0;
 	};
 
+	///
+	/// Lock-free single-producer, single-consumer ring of interleaved
+	/// samples, for handing decoded audio to a realtime audio callback.
+	/// Reads and writes are wait-free and never allocate; the buffered
+	/// level can be checked from any thread.
+	///
+	class AudioRing {
+	public:
+		/**
+		 * @param aFormat any interleaved format
+		 * @param aCapacity frames the ring holds
+		 * @param aMaxWrite largest single beginWrite(), in frames
+		 */
+		AudioRing(const AudioLayout &aLayout, AudioSampleFormat aFormat, int aCapacity, int aMaxWrite = 16384);
+		~AudioRing();
+
+		const AudioLayout &layout() const;
+		AudioSampleFormat format() const;
+		int capacity() const;
+		int maxWrite() const;
+
+		/**
+		 * Producer side: contiguous room for aFrames, even across the
+		 * wrap, to fill and then hand over with commitWrite().
+		 *
+		 * @return null if fewer than aFrames are free, or aFrames > maxWrite()
+		 */
+		void *beginWrite(int aFrames);
+		void commitWrite(int aFrames);
+		/**
+		 * Producer side: copy in as many frames as fit.
+		 * @return frames written
+		 */
+		int write(const void *aFrames, int aCount);
+		int writableFrames() const;
+
+		/**
+		 * Consumer side, safe on a realtime thread. Any shortfall is
+		 * filled with silence and, the first time in a row it happens,
+		 * reported to the delegate's onStarved() on this thread.
+		 *
+		 * @return frames of real audio read
+		 */
+		int read(void *aOutput, int aFrames);
+		/**
+		 * Consumer side: drop everything buffered, eg after a seek.
+		 */
+		void discard();
+		int readableFrames() const;
+
+		/**
+		 * Seconds of audio buffered; safe from any thread.
+		 */
+		double getBufferedTime() const;
+		/**
+		 * Short reads so far.
+		 */
+		long getUnderruns() const;
+
+		/**
+		 * The delegate must outlive the ring, or be replaced first
+		 * while the consumer isn't reading.
+		 */
+		void setDelegate(AudioFeeder::Delegate *aDelegate);
+
+	private:
+		class impl; std::unique_ptr<impl> pimpl;
+	};
+
 	///
 	/// Abstract class for JS, Cocoa, etc backends to implement
 	/// platform-specific streaming download behavior...
@@ -261,19 +817,28 @@ namespace OGVCore {
 		public:
 			virtual void onStart() = 0;
 			virtual void onBuffer() = 0;
-			virtual void onRead(std::vector<unsigned char> data) = 0;
+			virtual void onRead(const unsigned char *aBytes, size_t aLength) = 0;
+
+			/**
+			 * Backends that can read straight into memory should ask for
+			 * a buffer here and report the filled count to commitReadBuffer()
+			 * instead of calling onRead(); that skips a copy per chunk.
+			 */
+			virtual unsigned char *acquireReadBuffer(size_t aLength) = 0;
+			virtual void commitReadBuffer(size_t aLength) = 0;
 			virtual void onDone() = 0;
 			virtual void onError(std::string err) = 0;
 		};
 
 		virtual void readBytes() = 0;
 		virtual void abort() = 0;
-		virtual void seek(long aBytePosition) = 0;
+		// Byte positions are 64-bit so files past 2GB seek right on every platform.
+		virtual void seek(int64_t aBytePosition) = 0;
 
 		virtual std::string getResponseHeader(std::string aHeaderName) = 0;
-		virtual long bytesTotal() = 0;
-		virtual long bytesBuffered() = 0;
-		virtual long bytesRead() = 0;
+		virtual int64_t bytesTotal() = 0;
+		virtual int64_t bytesBuffered() = 0;
+		virtual int64_t bytesRead() = 0;
 		virtual bool isSeekable() = 0;
 	};
 
@@ -292,7 +857,14 @@ namespace OGVCore {
 	///
 	class Timer {
 	public:
+		/**
+		 * @return seconds on a monotonic clock
+		 */
 		virtual double getTimestamp() = 0;
+		/**
+		 * Have Player::process() called after aDelay seconds, replacing
+		 * any timeout already pending.
+		 */
 		virtual void setTimeout(double aDelay) = 0;
 	};
 
@@ -340,6 +912,44 @@ namespace OGVCore {
 		bool getPlaying();
 		bool getSeeking();
 
+		/**
+		 * While playing, audio is decoded in batches whenever the
+		 * output's buffered time drops below aLowWater, topping it up to
+		 * aHighWater. A wider gap means fewer wakeups; a higher low
+		 * watermark means fewer underruns. Defaults are 0.25s and 1s.
+		 */
+		void setAudioWatermarks(double aLowWater, double aHighWater);
+		AudioGovernorStats getAudioGovernorStats();
+
+	private:
+		class impl; std::unique_ptr<impl> pimpl;
+	};
+
+	/**
+	 * Rewrites an Ogg Theora/Vorbis/Opus file with a Skeleton 4 stream
+	 * added, carrying a keypoint index for every track, so players can
+	 * seek with one request instead of bisecting. The input is scanned
+	 * once, by page headers; its pages are copied through verbatim,
+	 * never re-encoded.
+	 */
+	class SkeletonIndexer {
+	public:
+		SkeletonIndexer();
+		~SkeletonIndexer();
+
+		/**
+		 * @return false on failure, eg if the input isn't Ogg, has a
+		 *         stream it doesn't know, or already has a Skeleton;
+		 *         getError() says which
+		 */
+		bool write(const std::string &aInputPath, const std::string &aOutputPath);
+
+		std::string getError() const;
+		/**
+		 * @return keypoints written last time, over all streams
+		 */
+		long getKeypointCount() const;
+
 	private:
 		class impl; std::unique_ptr<impl> pimpl;
 	};
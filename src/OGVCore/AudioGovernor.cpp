@@ -0,0 +1,136 @@
+//
+// Platform-independent Ogg Vorbis/Theora/Opus decoder/player base
+//
+// Copyright (c) 2013-2015 Brion Vibber <brion@pobox.com>
+// MIT-style license
+// Please reuse and redistribute with the LICENSE notes intact.
+//
+
+#include <algorithm>
+
+#include "AudioGovernor.h"
+
+namespace OGVCore {
+
+    namespace {
+
+        // Eight bins up to the high watermark, then a few for overshoot.
+        const int HISTOGRAM_BINS = 12;
+        const int BINS_PER_HIGH_WATER = 8;
+
+        // Don't spin when input is short, or oversleep on a bad rate guess.
+        const double MIN_DELAY = 0.005;
+        const double MIN_DRAIN_RATE = 0.25;
+        const double MAX_DRAIN_RATE = 4.0;
+
+    }
+
+    AudioGovernor::AudioGovernor(double aLowWater, double aHighWater) :
+        lowWater_(0),
+        highWater_(0),
+        histogram_(HISTOGRAM_BINS)
+    {
+        setWatermarks(aLowWater, aHighWater);
+    }
+
+    void AudioGovernor::setWatermarks(double aLowWater, double aHighWater)
+    {
+        lowWater_ = std::max(aLowWater, 0.0);
+        highWater_ = std::max(aHighWater, lowWater_ + MIN_DELAY);
+        restart();
+        clearStats();
+    }
+
+    double AudioGovernor::wake(double aNow, double aBuffered)
+    {
+        if (startTime_ < 0) {
+            startTime_ = aNow;
+        }
+        wakeups_++;
+        double binWidth = highWater_ / BINS_PER_HIGH_WATER;
+        int bin = std::min((int)(aBuffered / binWidth), HISTOGRAM_BINS - 1);
+        histogram_[std::max(bin, 0)]++;
+
+        if (lastTime_ >= 0 && aNow > lastTime_ && aBuffered > 0) {
+            // Only a level that hasn't bottomed out says how fast it drains.
+            double rate = (lastLevel_ - aBuffered) / (aNow - lastTime_);
+            rate = std::min(std::max(rate, MIN_DRAIN_RATE), MAX_DRAIN_RATE);
+            drainRate_ = drainRate_ * 0.75 + rate * 0.25;
+        }
+        if (aBuffered <= 0 && lastLevel_ > 0) {
+            starved();
+        }
+
+        lastTime_ = aNow;
+        lastLevel_ = aBuffered;
+        wakeLevel_ = aBuffered;
+        if (aBuffered >= lowWater_) {
+            return 0;
+        }
+        return highWater_ - aBuffered;
+    }
+
+    double AudioGovernor::refilled(double aNow, double aBuffered)
+    {
+        if (aBuffered > wakeLevel_) {
+            batches_++;
+            secondsDecoded_ += aBuffered - wakeLevel_;
+        }
+        if (aBuffered > 0) {
+            dry_ = false;
+        }
+        lastTime_ = aNow;
+        lastLevel_ = aBuffered;
+        wakeLevel_ = aBuffered;
+
+        if (aBuffered < lowWater_) {
+            // Input came up short; look again soon, but not so soon we spin.
+            return std::max(lowWater_ / 4, MIN_DELAY);
+        }
+        return std::max((aBuffered - lowWater_) / drainRate_, MIN_DELAY);
+    }
+
+    void AudioGovernor::starved()
+    {
+        if (!dry_) {
+            underruns_++;
+            dry_ = true;
+        }
+    }
+
+    void AudioGovernor::restart()
+    {
+        drainRate_ = 1.0;
+        lastTime_ = -1;
+        lastLevel_ = 0;
+        wakeLevel_ = 0;
+        dry_ = false;
+    }
+
+    AudioGovernorStats AudioGovernor::stats(double aNow) const
+    {
+        AudioGovernorStats stats;
+        stats.lowWater = lowWater_;
+        stats.highWater = highWater_;
+        stats.wakeups = wakeups_;
+        stats.batches = batches_;
+        stats.underruns = underruns_;
+        stats.secondsDecoded = secondsDecoded_;
+        stats.elapsed = (startTime_ >= 0) ? aNow - startTime_ : 0;
+        stats.wakeupsPerSecond = (stats.elapsed > 0) ? wakeups_ / stats.elapsed : 0;
+        stats.histogramBinWidth = highWater_ / BINS_PER_HIGH_WATER;
+        stats.bufferedHistogram = histogram_;
+        return stats;
+    }
+
+    void AudioGovernor::clearStats()
+    {
+        startTime_ = -1;
+        wakeups_ = 0;
+        batches_ = 0;
+        underruns_ = 0;
+        secondsDecoded_ = 0;
+        std::fill(histogram_.begin(), histogram_.end(), 0);
+    }
+
+}
@@ -0,0 +1,84 @@
+//
+// Platform-independent Ogg Vorbis/Theora/Opus decoder/player base
+//
+// Copyright (c) 2013-2015 Brion Vibber <brion@pobox.com>
+// MIT-style license
+// Please reuse and redistribute with the LICENSE notes intact.
+//
+
+#pragma once
+
+#include <vector>
+
+#include <OGVCore.h>
+
+namespace OGVCore {
+
+	/**
+	 * Decides when to wake up and how much audio to decode, keeping the
+	 * output's buffered time between a low and a high watermark. Once
+	 * the level drops under the low one it's topped up to the high one
+	 * in a single batch, and the next wakeup is timed for when the level
+	 * should be back at the low one, at the drain rate actually seen. So
+	 * the wider the gap, the fewer and bigger the batches.
+	 *
+	 * All times are in seconds; the clock is whatever the caller's is.
+	 */
+	class AudioGovernor {
+	public:
+		AudioGovernor(double aLowWater = 0.25, double aHighWater = 1.0);
+
+		/**
+		 * Also clears the stats, since the histogram bins follow the
+		 * high watermark.
+		 */
+		void setWatermarks(double aLowWater, double aHighWater);
+		double lowWater() const { return lowWater_; }
+		double highWater() const { return highWater_; }
+
+		/**
+		 * A wakeup, finding aBuffered seconds queued at the output.
+		 *
+		 * @return seconds of audio to decode now; 0 if there's enough
+		 */
+		double wake(double aNow, double aBuffered);
+		/**
+		 * The batch, if any, is queued and the output now holds
+		 * aBuffered seconds, which may be short if input ran out.
+		 *
+		 * @return seconds until the next wakeup
+		 */
+		double refilled(double aNow, double aBuffered);
+		/**
+		 * The output ran dry between wakeups.
+		 */
+		void starved();
+		/**
+		 * Forget the drain rate and last level, eg across a pause or
+		 * seek; stats carry on.
+		 */
+		void restart();
+
+		AudioGovernorStats stats(double aNow) const;
+
+	private:
+		double lowWater_;
+		double highWater_;
+
+		double drainRate_;   // output seconds played per clock second, smoothed
+		double lastTime_;    // when the level was last known, or -1
+		double lastLevel_;   // what it was then
+		double wakeLevel_;   // level at the current wakeup, before the batch
+		bool dry_;           // this underrun has been counted already
+
+		double startTime_;
+		long wakeups_;
+		long batches_;
+		long underruns_;
+		double secondsDecoded_;
+		std::vector<long> histogram_;
+
+		void clearStats();
+	};
+
+}
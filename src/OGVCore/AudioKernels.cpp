@@ -0,0 +1,541 @@
+//
+// Platform-independent Ogg Vorbis/Theora/Opus decoder/player base
+//
+// Copyright (c) 2013-2015 Brion Vibber <brion@pobox.com>
+// MIT-style license
+// Please reuse and redistribute with the LICENSE notes intact.
+//
+
+#include <assert.h>
+#include <math.h>
+#include <string.h>
+
+#include "AudioKernels.h"
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#define OGVCORE_CONVERT_SSE2 1
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#define OGVCORE_CONVERT_NEON 1
+#endif
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define OGVCORE_CONVERT_AVX2 1
+#endif
+
+namespace OGVCore {
+
+    static void deinterleaveStereo(const float *aInput, int aFrames, float *aLeft, float *aRight)
+    {
+        int i = 0;
+#if defined(__SSE2__)
+        for (; i + 4 <= aFrames; i += 4) {
+            __m128 a = _mm_loadu_ps(aInput + i * 2);      // L0 R0 L1 R1
+            __m128 b = _mm_loadu_ps(aInput + i * 2 + 4);  // L2 R2 L3 R3
+            _mm_storeu_ps(aLeft + i, _mm_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0)));
+            _mm_storeu_ps(aRight + i, _mm_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1)));
+        }
+#elif defined(__ARM_NEON)
+        for (; i + 4 <= aFrames; i += 4) {
+            float32x4x2_t lr = vld2q_f32(aInput + i * 2);
+            vst1q_f32(aLeft + i, lr.val[0]);
+            vst1q_f32(aRight + i, lr.val[1]);
+        }
+#endif
+        for (; i < aFrames; i++) {
+            aLeft[i] = aInput[i * 2];
+            aRight[i] = aInput[i * 2 + 1];
+        }
+    }
+
+    void audioDeinterleave(const float *aInput, int aChannels, int aFrames, float *const *aOutput)
+    {
+        if (aChannels == 1) {
+            memcpy(aOutput[0], aInput, sizeof(float) * aFrames);
+        } else if (aChannels == 2) {
+            deinterleaveStereo(aInput, aFrames, aOutput[0], aOutput[1]);
+        } else {
+            // Surround layouts are rare enough for the plain loop; walk the
+            // input in order so it streams through the cache once.
+            for (int i = 0; i < aFrames; i++) {
+                const float *frame = aInput + i * aChannels;
+                for (int c = 0; c < aChannels; c++) {
+                    aOutput[c][i] = frame[c];
+                }
+            }
+        }
+    }
+
+
+    AudioDither::AudioDither(uint32_t aSeed)
+    {
+        // Spread the seed over the lanes; xorshift must never see zero.
+        for (int i = 0; i < 8; i++) {
+            aSeed = aSeed * 1664525U + 1013904223U;
+            state[i] = aSeed ? aSeed : 1;
+        }
+    }
+
+    namespace {
+
+        // Integer full scale; S32's top is the largest float below 2^31,
+        // since 2^31 itself would overflow the conversion.
+        const float S16_SCALE = 32767.0f;
+        const float S16_MIN = -32768.0f;
+        const float S16_MAX = 32767.0f;
+        const float S32_SCALE = 2147483647.0f;
+        const float S32_MIN = -2147483648.0f;
+        const float S32_MAX = 2147483520.0f;
+        const float UNIFORM_SCALE = 1.0f / 16777216.0f;
+
+        inline uint32_t xorshift(uint32_t &s)
+        {
+            s ^= s << 13;
+            s ^= s >> 17;
+            s ^= s << 5;
+            return s;
+        }
+
+        /* triangular noise in (-1, 1), ie +/- one LSB */
+        inline float tpdf(uint32_t &s)
+        {
+            float a = (float)(xorshift(s) >> 8) * UNIFORM_SCALE;
+            float b = (float)(xorshift(s) >> 8) * UNIFORM_SCALE;
+            return a - b;
+        }
+
+        inline float clip(float x, float lo, float hi)
+        {
+            return x < lo ? lo : (x > hi ? hi : x);
+        }
+
+        void convertS16Scalar(const float *in, size_t n, int16_t *out, AudioDither *dither)
+        {
+            if (dither) {
+                uint32_t &s = dither->state[0];
+                for (size_t i = 0; i < n; i++) {
+                    out[i] = (int16_t)lrintf(clip(in[i] * S16_SCALE + tpdf(s), S16_MIN, S16_MAX));
+                }
+            } else {
+                for (size_t i = 0; i < n; i++) {
+                    out[i] = (int16_t)lrintf(clip(in[i] * S16_SCALE, S16_MIN, S16_MAX));
+                }
+            }
+        }
+
+        void convertS32Scalar(const float *in, size_t n, int32_t *out)
+        {
+            for (size_t i = 0; i < n; i++) {
+                out[i] = (int32_t)lrintf(clip(in[i] * S32_SCALE, S32_MIN, S32_MAX));
+            }
+        }
+
+#ifdef OGVCORE_CONVERT_SSE2
+        inline __m128i xorshift4(__m128i &s)
+        {
+            s = _mm_xor_si128(s, _mm_slli_epi32(s, 13));
+            s = _mm_xor_si128(s, _mm_srli_epi32(s, 17));
+            s = _mm_xor_si128(s, _mm_slli_epi32(s, 5));
+            return s;
+        }
+
+        inline __m128 tpdf4(__m128i &s)
+        {
+            const __m128 scale = _mm_set1_ps(UNIFORM_SCALE);
+            __m128 a = _mm_cvtepi32_ps(_mm_srli_epi32(xorshift4(s), 8));
+            __m128 b = _mm_cvtepi32_ps(_mm_srli_epi32(xorshift4(s), 8));
+            return _mm_mul_ps(_mm_sub_ps(a, b), scale);
+        }
+
+        /* scale, dither and clip four samples; packing saturates the rest */
+        inline __m128i scaleS16x4(const float *in, __m128i *s)
+        {
+            __m128 x = _mm_mul_ps(_mm_loadu_ps(in), _mm_set1_ps(S16_SCALE));
+            if (s) {
+                x = _mm_add_ps(x, tpdf4(*s));
+            }
+            x = _mm_min_ps(_mm_max_ps(x, _mm_set1_ps(S16_MIN)), _mm_set1_ps(S16_MAX));
+            return _mm_cvtps_epi32(x);
+        }
+
+        void convertS16Sse2(const float *in, size_t n, int16_t *out, AudioDither *dither)
+        {
+            size_t i = 0;
+            __m128i s;
+            __m128i *sp = nullptr;
+            if (dither) {
+                s = _mm_loadu_si128((const __m128i *)dither->state);
+                sp = &s;
+            }
+            for (; i + 8 <= n; i += 8) {
+                __m128i lo = scaleS16x4(in + i, sp);
+                __m128i hi = scaleS16x4(in + i + 4, sp);
+                _mm_storeu_si128((__m128i *)(out + i), _mm_packs_epi32(lo, hi));
+            }
+            if (dither) {
+                _mm_storeu_si128((__m128i *)dither->state, s);
+            }
+            convertS16Scalar(in + i, n - i, out + i, dither);
+        }
+
+        void convertS32Sse2(const float *in, size_t n, int32_t *out)
+        {
+            const __m128 scale = _mm_set1_ps(S32_SCALE);
+            const __m128 lo = _mm_set1_ps(S32_MIN);
+            const __m128 hi = _mm_set1_ps(S32_MAX);
+            size_t i = 0;
+            for (; i + 4 <= n; i += 4) {
+                __m128 x = _mm_mul_ps(_mm_loadu_ps(in + i), scale);
+                x = _mm_min_ps(_mm_max_ps(x, lo), hi);
+                _mm_storeu_si128((__m128i *)(out + i), _mm_cvtps_epi32(x));
+            }
+            convertS32Scalar(in + i, n - i, out + i);
+        }
+#endif
+
+#ifdef OGVCORE_CONVERT_AVX2
+        __attribute__((target("avx2")))
+        inline __m256i xorshift8(__m256i &s)
+        {
+            s = _mm256_xor_si256(s, _mm256_slli_epi32(s, 13));
+            s = _mm256_xor_si256(s, _mm256_srli_epi32(s, 17));
+            s = _mm256_xor_si256(s, _mm256_slli_epi32(s, 5));
+            return s;
+        }
+
+        __attribute__((target("avx2")))
+        inline __m256i scaleS16x8(const float *in, __m256i *s)
+        {
+            __m256 x = _mm256_mul_ps(_mm256_loadu_ps(in), _mm256_set1_ps(S16_SCALE));
+            if (s) {
+                __m256 a = _mm256_cvtepi32_ps(_mm256_srli_epi32(xorshift8(*s), 8));
+                __m256 b = _mm256_cvtepi32_ps(_mm256_srli_epi32(xorshift8(*s), 8));
+                x = _mm256_add_ps(x, _mm256_mul_ps(_mm256_sub_ps(a, b), _mm256_set1_ps(UNIFORM_SCALE)));
+            }
+            x = _mm256_min_ps(_mm256_max_ps(x, _mm256_set1_ps(S16_MIN)), _mm256_set1_ps(S16_MAX));
+            return _mm256_cvtps_epi32(x);
+        }
+
+        __attribute__((target("avx2")))
+        void convertS16Avx2(const float *in, size_t n, int16_t *out, AudioDither *dither)
+        {
+            size_t i = 0;
+            __m256i s;
+            __m256i *sp = nullptr;
+            if (dither) {
+                s = _mm256_loadu_si256((const __m256i *)dither->state);
+                sp = &s;
+            }
+            for (; i + 16 <= n; i += 16) {
+                __m256i lo = scaleS16x8(in + i, sp);
+                __m256i hi = scaleS16x8(in + i + 8, sp);
+                // packs works per 128-bit lane; put the quarters back in order.
+                __m256i packed = _mm256_permute4x64_epi64(_mm256_packs_epi32(lo, hi), _MM_SHUFFLE(3, 1, 2, 0));
+                _mm256_storeu_si256((__m256i *)(out + i), packed);
+            }
+            if (dither) {
+                _mm256_storeu_si256((__m256i *)dither->state, s);
+            }
+            convertS16Scalar(in + i, n - i, out + i, dither);
+        }
+
+        __attribute__((target("avx2")))
+        void convertS32Avx2(const float *in, size_t n, int32_t *out)
+        {
+            const __m256 scale = _mm256_set1_ps(S32_SCALE);
+            const __m256 lo = _mm256_set1_ps(S32_MIN);
+            const __m256 hi = _mm256_set1_ps(S32_MAX);
+            size_t i = 0;
+            for (; i + 8 <= n; i += 8) {
+                __m256 x = _mm256_mul_ps(_mm256_loadu_ps(in + i), scale);
+                x = _mm256_min_ps(_mm256_max_ps(x, lo), hi);
+                _mm256_storeu_si256((__m256i *)(out + i), _mm256_cvtps_epi32(x));
+            }
+            convertS32Scalar(in + i, n - i, out + i);
+        }
+
+        bool avx2Available()
+        {
+            __builtin_cpu_init();
+            return __builtin_cpu_supports("avx2");
+        }
+#endif
+
+#ifdef OGVCORE_CONVERT_NEON
+        inline uint32x4_t xorshift4(uint32x4_t &s)
+        {
+            s = veorq_u32(s, vshlq_n_u32(s, 13));
+            s = veorq_u32(s, vshrq_n_u32(s, 17));
+            s = veorq_u32(s, vshlq_n_u32(s, 5));
+            return s;
+        }
+
+        /* vcvtq truncates, so round half away from zero by hand */
+        inline int32x4_t roundToInt(float32x4_t x)
+        {
+            uint32x4_t negative = vcltq_f32(x, vdupq_n_f32(0.0f));
+            float32x4_t half = vbslq_f32(negative, vdupq_n_f32(-0.5f), vdupq_n_f32(0.5f));
+            return vcvtq_s32_f32(vaddq_f32(x, half));
+        }
+
+        inline int16x4_t scaleS16x4(const float *in, uint32x4_t *s)
+        {
+            float32x4_t x = vmulq_n_f32(vld1q_f32(in), S16_SCALE);
+            if (s) {
+                float32x4_t a = vcvtq_f32_u32(vshrq_n_u32(xorshift4(*s), 8));
+                float32x4_t b = vcvtq_f32_u32(vshrq_n_u32(xorshift4(*s), 8));
+                x = vmlaq_n_f32(x, vsubq_f32(a, b), UNIFORM_SCALE);
+            }
+            x = vminq_f32(vmaxq_f32(x, vdupq_n_f32(S16_MIN)), vdupq_n_f32(S16_MAX));
+            return vqmovn_s32(roundToInt(x));
+        }
+
+        void convertS16Neon(const float *in, size_t n, int16_t *out, AudioDither *dither)
+        {
+            size_t i = 0;
+            uint32x4_t s;
+            uint32x4_t *sp = nullptr;
+            if (dither) {
+                s = vld1q_u32(dither->state);
+                sp = &s;
+            }
+            for (; i + 8 <= n; i += 8) {
+                int16x4_t lo = scaleS16x4(in + i, sp);
+                int16x4_t hi = scaleS16x4(in + i + 4, sp);
+                vst1q_s16(out + i, vcombine_s16(lo, hi));
+            }
+            if (dither) {
+                vst1q_u32(dither->state, s);
+            }
+            convertS16Scalar(in + i, n - i, out + i, dither);
+        }
+
+        void convertS32Neon(const float *in, size_t n, int32_t *out)
+        {
+            const float32x4_t lo = vdupq_n_f32(S32_MIN);
+            const float32x4_t hi = vdupq_n_f32(S32_MAX);
+            size_t i = 0;
+            for (; i + 4 <= n; i += 4) {
+                float32x4_t x = vmulq_n_f32(vld1q_f32(in + i), S32_SCALE);
+                x = vminq_f32(vmaxq_f32(x, lo), hi);
+                vst1q_s32(out + i, roundToInt(x));
+            }
+            convertS32Scalar(in + i, n - i, out + i);
+        }
+#endif
+
+        typedef void (*S16Func)(const float *, size_t, int16_t *, AudioDither *);
+        typedef void (*S32Func)(const float *, size_t, int32_t *);
+
+        struct ConvertFuncs {
+            S16Func s16;
+            S32Func s32;
+        };
+
+        bool kernelFuncs(AudioConvertKernel kernel, ConvertFuncs &funcs)
+        {
+            switch (kernel) {
+                case AUDIO_CONVERT_SCALAR:
+                    funcs.s16 = convertS16Scalar;
+                    funcs.s32 = convertS32Scalar;
+                    return true;
+#ifdef OGVCORE_CONVERT_SSE2
+                case AUDIO_CONVERT_SSE2:
+                    funcs.s16 = convertS16Sse2;
+                    funcs.s32 = convertS32Sse2;
+                    return true;
+#endif
+#ifdef OGVCORE_CONVERT_AVX2
+                case AUDIO_CONVERT_AVX2:
+                    funcs.s16 = convertS16Avx2;
+                    funcs.s32 = convertS32Avx2;
+                    return avx2Available();
+#endif
+#ifdef OGVCORE_CONVERT_NEON
+                case AUDIO_CONVERT_NEON:
+                    funcs.s16 = convertS16Neon;
+                    funcs.s32 = convertS32Neon;
+                    return true;
+#endif
+                default:
+                    return false;
+            }
+        }
+
+        struct Dispatch {
+            AudioConvertKernel kernel;
+            ConvertFuncs funcs;
+
+            Dispatch() :
+                kernel(AUDIO_CONVERT_SCALAR)
+            {
+                kernelFuncs(AUDIO_CONVERT_SCALAR, funcs);
+                const AudioConvertKernel preferred[] = {AUDIO_CONVERT_AVX2, AUDIO_CONVERT_SSE2, AUDIO_CONVERT_NEON};
+                for (size_t i = 0; i < sizeof(preferred) / sizeof(preferred[0]); i++) {
+                    ConvertFuncs f;
+                    if (kernelFuncs(preferred[i], f)) {
+                        kernel = preferred[i];
+                        funcs = f;
+                        break;
+                    }
+                }
+            }
+        };
+
+        const Dispatch &dispatch()
+        {
+            static const Dispatch selected;
+            return selected;
+        }
+
+        void convertWith(const ConvertFuncs &funcs, const float *aInput, size_t aCount, AudioSampleFormat aFormat, void *aOutput, AudioDither *aDither)
+        {
+            switch (aFormat) {
+                case AUDIO_SAMPLE_FLOAT:
+                    memcpy(aOutput, aInput, sizeof(float) * aCount);
+                    break;
+                case AUDIO_SAMPLE_S16:
+                    funcs.s16(aInput, aCount, (int16_t *)aOutput, aDither);
+                    break;
+                case AUDIO_SAMPLE_S32:
+                    funcs.s32(aInput, aCount, (int32_t *)aOutput);
+                    break;
+                default:
+                    assert(!"planar output is not a conversion");
+                    break;
+            }
+        }
+
+    }
+
+    bool audioConvertKernelAvailable(AudioConvertKernel kernel)
+    {
+        ConvertFuncs funcs;
+        return kernelFuncs(kernel, funcs);
+    }
+
+    const char *audioConvertKernelName(AudioConvertKernel kernel)
+    {
+        switch (kernel) {
+            case AUDIO_CONVERT_SCALAR: return "scalar";
+            case AUDIO_CONVERT_SSE2:   return "sse2";
+            case AUDIO_CONVERT_AVX2:   return "avx2";
+            case AUDIO_CONVERT_NEON:   return "neon";
+            default:                   return "unknown";
+        }
+    }
+
+    AudioConvertKernel audioConvertSelectedKernel()
+    {
+        return dispatch().kernel;
+    }
+
+    void audioConvert(const float *aInput, size_t aCount, AudioSampleFormat aFormat, void *aOutput, AudioDither *aDither)
+    {
+        convertWith(dispatch().funcs, aInput, aCount, aFormat, aOutput, aDither);
+    }
+
+    void audioConvertWith(AudioConvertKernel kernel, const float *aInput, size_t aCount, AudioSampleFormat aFormat, void *aOutput, AudioDither *aDither)
+    {
+        ConvertFuncs funcs;
+        bool available = kernelFuncs(kernel, funcs);
+        assert(available);
+        (void)available;
+        convertWith(funcs, aInput, aCount, aFormat, aOutput, aDither);
+    }
+
+    void audioInterleave(const float *const *aInput, int aChannels, int aFrames, AudioSampleFormat aFormat, void *aOutput, AudioDither *aDither)
+    {
+        // 16KB of scratch stays in L1 between the interleave and the convert.
+        const int scratchSamples = 4096;
+        float scratch[scratchSamples];
+        int chunkFrames = scratchSamples / aChannels; // Vorbis tops out at 255 channels
+        size_t frameBytes = audioSampleSize(aFormat) * aChannels;
+        unsigned char *output = (unsigned char *)aOutput;
+
+        for (int start = 0; start < aFrames; start += chunkFrames) {
+            int frames = (aFrames - start < chunkFrames) ? aFrames - start : chunkFrames;
+            // Float output needs no conversion, so interleave straight into it.
+            float *dest = (aFormat == AUDIO_SAMPLE_FLOAT) ? (float *)output : scratch;
+            for (int i = 0; i < frames; i++) {
+                for (int c = 0; c < aChannels; c++) {
+                    dest[i * aChannels + c] = aInput[c][start + i];
+                }
+            }
+            if (aFormat != AUDIO_SAMPLE_FLOAT) {
+                audioConvert(scratch, (size_t)frames * aChannels, aFormat, output, aDither);
+            }
+            output += frames * frameBytes;
+        }
+    }
+
+    bool audioDownmixMatrix(int aInChannels, int aOutChannels, float *aMatrix)
+    {
+        // Where each input channel lands in stereo: left gain, right gain.
+        const float h = 0.70710678f;
+        static const float stereoGains[8][8][2] = {
+            {{h, h}},                                                                  // M
+            {{1, 0}, {0, 1}},                                                          // L R
+            {{1, 0}, {h, h}, {0, 1}},                                                  // L C R
+            {{1, 0}, {0, 1}, {h, 0}, {0, h}},                                          // FL FR RL RR
+            {{1, 0}, {h, h}, {0, 1}, {h, 0}, {0, h}},                                  // FL C FR RL RR
+            {{1, 0}, {h, h}, {0, 1}, {h, 0}, {0, h}, {0, 0}},                          // + LFE
+            {{1, 0}, {h, h}, {0, 1}, {h, 0}, {0, h}, {0.5f, 0.5f}, {0, 0}},            // FL C FR SL SR RC LFE
+            {{1, 0}, {h, h}, {0, 1}, {h, 0}, {0, h}, {h, 0}, {0, h}, {0, 0}},          // FL C FR SL SR RL RR LFE
+        };
+        if (aInChannels < 1 || aInChannels > 8 || aOutChannels < 1 || aOutChannels > 2) {
+            return false;
+        }
+        const float (*gains)[2] = stereoGains[aInChannels - 1];
+        for (int o = 0; o < aOutChannels; o++) {
+            float *row = aMatrix + o * aInChannels;
+            float total = 0;
+            for (int c = 0; c < aInChannels; c++) {
+                // Mono is the sum of the stereo pair.
+                row[c] = (aOutChannels == 1) ? gains[c][0] + gains[c][1] : gains[c][o];
+                total += row[c];
+            }
+            for (int c = 0; c < aInChannels; c++) {
+                row[c] /= total;
+            }
+        }
+        return true;
+    }
+
+    void audioMix(const float *const *aInput, int aInChannels, int aFrames,
+                  const float *aMatrix, int aOutChannels, float *const *aOutput)
+    {
+        for (int o = 0; o < aOutChannels; o++) {
+            const float *row = aMatrix + o * aInChannels;
+            float *out = aOutput[o];
+            int i = 0;
+#if defined(__SSE2__)
+            for (; i + 4 <= aFrames; i += 4) {
+                __m128 acc = _mm_mul_ps(_mm_loadu_ps(aInput[0] + i), _mm_set1_ps(row[0]));
+                for (int c = 1; c < aInChannels; c++) {
+                    acc = _mm_add_ps(acc, _mm_mul_ps(_mm_loadu_ps(aInput[c] + i), _mm_set1_ps(row[c])));
+                }
+                _mm_storeu_ps(out + i, acc);
+            }
+#elif defined(__ARM_NEON)
+            for (; i + 4 <= aFrames; i += 4) {
+                float32x4_t acc = vmulq_n_f32(vld1q_f32(aInput[0] + i), row[0]);
+                for (int c = 1; c < aInChannels; c++) {
+                    acc = vmlaq_n_f32(acc, vld1q_f32(aInput[c] + i), row[c]);
+                }
+                vst1q_f32(out + i, acc);
+            }
+#endif
+            for (; i < aFrames; i++) {
+                float acc = 0;
+                for (int c = 0; c < aInChannels; c++) {
+                    acc += aInput[c][i] * row[c];
+                }
+                out[i] = acc;
+            }
+        }
+    }
+
+}
@@ -0,0 +1,95 @@
+//
+// Platform-independent Ogg Vorbis/Theora/Opus decoder/player base
+//
+// Copyright (c) 2013-2015 Brion Vibber <brion@pobox.com>
+// MIT-style license
+// Please reuse and redistribute with the LICENSE notes intact.
+//
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <OGVCore.h>
+
+namespace OGVCore {
+
+	/**
+	 * Split interleaved float samples (eg Opus output) into one plane
+	 * per channel. Stereo, the common case, gets a SIMD path.
+	 *
+	 * @param aOutput aChannels plane pointers, each with room for aFrames
+	 */
+	void audioDeinterleave(const float *aInput, int aChannels, int aFrames, float *const *aOutput);
+
+	/**
+	 * Random state for TPDF dither; one per stream so the noise of
+	 * neighbouring packets doesn't correlate. Never all zero.
+	 */
+	struct AudioDither {
+		uint32_t state[8];
+
+		explicit AudioDither(uint32_t aSeed = 0x9e3779b9U);
+	};
+
+	/**
+	 * Available sample conversion implementations; the fastest one the
+	 * CPU supports is picked at runtime for audioConvert().
+	 */
+	enum AudioConvertKernel {
+		AUDIO_CONVERT_SCALAR,
+		AUDIO_CONVERT_SSE2,
+		AUDIO_CONVERT_AVX2,
+		AUDIO_CONVERT_NEON,
+		AUDIO_CONVERT_KERNEL_COUNT
+	};
+
+	bool audioConvertKernelAvailable(AudioConvertKernel kernel);
+	const char *audioConvertKernelName(AudioConvertKernel kernel);
+	AudioConvertKernel audioConvertSelectedKernel();
+
+	/**
+	 * Convert aCount float samples in [-1, 1] to an interleaved format,
+	 * clipping integer output. Layout is untouched, so interleaved input
+	 * (eg Opus output) comes out interleaved.
+	 *
+	 * @param aFormat any format but AUDIO_SAMPLE_FLOAT_PLANAR
+	 * @param aDither if not null, TPDF dither 16-bit output
+	 */
+	void audioConvert(const float *aInput, size_t aCount, AudioSampleFormat aFormat, void *aOutput, AudioDither *aDither);
+
+	/**
+	 * Run a specific kernel, for testing and benchmarking.
+	 * Kernel must be available.
+	 */
+	void audioConvertWith(AudioConvertKernel kernel, const float *aInput, size_t aCount, AudioSampleFormat aFormat, void *aOutput, AudioDither *aDither);
+
+	/**
+	 * Interleave planar float samples (eg vorbis_synthesis_pcmout's)
+	 * into aFormat, converting as with audioConvert(). Works through
+	 * small cache-resident chunks, so memory is only crossed once.
+	 */
+	void audioInterleave(const float *const *aInput, int aChannels, int aFrames, AudioSampleFormat aFormat, void *aOutput, AudioDither *aDither);
+
+	/**
+	 * Fill in a downmix matrix for the Vorbis channel order, which Opus
+	 * mapping family 1 shares. Centre and surrounds come in at -3dB, LFE
+	 * is dropped, and each output row is normalized so a full-scale
+	 * input can't clip.
+	 *
+	 * @param aMatrix room for aOutChannels * aInChannels gains, one row
+	 *        of aInChannels per output channel
+	 * @return false if there's no known layout for aInChannels (> 8)
+	 *         or aOutChannels isn't 1 or 2
+	 */
+	bool audioDownmixMatrix(int aInChannels, int aOutChannels, float *aMatrix);
+
+	/**
+	 * Mix planar float channels through a matrix from audioDownmixMatrix().
+	 * SIMD across samples, so any channel count vectorizes.
+	 */
+	void audioMix(const float *const *aInput, int aInChannels, int aFrames,
+	              const float *aMatrix, int aOutChannels, float *const *aOutput);
+
+}
@@ -0,0 +1,66 @@
+//
+// Platform-independent Ogg Vorbis/Theora/Opus decoder/player base
+//
+// Copyright (c) 2013-2015 Brion Vibber <brion@pobox.com>
+// MIT-style license
+// Please reuse and redistribute with the LICENSE notes intact.
+//
+
+// good ol' C library
+#include <stddef.h>
+#include <string.h>
+
+#include "AudioPool.h"
+
+namespace OGVCore {
+
+    AudioPool::AudioPool() :
+        buffers_(std::make_shared<FreeList<AudioBuffer>>()),
+        handles_(std::make_shared<FreeList<HandleChunk>>())
+    {}
+
+    std::shared_ptr<AudioBuffer> AudioPool::recycledBuffer()
+    {
+        AudioBuffer *buffer = buffers_->pop();
+        if (!buffer) {
+            buffer = new AudioBuffer();
+        }
+        return recycledHandle(buffer, buffers_, handles_);
+    }
+
+    std::shared_ptr<AudioBuffer> AudioPool::acquire(const AudioLayout &aLayout, int aSampleCount, AudioSampleFormat aFormat)
+    {
+        size_t size;
+        int stride = 0;
+        if (aFormat == AUDIO_SAMPLE_FLOAT_PLANAR) {
+            // Start every channel on a cache line so SIMD stores stay aligned.
+            const int floatsPerLine = (int)(BufferPool::ALIGNMENT / sizeof(float));
+            stride = (aSampleCount + floatsPerLine - 1) / floatsPerLine * floatsPerLine;
+            size = sizeof(float) * (size_t)stride * aLayout.channelCount;
+        } else {
+            size = audioSampleSize(aFormat) * (size_t)aSampleCount * aLayout.channelCount;
+        }
+
+        std::shared_ptr<AudioBuffer> buffer = recycledBuffer();
+        std::shared_ptr<BufferPool::Block> block = blocks_.acquire(size);
+
+        buffer->layout = aLayout;
+        buffer->sampleCount = aSampleCount;
+        buffer->timestamp = -1;
+        buffer->format = aFormat;
+        buffer->data = (float *)block->bytes();
+        buffer->channelStride = stride;
+        buffer->storage = block;
+        return buffer;
+    }
+
+    std::shared_ptr<AudioBuffer> AudioPool::copyPlanar(const AudioLayout &aLayout, int aSampleCount, const float *const *aSamples)
+    {
+        std::shared_ptr<AudioBuffer> buffer = acquire(aLayout, aSampleCount);
+        for (int c = 0; c < aLayout.channelCount; c++) {
+            memcpy(buffer->channel(c), aSamples[c], sizeof(float) * aSampleCount);
+        }
+        return buffer;
+    }
+
+}
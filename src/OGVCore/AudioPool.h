@@ -0,0 +1,57 @@
+//
+// Platform-independent Ogg Vorbis/Theora/Opus decoder/player base
+//
+// Copyright (c) 2013-2015 Brion Vibber <brion@pobox.com>
+// MIT-style license
+// Please reuse and redistribute with the LICENSE notes intact.
+//
+
+#pragma once
+
+#include <memory>
+
+#include <OGVCore.h>
+#include "BufferPool.h"
+#include "FreeList.h"
+
+namespace OGVCore {
+
+	/* a released buffer lets go of its block right away */
+	inline void recycleReset(AudioBuffer *aBuffer)
+	{
+		aBuffer->storage.reset();
+	}
+
+	/**
+	 * Hands out AudioBuffers whose channels share one aligned block from
+	 * a BufferPool. Dropping the last shared_ptr (eg an AudioFeeder's)
+	 * puts the buffer and its block back on their free lists, so steady
+	 * state decoding does no allocation. Acquire from one thread at a
+	 * time; references may be dropped anywhere.
+	 */
+	class AudioPool {
+	public:
+		AudioPool();
+
+		/**
+		 * @return a buffer sized for aSampleCount samples per channel in
+		 *         aFormat, holding stale data, for the caller to overwrite
+		 */
+		std::shared_ptr<AudioBuffer> acquire(const AudioLayout &aLayout, int aSampleCount, AudioSampleFormat aFormat = AUDIO_SAMPLE_FLOAT_PLANAR);
+
+		/**
+		 * Copy planar samples (eg vorbis_synthesis_pcmout's) into a pooled buffer.
+		 */
+		std::shared_ptr<AudioBuffer> copyPlanar(const AudioLayout &aLayout, int aSampleCount, const float *const *aSamples);
+
+		const BufferPool &bufferPool() const { return blocks_; }
+
+	private:
+		BufferPool blocks_;
+		std::shared_ptr<FreeList<AudioBuffer>> buffers_;
+		std::shared_ptr<FreeList<HandleChunk>> handles_;
+
+		std::shared_ptr<AudioBuffer> recycledBuffer();
+	};
+
+}
@@ -0,0 +1,273 @@
+//
+// Platform-independent Ogg Vorbis/Theora/Opus decoder/player base
+//
+// Copyright (c) 2013-2015 Brion Vibber <brion@pobox.com>
+// MIT-style license
+// Please reuse and redistribute with the LICENSE notes intact.
+//
+
+// C++ awesome
+#include <atomic>
+#include <vector>
+
+// good ol' C library
+#include <assert.h>
+#include <stdint.h>
+#include <string.h>
+
+// And our own headers.
+#include <OGVCore.h>
+#include "SPSCQueue.h"
+
+namespace OGVCore {
+
+#pragma mark - Declarations
+
+    class AudioRing::impl {
+    public:
+        impl(const AudioLayout &aLayout, AudioSampleFormat aFormat, int aCapacity, int aMaxWrite);
+
+        const AudioLayout &layout() const { return audioLayout; }
+        AudioSampleFormat format() const { return sampleFormat; }
+        int capacity() const { return frameCapacity; }
+        int maxWrite() const { return maxWriteFrames; }
+
+        void *beginWrite(int aFrames);
+        void commitWrite(int aFrames);
+        int write(const void *aFrames, int aCount);
+        int writableFrames() const;
+
+        int read(void *aOutput, int aFrames);
+        void discard();
+        int readableFrames() const;
+
+        double getBufferedTime() const;
+        long getUnderruns() const;
+        void setDelegate(AudioFeeder::Delegate *aDelegate);
+
+    private:
+        AudioLayout       audioLayout;
+        AudioSampleFormat sampleFormat;
+        int               frameCapacity;
+        int               maxWriteFrames;
+        size_t            frameBytes;
+
+        /* frameCapacity frames of ring, then maxWriteFrames of slack so a
+           write can run straight past the end before being wrapped */
+        std::vector<unsigned char> storage;
+
+        /* running frame totals; the difference is what's buffered.
+           Padded apart so producer and consumer don't share a line. */
+        char              writePad[CACHE_LINE_SIZE];
+        std::atomic<int64_t> writePosition {0};
+        char              readPad[CACHE_LINE_SIZE - sizeof(std::atomic<int64_t>)];
+        std::atomic<int64_t> readPosition {0};
+        char              endPad[CACHE_LINE_SIZE - sizeof(std::atomic<int64_t>)];
+
+        /* consumer-only state */
+        AudioFeeder::Delegate *delegate = nullptr;
+        bool              starved = false;
+        std::atomic<long> underruns {0};
+
+        unsigned char *frameAt(int64_t aPosition)
+        {
+            return &storage[(size_t)(aPosition % frameCapacity) * frameBytes];
+        }
+    };
+
+#pragma mark - AudioRing methods
+
+    AudioRing::AudioRing(const AudioLayout &aLayout, AudioSampleFormat aFormat, int aCapacity, int aMaxWrite) :
+        pimpl(new impl(aLayout, aFormat, aCapacity, aMaxWrite))
+    {}
+
+    AudioRing::~AudioRing()
+    {}
+
+#pragma mark - public method pimpl bouncers
+
+    const AudioLayout &AudioRing::layout() const
+    {
+        return pimpl->layout();
+    }
+
+    AudioSampleFormat AudioRing::format() const
+    {
+        return pimpl->format();
+    }
+
+    int AudioRing::capacity() const
+    {
+        return pimpl->capacity();
+    }
+
+    int AudioRing::maxWrite() const
+    {
+        return pimpl->maxWrite();
+    }
+
+    void *AudioRing::beginWrite(int aFrames)
+    {
+        return pimpl->beginWrite(aFrames);
+    }
+
+    void AudioRing::commitWrite(int aFrames)
+    {
+        pimpl->commitWrite(aFrames);
+    }
+
+    int AudioRing::write(const void *aFrames, int aCount)
+    {
+        return pimpl->write(aFrames, aCount);
+    }
+
+    int AudioRing::writableFrames() const
+    {
+        return pimpl->writableFrames();
+    }
+
+    int AudioRing::read(void *aOutput, int aFrames)
+    {
+        return pimpl->read(aOutput, aFrames);
+    }
+
+    void AudioRing::discard()
+    {
+        pimpl->discard();
+    }
+
+    int AudioRing::readableFrames() const
+    {
+        return pimpl->readableFrames();
+    }
+
+    double AudioRing::getBufferedTime() const
+    {
+        return pimpl->getBufferedTime();
+    }
+
+    long AudioRing::getUnderruns() const
+    {
+        return pimpl->getUnderruns();
+    }
+
+    void AudioRing::setDelegate(AudioFeeder::Delegate *aDelegate)
+    {
+        pimpl->setDelegate(aDelegate);
+    }
+
+#pragma mark - Internal implementation
+
+    AudioRing::impl::impl(const AudioLayout &aLayout, AudioSampleFormat aFormat, int aCapacity, int aMaxWrite) :
+        audioLayout(aLayout),
+        sampleFormat(aFormat),
+        frameCapacity(aCapacity),
+        maxWriteFrames(aMaxWrite < aCapacity ? aMaxWrite : aCapacity),
+        frameBytes(audioSampleSize(aFormat) * aLayout.channelCount),
+        storage((size_t)(frameCapacity + maxWriteFrames) * frameBytes)
+    {
+        assert(aFormat != AUDIO_SAMPLE_FLOAT_PLANAR);
+    }
+
+    int AudioRing::impl::writableFrames() const
+    {
+        // Only the consumer moves readPosition, and only forward, so this is a floor.
+        int64_t used = writePosition.load(std::memory_order_relaxed) - readPosition.load(std::memory_order_acquire);
+        return frameCapacity - (int)used;
+    }
+
+    void *AudioRing::impl::beginWrite(int aFrames)
+    {
+        if (aFrames > maxWriteFrames || aFrames > writableFrames()) {
+            return nullptr;
+        }
+        return frameAt(writePosition.load(std::memory_order_relaxed));
+    }
+
+    void AudioRing::impl::commitWrite(int aFrames)
+    {
+        int64_t position = writePosition.load(std::memory_order_relaxed);
+        int start = (int)(position % frameCapacity);
+        int overflow = start + aFrames - frameCapacity;
+        if (overflow > 0) {
+            // Whatever ran into the slack belongs at the front; that space is free.
+            memcpy(&storage[0], &storage[(size_t)frameCapacity * frameBytes], overflow * frameBytes);
+        }
+        writePosition.store(position + aFrames, std::memory_order_release);
+    }
+
+    int AudioRing::impl::write(const void *aFrames, int aCount)
+    {
+        int frames = writableFrames();
+        if (aCount < frames) {
+            frames = aCount;
+        }
+        int64_t position = writePosition.load(std::memory_order_relaxed);
+        int start = (int)(position % frameCapacity);
+        int first = (start + frames > frameCapacity) ? frameCapacity - start : frames;
+        const unsigned char *input = (const unsigned char *)aFrames;
+        memcpy(frameAt(position), input, first * frameBytes);
+        memcpy(&storage[0], input + first * frameBytes, (frames - first) * frameBytes);
+        writePosition.store(position + frames, std::memory_order_release);
+        return frames;
+    }
+
+    int AudioRing::impl::readableFrames() const
+    {
+        return (int)(writePosition.load(std::memory_order_acquire) - readPosition.load(std::memory_order_relaxed));
+    }
+
+    int AudioRing::impl::read(void *aOutput, int aFrames)
+    {
+        int64_t position = readPosition.load(std::memory_order_relaxed);
+        int frames = readableFrames();
+        if (aFrames < frames) {
+            frames = aFrames;
+        }
+        int start = (int)(position % frameCapacity);
+        int first = (start + frames > frameCapacity) ? frameCapacity - start : frames;
+        unsigned char *output = (unsigned char *)aOutput;
+        memcpy(output, frameAt(position), first * frameBytes);
+        memcpy(output + first * frameBytes, &storage[0], (frames - first) * frameBytes);
+        readPosition.store(position + frames, std::memory_order_release);
+
+        if (frames < aFrames) {
+            // Every format here is signed, so zero bytes are silence.
+            memset(output + frames * frameBytes, 0, (aFrames - frames) * frameBytes);
+            underruns.fetch_add(1, std::memory_order_relaxed);
+            if (!starved && delegate) {
+                delegate->onStarved();
+            }
+            starved = true;
+        } else {
+            starved = false;
+        }
+        return frames;
+    }
+
+    void AudioRing::impl::discard()
+    {
+        readPosition.store(writePosition.load(std::memory_order_acquire), std::memory_order_release);
+    }
+
+    double AudioRing::impl::getBufferedTime() const
+    {
+        int64_t buffered = writePosition.load(std::memory_order_acquire) - readPosition.load(std::memory_order_acquire);
+        if (buffered < 0) {
+            // positions read a moment apart
+            buffered = 0;
+        }
+        return (double)buffered / audioLayout.sampleRate;
+    }
+
+    long AudioRing::impl::getUnderruns() const
+    {
+        return underruns.load(std::memory_order_relaxed);
+    }
+
+    void AudioRing::impl::setDelegate(AudioFeeder::Delegate *aDelegate)
+    {
+        delegate = aDelegate;
+    }
+
+}
@@ -0,0 +1,113 @@
+//
+// Platform-independent Ogg Vorbis/Theora/Opus decoder/player base
+//
+// Copyright (c) 2013-2015 Brion Vibber <brion@pobox.com>
+// MIT-style license
+// Please reuse and redistribute with the LICENSE notes intact.
+//
+
+// good ol' C library
+#include <stdlib.h>
+#include <new>
+
+// POSIX
+#include <sys/mman.h>
+
+#include "BufferPool.h"
+
+namespace OGVCore {
+
+    // Below this, huge pages would mostly be waste.
+    static const size_t HUGE_PAGE_SIZE = 2 * 1024 * 1024;
+
+    BufferPool::Block::Block(size_t aSize, bool aHugePages) :
+        bytes_(nullptr),
+        size_(aSize),
+        mapped_(false)
+    {
+#if defined(MADV_HUGEPAGE)
+        if (aHugePages && aSize >= HUGE_PAGE_SIZE) {
+            void *mapping = mmap(nullptr, aSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+            if (mapping != MAP_FAILED) {
+                // Transparent huge pages; harmless if the kernel says no.
+                madvise(mapping, aSize, MADV_HUGEPAGE);
+                bytes_ = (unsigned char *)mapping;
+                mapped_ = true;
+                return;
+            }
+        }
+#endif
+        void *memory = nullptr;
+        if (posix_memalign(&memory, ALIGNMENT, aSize) != 0) {
+            throw std::bad_alloc();
+        }
+        bytes_ = (unsigned char *)memory;
+    }
+
+    BufferPool::Block::~Block()
+    {
+        if (mapped_) {
+            munmap(bytes_, size_);
+        } else {
+            free(bytes_);
+        }
+    }
+
+    BufferPool::BufferPool(bool aHugePages) :
+        hugePages_(aHugePages),
+        allocations_(0),
+        handles_(std::make_shared<FreeList<HandleChunk>>())
+    {}
+
+    /* four classes per power of two, so at most 25% slack */
+    size_t BufferPool::sizeClass(size_t aSize)
+    {
+        size_t size = (aSize < 4096) ? 4096 : aSize;
+        size_t power = 4096;
+        while (power * 2 <= size) {
+            power *= 2;
+        }
+        size_t step = power / 4;
+        return (size + step - 1) / step * step;
+    }
+
+    /* helper: the size class's free list, created on first use */
+    const std::shared_ptr<FreeList<BufferPool::Block>> &BufferPool::freeList(size_t aSizeClass)
+    {
+        std::shared_ptr<FreeList<Block>> &blocks = classes_[aSizeClass];
+        if (!blocks) {
+            blocks = std::make_shared<FreeList<Block>>();
+        }
+        return blocks;
+    }
+
+    std::shared_ptr<BufferPool::Block> BufferPool::acquire(size_t aSize)
+    {
+        size_t size = sizeClass(aSize);
+        const std::shared_ptr<FreeList<Block>> &blocks = freeList(size);
+        Block *block = blocks->pop();
+        if (!block) {
+            block = new Block(size, hugePages_);
+            allocations_++;
+        }
+        return recycledHandle(block, blocks, handles_);
+    }
+
+    void BufferPool::reserve(size_t aSize, size_t aCount)
+    {
+        size_t size = sizeClass(aSize);
+        const std::shared_ptr<FreeList<Block>> &blocks = freeList(size);
+        while (blocks->size() < aCount) {
+            blocks->push(new Block(size, hugePages_));
+            allocations_++;
+        }
+    }
+
+    void BufferPool::trim()
+    {
+        for (auto &entry : classes_) {
+            entry.second->clear();
+        }
+    }
+
+}
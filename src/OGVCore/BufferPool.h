@@ -0,0 +1,89 @@
+//
+// Platform-independent Ogg Vorbis/Theora/Opus decoder/player base
+//
+// Copyright (c) 2013-2015 Brion Vibber <brion@pobox.com>
+// MIT-style license
+// Please reuse and redistribute with the LICENSE notes intact.
+//
+
+#pragma once
+
+#include <stddef.h>
+#include <map>
+#include <memory>
+
+#include "FreeList.h"
+
+namespace OGVCore {
+
+	/**
+	 * Size-classed pool of aligned memory blocks.
+	 *
+	 * Blocks are handed out as shared_ptrs whose deleter pushes the
+	 * block back onto its size class's free list, so recycling costs no
+	 * allocation and the release is ordered before the next acquire.
+	 * Only acquire from one thread at a time; references may be dropped
+	 * from any thread.
+	 */
+	class BufferPool {
+	public:
+		static const size_t ALIGNMENT = 64;
+
+		class Block {
+		public:
+			~Block();
+
+			unsigned char *bytes() const { return bytes_; }
+			size_t size() const { return size_; }
+
+		private:
+			friend class BufferPool;
+			Block(size_t aSize, bool aHugePages);
+
+			unsigned char *bytes_;
+			size_t size_;
+			bool mapped_;
+
+			Block(const Block &);
+			Block &operator=(const Block &);
+		};
+
+		/**
+		 * @param aHugePages back large blocks with huge pages where the
+		 *        OS supports it, to cut TLB misses on HD frames
+		 */
+		explicit BufferPool(bool aHugePages = false);
+
+		/**
+		 * @return a block of at least aSize bytes, aligned to ALIGNMENT
+		 */
+		std::shared_ptr<Block> acquire(size_t aSize);
+
+		/**
+		 * Preallocate so the first aCount acquires of aSize don't malloc.
+		 */
+		void reserve(size_t aSize, size_t aCount);
+
+		/**
+		 * Release free blocks. Blocks still in use go back to their free
+		 * lists as usual when dropped.
+		 */
+		void trim();
+
+		/**
+		 * @return total blocks allocated over the pool's life
+		 */
+		size_t allocationCount() const { return allocations_; }
+
+		static size_t sizeClass(size_t aSize);
+
+	private:
+		bool hugePages_;
+		size_t allocations_;
+		std::map<size_t, std::shared_ptr<FreeList<Block>>> classes_;
+		std::shared_ptr<FreeList<HandleChunk>> handles_;
+
+		const std::shared_ptr<FreeList<Block>> &freeList(size_t aSizeClass);
+	};
+
+}
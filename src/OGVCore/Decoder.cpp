@@ -7,8 +7,14 @@
 //
 
 // C++ awesome
+#include <algorithm>
 #include <vector>
+#include <deque>
 #include <functional>
+#include <unordered_map>
+#include <atomic>
+#include <mutex>
+#include <thread>
 #include <cmath>
 
 // good ol' C library
@@ -23,6 +29,7 @@
 #include <theora/theoradec.h>
 
 #ifdef OPUS
+#include <opus/opus.h>
 #include <opus/opus_multistream.h>
 #include "opus_header.h"
 #include "opus_helper.h"
@@ -34,6 +41,18 @@
 // And our own headers.
 
 #include <OGVCore.h>
+#include "AudioKernels.h"
+#include "AudioPool.h"
+#include "FramePool.h"
+#include "KeyframeIndex.h"
+#include "MappedFile.h"
+#include "OggPageParser.h"
+#include "PacketQueue.h"
+#include "Resampler.h"
+#include "SegmentDecoder.h"
+#include "SidecarIndex.h"
+#include "SPSCQueue.h"
+#include "Waker.h"
 
 namespace OGVCore {
 
@@ -56,26 +75,104 @@ namespace OGVCore {
         std::shared_ptr<AudioLayout> getAudioLayout() const;
         std::shared_ptr<FrameLayout> getFrameLayout() const;
 
-        void receiveInput(std::vector<unsigned char> aBuffer);
+        void receiveInput(const unsigned char *aBytes, size_t aLength);
+        unsigned char *acquireInputBuffer(size_t aLength);
+        void commitInputBuffer(size_t aLength);
+        bool openFile(const std::string &aPath);
+        void seekFile(int64_t aOffset);
+        void setVerifyChecksums(bool aVerify);
+        void setVideoEnabled(bool aEnabled);
+        void setAudioEnabled(bool aEnabled);
+        bool videoEnabled() const;
+        bool audioEnabled() const;
         bool process();
 
         bool decodeFrame(std::function<void(FrameBuffer &aBuffer)> aCallback);
+        bool skipFrame();
         void discardFrame();
+        void setOwnedFrames(bool aOwned, int aPreallocate, bool aHugePages);
+        std::shared_ptr<FrameBuffer> dequeueFrame();
 
         bool decodeAudio(std::function<void(AudioBuffer &aBuffer)> aCallback);
+        std::shared_ptr<AudioBuffer> decodeAudioSamples(int aSampleCount);
+        std::shared_ptr<AudioBuffer> decodeAudioDuration(double aSeconds);
         void discardAudio();
-
+        void setAudioOutputFormat(AudioSampleFormat aFormat, bool aDither);
+        bool setOpusDecodeRate(int aRate);
+        void setAudioDownmix(int aChannels);
+        void setAudioOutputRate(int aRate, ResampleQuality aQuality);
+        int decodeAudioInto(AudioRing &aRing);
+        void setAudioSeekTarget(double aTime);
+
+        void startDecodeAhead(int aDepth, bool aSplitAudioVideo);
+        void startDecodeAhead(int aDepth, DecoderScheduler &aScheduler);
+        void stopDecodeAhead();
+        std::shared_ptr<FrameBuffer> popFrame();
+        std::shared_ptr<AudioBuffer> popAudio();
+        DecodeAheadStats getDecodeAheadStats() const;
+
+        long decodeSegments(int aThreads, std::function<void(FrameBuffer &aBuffer)> aCallback);
+
+        void flush();
         void flushBuffers();
 
         long getSegmentLength() const;
         double getDuration() const;
         long getKeypointOffset(double aTime);
+        bool buildKeyframeIndex(bool aBackground);
+        bool keyframeIndexReady() const;
+        bool saveKeyframeIndex(const std::string &aPath);
+
+        DemuxStats getDemuxStats() const;
+        bool firstTimestampedPage(TimestampedPage &aPage) const;
 
     private:
         std::function<void()> onLoadedMetadata;
 
         void video_write(std::function<void(FrameBuffer &aBuffer)> aCallback);
         int queue_page(ogg_page *page);
+        int demux_page();
+        int sync_pageout(ogg_page *page);
+        void hold_page(ogg_page *page);
+        void note_timestamped_page(ogg_stream_state *stream, ogg_page *page);
+        void route_stream(ogg_stream_state *stream);
+        void set_stream_routed(ogg_stream_state *stream, bool routed);
+        void update_track_routes();
+        void with_decode_ahead_stopped(const std::function<void()> &aChange);
+        ogg_stream_state *audio_stream();
+
+        bool ready_video_packet();
+        bool take_video_packet();
+        void track_video_packet(ogg_packet *packet);
+        bool awaiting_video_keyframe(ogg_packet *packet);
+        void track_audio_packet(ogg_packet *packet);
+        int next_audio_packet(ogg_packet *packet, bool peek);
+        bool resolve_audio_seek(ogg_stream_state *stream);
+        bool audio_seek_needed(ogg_int64_t end);
+        int seek_trim(ogg_int64_t end, int count);
+        int audio_packet_blocksize(ogg_packet *packet);
+        int audio_packet_duration(ogg_packet *packet, int prevBlocksize);
+        int audio_granule_rate();
+        void reset_audio_decoder();
+        bool decode_video_packet(ogg_packet *packet, std::function<void(FrameBuffer &aBuffer)> aCallback);
+        bool decode_audio_packet(ogg_packet *packet, std::function<void(AudioBuffer &aBuffer)> aCallback);
+        bool decode_audio_samples(ogg_packet *packet);
+        int append_audio(int aSampleCount);
+        void *audio_frame(int aOffset);
+        void write_planar_audio(const float *const *aPlanes, int aFrames);
+        float *const *queued_planes(int aOffset);
+        void prepare_audio_output(int aChannels, int aRate, bool aKnownOrder);
+        int max_audio_packet_samples();
+
+        bool decodeAheadStep();
+        bool demuxStep();
+        bool videoStep();
+        bool audioStep();
+        void runLoop(bool (Decoder::impl::*aStep)(), Waker *aWaker);
+        void prepare_decode_ahead(int aDepth);
+        void wake_worker(Waker &aWaker);
+        void schedule_step();
+        void scheduled_step();
 
         void processBegin();
         void processHeaders();
@@ -83,12 +180,39 @@ namespace OGVCore {
 
 
         /* Ogg and codec state for demux/decode */
+        std::mutex        inputMutex;   // guards oggSyncState against the decode-ahead worker
         ogg_sync_state    oggSyncState {};
+        unsigned char    *inputReserved = nullptr; // acquireInputBuffer() space not yet committed
+        int64_t           inputCommitted = 0;  // bytes of input since the last flush
+
+        /* where the page just pulled out sat, and the first since a flush to date the seek track */
+        int64_t           pageOffset = -1;
+        int64_t           pageEnd = -1;
+        bool              haveTimestampedPage = false;
+        TimestampedPage   timestampedPage;
         ogg_page          oggPage {};
+        std::vector<unsigned char> heldPage; // oggPage's bytes, once the sync buffer may move
         ogg_packet        oggPacket {};
         ogg_packet        audioPacket {};
         ogg_packet        videoPacket {};
 
+        /* Optional native demux front end over a mapped local file */
+        std::unique_ptr<MappedFile>    mappedFile;
+        std::unique_ptr<OggPageParser> pageParser;
+        bool                           verifyChecksums = true;
+
+        /* Keyframe index from a page header scan, for files Skeleton doesn't index */
+        mutable std::mutex             indexMutex;
+        std::shared_ptr<KeyframeIndex> keyframeIndex;   // published once the scan is complete
+        std::thread                    indexThread;
+        std::atomic<bool>              indexCancel {false};
+        void stop_index_build();
+        int64_t index_serial() const;
+
+        /* ...or one saved beside the file last time */
+        std::string                    filePath;
+        SidecarIndex                   sidecarIndex;
+
         /* Video decode state */
         ogg_stream_state  theoraStreamState {};
         th_info           theoraInfo {};
@@ -110,6 +234,19 @@ namespace OGVCore {
         int               audiobufReady = 0;
         ogg_int64_t       audiobufGranulepos = -1; /* time position of last sample */
         double            audiobufTime = -1;
+        int               audioPrevBlocksize = 0;  /* Vorbis: last decoded packet's, 0 after a restart */
+
+        /* Seek trimming: the demux side holds packets until a page end dates
+           them and drops those ending too early; the decode side cuts the
+           first output to the exact target sample */
+        ogg_int64_t       audioSeekGranule = -1;   // target, while packets are still being held or dropped
+        ogg_int64_t       audioSeekPosition = -1;  // end of the last held packet, once dated
+        int               audioSeekBlocksize = 0;
+        std::deque<std::unique_ptr<OwnedPacket>> audioSeekPackets;
+        std::deque<int>   audioSeekDurations;
+        std::unique_ptr<OwnedPacket> audioSeekCurrent;  // last handed out; its bytes live until decoded
+        ogg_int64_t       audioTrimGranule = -1;   // target, until output reaches it
+        std::vector<const float *> trimmedPlanes;
 
         /* Audio decode state */
         int               vorbisHeaders = 0;
@@ -130,8 +267,16 @@ namespace OGVCore {
         ogg_int64_t       opusPrevPacketGranpos = 0L;
         float             opusGain = 0.0f;
         int               opusStreams = 0;
+        int               opusDecodeRate = 48000;
+        std::vector<float> opusOutput;        // interleaved scratch, sized once at header time
+        std::vector<float> opusPlanar;        // full-channel planes on their way to a downmix or resample
+        std::vector<float *> opusPlanes;
         /* 120ms at 48000 */
 #define OPUS_MAX_FRAME_SIZE (960*6)
+/* decode at least 80ms ahead of a seek target so the decoder converges */
+#define OPUS_SEEK_PREROLL (48*80)
+/* granulepos and preskip always count 48kHz samples, whatever rate we decode at */
+#define OPUS_GRANULE_RATE 48000
 #endif
 
         OggSkeleton      *skeleton = nullptr;
@@ -140,8 +285,13 @@ namespace OGVCore {
         int               skeletonProcessingHeaders = 0;
         int               skeletonDone = 0;
 
+        /* serial number -> the one stream state that accepts its pages */
+        std::unordered_map<ogg_uint32_t, ogg_stream_state *> streamRoutes;
+        DemuxStats        demuxStats;
+
         int               processAudio = 1;
         int               processVideo = 1;
+        bool              videoNeedsKeyframe = false; // re-enabled mid-stream; drop packets until one
 
         enum AppState {
             OGVCORE_STATE_BEGIN,
@@ -155,10 +305,54 @@ namespace OGVCore {
         bool isFrameReady = false;
         std::shared_ptr<FrameLayout> frameLayout = nullptr;
         std::shared_ptr<FrameBuffer> queuedFrame = nullptr;
+        std::unique_ptr<FramePool> framePool;
 
         bool isAudioReady = false;
         std::shared_ptr<AudioLayout> audioLayout = nullptr;
         std::shared_ptr<AudioBuffer> queuedAudio = nullptr;
+        AudioPool         audioPool;
+        AudioSampleFormat audioFormat = AUDIO_SAMPLE_FLOAT_PLANAR;
+        bool              ditherAudio = false;
+        AudioDither       audioDither;
+        int               audioDownmix = 0;      // requested channel count, 0 to keep them all
+        std::vector<float> downmixMatrix;        // empty unless this stream is being mixed down
+        std::vector<float> mixOutput;            // mixed planes waiting to be resampled or interleaved
+        std::vector<float *> mixPlanes;
+        int               audioOutputRate = 0;   // requested rate, 0 to keep the stream's
+        ResampleQuality   resampleQuality = RESAMPLE_MEDIUM;
+        std::unique_ptr<Resampler> resampler;    // only while the stream's rate differs
+        std::vector<float> resampleOutput;       // resampled planes waiting to be interleaved
+        std::vector<float *> resamplePlanes;
+        std::vector<float *> outputPlanes;       // queuedAudio's channels at the write offset
+        std::shared_ptr<AudioBuffer> ringView;   // stands in for queuedAudio over an AudioRing's free space
+
+        /* Optional decode-ahead worker(s) */
+        std::thread       decodeAheadThread;
+        std::atomic<bool> decodeAheadRunning {false};
+        int               decodeAheadDepth = 0;
+        std::unique_ptr<SPSCQueue<std::shared_ptr<FrameBuffer>>> frameQueue;
+        std::unique_ptr<SPSCQueue<std::shared_ptr<AudioBuffer>>> audioQueue;
+        Waker             decodeAheadWake;   // the single worker, or the demux stage
+
+        /* Split mode: demux feeds per-track packet queues, each drained by its own decode thread */
+        bool              decodeAheadSplit = false;
+        std::thread       videoThread;
+        std::thread       audioThread;
+        std::unique_ptr<PacketQueue> videoPackets;
+        std::unique_ptr<PacketQueue> audioPackets;
+        Waker             videoWake;
+        Waker             audioWake;
+
+        /* Scheduler mode: decodeAheadStep runs as a chain of tasks, one in flight at a time */
+        std::atomic<DecoderScheduler *> scheduler {nullptr}; // read by input threads waking the chain
+        std::atomic<bool> stepScheduled {false};
+        std::atomic<bool> wakeRequested {false};
+        std::mutex        stepMutex;         // held for the whole of each step
+        Waker             stepIdleWake;      // the chain has stopped
+
+        std::atomic<long> framesDecoded {0};
+        std::atomic<long> consumerStalls {0};
+        std::atomic<long> producerStalls {0};
     };
 
 #pragma mark - Decoder methods
@@ -222,9 +416,59 @@ namespace OGVCore {
         return pimpl->getFrameLayout();
     }
 
-    void Decoder::receiveInput(std::vector<unsigned char> aBuffer)
+    void Decoder::receiveInput(const std::vector<unsigned char> &aBuffer)
+    {
+        pimpl->receiveInput(aBuffer.data(), aBuffer.size());
+    }
+
+    void Decoder::receiveInput(const unsigned char *aBytes, size_t aLength)
+    {
+        pimpl->receiveInput(aBytes, aLength);
+    }
+
+    unsigned char *Decoder::acquireInputBuffer(size_t aLength)
+    {
+        return pimpl->acquireInputBuffer(aLength);
+    }
+
+    void Decoder::commitInputBuffer(size_t aLength)
+    {
+        pimpl->commitInputBuffer(aLength);
+    }
+
+    bool Decoder::openFile(const std::string &aPath)
+    {
+        return pimpl->openFile(aPath);
+    }
+
+    void Decoder::seekFile(int64_t aOffset)
+    {
+        pimpl->seekFile(aOffset);
+    }
+
+    void Decoder::setVerifyChecksums(bool aVerify)
+    {
+        pimpl->setVerifyChecksums(aVerify);
+    }
+
+    void Decoder::setVideoEnabled(bool aEnabled)
+    {
+        pimpl->setVideoEnabled(aEnabled);
+    }
+
+    void Decoder::setAudioEnabled(bool aEnabled)
+    {
+        pimpl->setAudioEnabled(aEnabled);
+    }
+
+    bool Decoder::videoEnabled() const
+    {
+        return pimpl->videoEnabled();
+    }
+
+    bool Decoder::audioEnabled() const
     {
-        pimpl->receiveInput(aBuffer);
+        return pimpl->audioEnabled();
     }
 
     bool Decoder::process()
@@ -237,26 +481,114 @@ namespace OGVCore {
         return pimpl->decodeFrame(aCallback);
     }
 
+    bool Decoder::skipFrame()
+    {
+        return pimpl->skipFrame();
+    }
+
     void Decoder::discardFrame()
     {
         return pimpl->discardFrame();
     }
 
+    void Decoder::setOwnedFrames(bool aOwned, int aPreallocate, bool aHugePages)
+    {
+        pimpl->setOwnedFrames(aOwned, aPreallocate, aHugePages);
+    }
+
+    std::shared_ptr<FrameBuffer> Decoder::dequeueFrame()
+    {
+        return pimpl->dequeueFrame();
+    }
+
     bool Decoder::decodeAudio(std::function<void(AudioBuffer &aBuffer)> aCallback)
     {
         return pimpl->decodeAudio(aCallback);
     }
 
+    std::shared_ptr<AudioBuffer> Decoder::decodeAudioSamples(int aSampleCount)
+    {
+        return pimpl->decodeAudioSamples(aSampleCount);
+    }
+
+    std::shared_ptr<AudioBuffer> Decoder::decodeAudioDuration(double aSeconds)
+    {
+        return pimpl->decodeAudioDuration(aSeconds);
+    }
+
     void Decoder::discardAudio()
     {
         pimpl->discardAudio();
     }
 
+    void Decoder::setAudioOutputFormat(AudioSampleFormat aFormat, bool aDither)
+    {
+        pimpl->setAudioOutputFormat(aFormat, aDither);
+    }
+
+    bool Decoder::setOpusDecodeRate(int aRate)
+    {
+        return pimpl->setOpusDecodeRate(aRate);
+    }
+
+    void Decoder::setAudioDownmix(int aChannels)
+    {
+        pimpl->setAudioDownmix(aChannels);
+    }
+
+    void Decoder::setAudioOutputRate(int aRate, ResampleQuality aQuality)
+    {
+        pimpl->setAudioOutputRate(aRate, aQuality);
+    }
+
+    int Decoder::decodeAudioInto(AudioRing &aRing)
+    {
+        return pimpl->decodeAudioInto(aRing);
+    }
+
+    void Decoder::setAudioSeekTarget(double aTime)
+    {
+        pimpl->setAudioSeekTarget(aTime);
+    }
+
+    void Decoder::startDecodeAhead(int aDepth, bool aSplitAudioVideo)
+    {
+        pimpl->startDecodeAhead(aDepth, aSplitAudioVideo);
+    }
+
+    void Decoder::startDecodeAhead(int aDepth, DecoderScheduler &aScheduler)
+    {
+        pimpl->startDecodeAhead(aDepth, aScheduler);
+    }
+
+    void Decoder::stopDecodeAhead()
+    {
+        pimpl->stopDecodeAhead();
+    }
+
+    std::shared_ptr<FrameBuffer> Decoder::popFrame()
+    {
+        return pimpl->popFrame();
+    }
+
+    std::shared_ptr<AudioBuffer> Decoder::popAudio()
+    {
+        return pimpl->popAudio();
+    }
+
+    DecodeAheadStats Decoder::getDecodeAheadStats() const
+    {
+        return pimpl->getDecodeAheadStats();
+    }
+
+    long Decoder::decodeSegments(int aThreads, std::function<void(FrameBuffer &aBuffer)> aCallback)
+    {
+        return pimpl->decodeSegments(aThreads, aCallback);
+    }
+
     void Decoder::flush()
     {
-        pimpl->flushBuffers();
-        pimpl->discardFrame();
-        pimpl->discardAudio();
+        pimpl->flush();
     }
 
     long Decoder::getSegmentLength() const
@@ -274,6 +606,31 @@ namespace OGVCore {
         return pimpl->getKeypointOffset(aTime);
     }
 
+    bool Decoder::buildKeyframeIndex(bool aBackground)
+    {
+        return pimpl->buildKeyframeIndex(aBackground);
+    }
+
+    bool Decoder::keyframeIndexReady() const
+    {
+        return pimpl->keyframeIndexReady();
+    }
+
+    bool Decoder::saveKeyframeIndex(const std::string &aPath)
+    {
+        return pimpl->saveKeyframeIndex(aPath);
+    }
+
+    DemuxStats Decoder::getDemuxStats() const
+    {
+        return pimpl->getDemuxStats();
+    }
+
+    bool Decoder::firstTimestampedPage(TimestampedPage &aPage) const
+    {
+        return pimpl->firstTimestampedPage(aPage);
+    }
+
 #pragma mark - implementation methods
 
     Decoder::impl::impl() :
@@ -297,6 +654,9 @@ namespace OGVCore {
 
     Decoder::impl::~impl()
     {
+        stopDecodeAhead();
+        stop_index_build();
+
         if (theoraHeaders) {
             ogg_stream_clear(&theoraStreamState);
             th_decode_free(theoraDecoderContext);
@@ -333,12 +693,12 @@ namespace OGVCore {
 
     bool Decoder::impl::hasAudio() const
     {
-        return (audioLayout.get() != NULL);
+        return (audioLayout.get() != NULL) && processAudio;
     }
 
     bool Decoder::impl::hasVideo() const
     {
-        return (frameLayout.get() != NULL);
+        return (frameLayout.get() != NULL) && processVideo;
     }
 
     bool Decoder::impl::audioReady() const
@@ -380,50 +740,290 @@ namespace OGVCore {
         th_ycbcr_buffer ycbcr;
         th_decode_ycbcr_out(theoraDecoderContext, ycbcr);
 
-        int hdec = !(theoraInfo.pixel_fmt & 1);
-        int vdec = !(theoraInfo.pixel_fmt & 2);
+        PlaneBuffer Y(ycbcr[0].data, ycbcr[0].stride, frameLayout->frame.height);
+        PlaneBuffer Cb(ycbcr[1].data, ycbcr[1].stride, frameLayout->frame.height >> frameLayout->subsampling.y);
+        PlaneBuffer Cr(ycbcr[2].data, ycbcr[2].stride, frameLayout->frame.height >> frameLayout->subsampling.y);
 
         assert(queuedFrame.get() == NULL);
-        queuedFrame.reset(new FrameBuffer(*frameLayout,
-                                          videobufTime, keyframeTime,
-                                          PlaneBuffer(ycbcr[0].data, ycbcr[0].stride, frameLayout->frame.height),
-                                          PlaneBuffer(ycbcr[1].data, ycbcr[1].stride, frameLayout->frame.height >> frameLayout->subsampling.y),
-                                          PlaneBuffer(ycbcr[2].data, ycbcr[2].stride, frameLayout->frame.height >> frameLayout->subsampling.y)));
+        if (framePool) {
+            // One copy out of libtheora's buffers; the frame owns it from here.
+            queuedFrame = framePool->copyFrame(*frameLayout, videobufTime, keyframeTime, Y, Cb, Cr);
+        } else {
+            queuedFrame.reset(new FrameBuffer(*frameLayout,
+                                              videobufTime, keyframeTime,
+                                              Y, Cb, Cr));
+        }
         aCallback(*queuedFrame);
         queuedFrame.reset();
     }
 
-    /* helper: push a page into the appropriate steam */
-    /* this can be done blindly; a stream won't accept a page
-                    that doesn't belong to it */
+    /* helper: push a page into the stream that owns its serial number */
+    /* pages for streams we aren't decoding are dropped unparsed */
     int Decoder::impl::queue_page(ogg_page *page) {
-        if (theoraHeaders) ogg_stream_pagein(&theoraStreamState, page);
-        if (vorbisHeaders) ogg_stream_pagein(&vorbisStreamState, page);
+        auto route = streamRoutes.find((ogg_uint32_t)ogg_page_serialno(page));
+        if (route == streamRoutes.end()) {
+            // BOS pages are still being sniffed by processBegin().
+            if (appState != OGVCORE_STATE_BEGIN || !ogg_page_bos(page)) {
+                demuxStats.pagesDiscarded++;
+            }
+            return -1;
+        }
+        ogg_stream_pagein(route->second, page);
+        demuxStats.pagesRouted++;
+        if (!haveTimestampedPage && appState == OGVCORE_STATE_DECODING) {
+            note_timestamped_page(route->second, page);
+        }
+        return 0;
+    }
+
+    /* helper: remember the first page since a flush that dates the track bisection seeks by */
+    void Decoder::impl::note_timestamped_page(ogg_stream_state *stream, ogg_page *page) {
+        ogg_int64_t granulepos = ogg_page_granulepos(page);
+        bool video = theoraHeaders && processVideo;
+        if (granulepos < 0 || stream != (video ? &theoraStreamState : audio_stream())) {
+            return;
+        }
+        timestampedPage.offset = pageOffset;
+        timestampedPage.end = pageEnd;
+        if (video) {
+            int shift = theoraInfo.keyframe_granule_shift;
+            timestampedPage.time = th_granule_time(theoraDecoderContext, granulepos);
+            timestampedPage.keyframeTime = th_granule_time(theoraDecoderContext, (granulepos >> shift) << shift);
+        } else {
 #ifdef OPUS
-        if (opusHeaders) ogg_stream_pagein(&opusStreamState, page);
+            if (opusHeaders) {
+                timestampedPage.time = (double)granulepos / OPUS_GRANULE_RATE;
+            } else
 #endif
-        if (skeletonHeaders) ogg_stream_pagein(&skeletonStreamState, page);
-        return 0;
+            {
+                timestampedPage.time = vorbis_granule_time(&vorbisDspState, granulepos);
+            }
+            timestampedPage.keyframeTime = timestampedPage.time;
+        }
+        haveTimestampedPage = true;
+    }
+
+    /* helper: claim a newly identified stream's serial number */
+    void Decoder::impl::route_stream(ogg_stream_state *stream) {
+        streamRoutes[(ogg_uint32_t)stream->serialno] = stream;
+    }
+
+    /* helper: start or stop taking pages for a stream we've identified */
+    /* a stream that stops loses whatever it had buffered, so nothing piles up */
+    void Decoder::impl::set_stream_routed(ogg_stream_state *stream, bool routed) {
+        if (routed) {
+            route_stream(stream);
+        } else if (streamRoutes.erase((ogg_uint32_t)stream->serialno)) {
+            ogg_stream_reset(stream);
+        }
+    }
+
+    /* helper: bring the routes in line with which tracks are enabled */
+    /* tracks still reading headers keep their pages until decoding starts */
+    void Decoder::impl::update_track_routes() {
+        if (appState != OGVCORE_STATE_DECODING) {
+            return;
+        }
+        if (theoraHeaders) {
+            set_stream_routed(&theoraStreamState, processVideo);
+        }
+        ogg_stream_state *audioStream = audio_stream();
+        if (audioStream) {
+            set_stream_routed(audioStream, processAudio);
+        }
+        if (vorbisHeaders && audioStream != &vorbisStreamState) {
+            // Opus won; nobody will ever read the Vorbis packets.
+            set_stream_routed(&vorbisStreamState, false);
+        }
+    }
+
+    /* helper: pull the next page into oggPage from the mapped file or the sync layer, and queue it */
+    /* same return values as ogg_sync_pageout */
+    int Decoder::impl::demux_page() {
+        if (pageParser) {
+            // The mapping never changes, so no input lock is needed.
+            OggPageView view;
+            int ret = pageParser->nextPage(view);
+            if (ret > 0) {
+                // libogg only reads through these, so point it into the mapping;
+                // ogg_stream_pagein() then makes the one copy, into the stream.
+                oggPage.header = const_cast<unsigned char *>(view.header);
+                oggPage.header_len = (long)view.headerLength;
+                oggPage.body = const_cast<unsigned char *>(view.body);
+                oggPage.body_len = (long)view.bodyLength;
+                pageOffset = (int64_t)view.offset;
+                pageEnd = pageOffset + (int64_t)(view.headerLength + view.bodyLength);
+                queue_page(&oggPage);
+            }
+            return ret;
+        }
+        // The page points into the sync buffer, which ogg_sync_buffer() on
+        // the input thread may move; keep it locked until libogg has copied
+        // the page into its stream.
+        std::lock_guard<std::mutex> lock(inputMutex);
+        int ret = sync_pageout(&oggPage);
+        if (ret > 0) {
+            queue_page(&oggPage);
+            if (appState == OGVCORE_STATE_BEGIN) {
+                // processBegin() still sniffs it after we let go.
+                hold_page(&oggPage);
+            }
+        }
+        return ret;
+    }
+
+    /* helper: copy a page out of the sync buffer so it outlives the input lock */
+    void Decoder::impl::hold_page(ogg_page *page) {
+        heldPage.assign(page->header, page->header + page->header_len);
+        heldPage.insert(heldPage.end(), page->body, page->body + page->body_len);
+        page->header = heldPage.data();
+        page->body = heldPage.data() + page->header_len;
+    }
+
+    /* helper: ogg_sync_pageout, noting where the page sat in the input; hold inputMutex */
+    int Decoder::impl::sync_pageout(ogg_page *page) {
+        int ret = ogg_sync_pageout(&oggSyncState, page);
+        if (ret > 0) {
+            // Everything that came in, less what's still buffered, has been read.
+            pageEnd = inputCommitted - (oggSyncState.fill - oggSyncState.returned);
+            pageOffset = pageEnd - page->header_len - page->body_len;
+        }
+        return ret;
+    }
+
+    void Decoder::impl::receiveInput(const unsigned char *aBytes, size_t aLength)
+    {
+        if (aLength > 0) {
+            // This is the one copy; callers that can read straight into
+            // the sync buffer should use acquireInputBuffer() instead.
+            unsigned char *dest = acquireInputBuffer(aLength);
+            memcpy(dest, aBytes, aLength);
+            commitInputBuffer(aLength);
+        }
     }
 
-    void Decoder::impl::receiveInput(std::vector<unsigned char> aBuffer)
+    unsigned char *Decoder::impl::acquireInputBuffer(size_t aLength)
     {
-        int bufsize = aBuffer.size();
-        if (bufsize > 0) {
-            const unsigned char *buffer = aBuffer.data();
-            buffersReceived = 1;
-            if (appState == OGVCORE_STATE_DECODING) {
-                // queue ALL the pages!
-                while (ogg_sync_pageout(&oggSyncState, &oggPage) > 0) {
-                    queue_page(&oggPage);
+        // Only reserve under the lock; the caller's read into the space
+        // past the sync buffer's fill point runs unlocked, since neither
+        // ogg_sync_pageout() nor the worker touch it until it's committed.
+        std::lock_guard<std::mutex> lock(inputMutex);
+        if (!decodeAheadRunning && appState == OGVCORE_STATE_DECODING) {
+            // queue ALL the pages!
+            while (sync_pageout(&oggPage) > 0) {
+                queue_page(&oggPage);
+            }
+        }
+        inputReserved = (unsigned char *)ogg_sync_buffer(&oggSyncState, aLength);
+        return inputReserved;
+    }
+
+    void Decoder::impl::commitInputBuffer(size_t aLength)
+    {
+        {
+            std::lock_guard<std::mutex> lock(inputMutex);
+            // A seek in between reset the sync state; those bytes are stale.
+            if (aLength > 0 && inputReserved) {
+                buffersReceived = 1;
+                inputCommitted += aLength;
+                if (ogg_sync_wrote(&oggSyncState, aLength) < 0) {
+                    printf("Horrible error in ogg_sync_wrote\n");
                 }
             }
-            char *dest = ogg_sync_buffer(&oggSyncState, bufsize);
-            memcpy(dest, buffer, bufsize);
-            if (ogg_sync_wrote(&oggSyncState, bufsize) < 0) {
-                printf("Horrible error in ogg_sync_wrote\n");
+            inputReserved = nullptr;
+        }
+
+        if (aLength > 0 && decodeAheadRunning) {
+            wake_worker(decodeAheadWake);
+        }
+    }
+
+    bool Decoder::impl::openFile(const std::string &aPath)
+    {
+        std::unique_ptr<MappedFile> file(new MappedFile());
+        if (!file->open(aPath)) {
+            printf("Could not map input file %s\n", aPath.c_str());
+            return false;
+        }
+        {
+            // An index of the last file is no use, and a scan may still be reading it.
+            stop_index_build();
+            std::lock_guard<std::mutex> lock(indexMutex);
+            keyframeIndex.reset();
+        }
+        pageParser.reset(new OggPageParser(file->data(), file->length()));
+        pageParser->setVerifyChecksums(verifyChecksums);
+        mappedFile = std::move(file);
+        filePath = aPath;
+        sidecarIndex.open(aPath + ".ogvidx", *mappedFile);
+        buffersReceived = 1;
+        return true;
+    }
+
+    void Decoder::impl::setVerifyChecksums(bool aVerify)
+    {
+        verifyChecksums = aVerify;
+        if (pageParser) {
+            pageParser->setVerifyChecksums(aVerify);
+        }
+    }
+
+    void Decoder::impl::seekFile(int64_t aOffset)
+    {
+        if (pageParser) {
+            pageParser->seek(aOffset < 0 ? 0 : (uint64_t)aOffset);
+        }
+    }
+
+    void Decoder::impl::setVideoEnabled(bool aEnabled)
+    {
+        if (processVideo == (int)aEnabled) {
+            return;
+        }
+        with_decode_ahead_stopped([this, aEnabled]() {
+            processVideo = aEnabled;
+            update_track_routes();
+            // Pages were dropped while it was off, so the decoder's
+            // reference frames are stale until the next keyframe.
+            videoNeedsKeyframe = aEnabled && appState == OGVCORE_STATE_DECODING;
+            if (!aEnabled) {
+                // The peeked packet went with the stream's buffered data.
+                videobufReady = 0;
+                isFrameReady = false;
+                videobufGranulepos = -1;
+                videobufTime = -1;
+                keyframeGranulepos = -1;
+                keyframeTime = -1;
             }
+        });
+    }
+
+    void Decoder::impl::setAudioEnabled(bool aEnabled)
+    {
+        if (processAudio == (int)aEnabled) {
+            return;
         }
+        with_decode_ahead_stopped([this, aEnabled]() {
+            processAudio = aEnabled;
+            update_track_routes();
+            if (!aEnabled) {
+                audiobufReady = 0;
+                isAudioReady = false;
+                audiobufGranulepos = -1;
+                audiobufTime = -1;
+            }
+            reset_audio_decoder();
+        });
+    }
+
+    bool Decoder::impl::videoEnabled() const
+    {
+        return processVideo;
+    }
+
+    bool Decoder::impl::audioEnabled() const
+    {
+        return processAudio;
     }
 
     bool Decoder::impl::process()
@@ -432,10 +1032,9 @@ namespace OGVCore {
             return 0;
         }
         if (needData) {
-            int ret = ogg_sync_pageout(&oggSyncState, &oggPage);
+            int ret = demux_page();
             if (ret > 0) {
-                // complete page retrieved
-                queue_page(&oggPage);
+                // complete page retrieved and queued
             } else if (ret < 0) {
                 // incomplete sync
                 // continue on the next loop
@@ -480,6 +1079,7 @@ namespace OGVCore {
                 /* it is theora -- save this stream state */
                 printf("found theora stream!\n");
                 memcpy(&theoraStreamState, &test, sizeof (test));
+                route_stream(&theoraStreamState);
                 theoraHeaders = 1;
 
                 if (theoraProcessingHeaders == 0) {
@@ -491,6 +1091,7 @@ namespace OGVCore {
                 // it's vorbis! save this as our audio stream...
                 printf("found vorbis stream! %d\n", vorbisProcessingHeaders);
                 memcpy(&vorbisStreamState, &test, sizeof (test));
+                route_stream(&vorbisStreamState);
                 vorbisHeaders = 1;
 
                 // ditch the processed packet...
@@ -499,6 +1100,24 @@ namespace OGVCore {
             } else if (processAudio && !opusHeaders && (opusDecoder = opus_process_header(&oggPacket, &opusMappingFamily, &opusChannels, &opusPreskip, &opusGain, &opusStreams)) != NULL) {
                 printf("found Opus stream! (first of two headers)\n");
                 memcpy(&opusStreamState, &test, sizeof (test));
+                route_stream(&opusStreamState);
+                if (opusDecodeRate != OPUS_GRANULE_RATE) {
+                    // opus_process_header always decodes at full rate; start over at ours.
+                    OpusHeader header;
+                    int err = OPUS_OK;
+                    OpusMSDecoder *rateDecoder = NULL;
+                    if (opus_header_parse(oggPacket.packet, oggPacket.bytes, &header)) {
+                        rateDecoder = opus_multistream_decoder_create(opusDecodeRate, header.channels, header.nb_streams,
+                                                                      header.nb_coupled, header.stream_map, &err);
+                    }
+                    if (rateDecoder && err == OPUS_OK) {
+                        opus_multistream_decoder_destroy(opusDecoder);
+                        opusDecoder = rateDecoder;
+                    } else {
+                        printf("Couldn't decode Opus at %d Hz; staying at 48000.\n", opusDecodeRate);
+                        opusDecodeRate = OPUS_GRANULE_RATE;
+                    }
+                }
                 if (opusGain) {
                     opus_multistream_decoder_ctl(opusDecoder, OPUS_SET_GAIN(opusGain));
                 }
@@ -510,6 +1129,7 @@ namespace OGVCore {
 #endif
             } else if (!skeletonHeaders && (skeletonProcessingHeaders = oggskel_decode_header(skeleton, &oggPacket)) >= 0) {
                 memcpy(&skeletonStreamState, &test, sizeof (test));
+                route_stream(&skeletonStreamState);
                 skeletonHeaders = 1;
                 skeletonDone = 0;
 
@@ -654,9 +1274,14 @@ namespace OGVCore {
 #ifdef OPUS
             // If we have both Vorbis and Opus, prefer Opus
             if (opusHeaders) {
-                // opusDecoder should already be initialized
-                // Opus has a fixed internal sampling rate of 48000 Hz
-                audioLayout.reset(new AudioLayout(opusChannels, 48000));
+                // opusDecoder should already be initialized, at opusDecodeRate
+                // Only families 0 and 1 have a defined speaker order to mix from.
+                prepare_audio_output(opusChannels, opusDecodeRate, opusMappingFamily <= 1);
+                opusOutput.resize(OPUS_MAX_FRAME_SIZE * opusChannels);
+                opusPlanes.resize(opusChannels);
+                if (!downmixMatrix.empty() || resampler) {
+                    opusPlanar.resize(OPUS_MAX_FRAME_SIZE * opusChannels);
+                }
             } else
 #endif
             if (vorbisHeaders) {
@@ -665,10 +1290,11 @@ namespace OGVCore {
                 printf("Ogg logical stream %lx is Vorbis %d channel %ld Hz audio.\n",
                         vorbisStreamState.serialno, vorbisInfo.channels, vorbisInfo.rate);
 
-                audioLayout.reset(new AudioLayout(vorbisInfo.channels, vorbisInfo.rate));
+                prepare_audio_output(vorbisInfo.channels, vorbisInfo.rate, true);
             }
 
             appState = OGVCORE_STATE_DECODING;
+            update_track_routes();
             printf("Done with headers step\n");
             onLoadedMetadata();
         }
@@ -677,214 +1303,735 @@ namespace OGVCore {
     void Decoder::impl::processDecoding()
     {
         needData = 0;
-        if (theoraHeaders && !videobufReady) {
+        if (theoraHeaders && processVideo && !videobufReady) {
             /* theora is one in, one out... */
-            if (ogg_stream_packetpeek(&theoraStreamState, &videoPacket) > 0) {
-                videobufReady = 1;
-
-                if (videoPacket.granulepos < 0) {
-                    // granulepos is actually listed per-page, not per-packet,
-                    // so not every packet lists a granulepos.
-                    // Scary, huh?
-                    if (videobufGranulepos < 0) {
-                        // don't know our position yet
-                    } else {
-                        videobufGranulepos++;
-                    }
-                } else {
-                    videobufGranulepos = videoPacket.granulepos;
-                    th_decode_ctl(theoraDecoderContext, TH_DECCTL_SET_GRANPOS, &videobufGranulepos, sizeof(videobufGranulepos));
-                }
-
-                double videoPacketTime = -1;
-                double packetKeyframeTime = -1;
-                if (videobufGranulepos < 0) {
-                    // Extract the previous-keyframe info from the granule pos. It might be handy.
-                    keyframeGranulepos = (videobufGranulepos >> theoraInfo.keyframe_granule_shift) << theoraInfo.keyframe_granule_shift;
-
-                    // Convert to precious, precious seconds. Yay linear units!
-                    videobufTime = th_granule_time(theoraDecoderContext, videobufGranulepos);
-                    keyframeTime = th_granule_time(theoraDecoderContext, keyframeGranulepos);
+            if (!ready_video_packet()) {
+                needData = 1;
+            }
+        }
 
-                    // Also, if we've just resynced a stream we need to feed this down to the decoder
-                }
-                //printf("packet granulepos: %llx; time %lf; offset %d\n",(unsigned long long)videoPacket.granulepos, (double)videoPacketTime, (int)theoraInfo.keyframe_granule_shift);
+        ogg_stream_state *audioStream = audio_stream();
+        if (audioStream && processAudio && !audiobufReady) {
+            if (next_audio_packet(&audioPacket, true) > 0) {
+                audiobufReady = 1;
+                track_audio_packet(&audioPacket);
 
-                //OgvJsOutputFrameReady(videobufTime, keyframeTime);
-                isFrameReady = 1;
+                //OgvJsOutputAudioReady(audiobufTime);
+                isAudioReady = 1;
             } else {
                 needData = 1;
             }
         }
 
-        if (!audiobufReady) {
+        if (!videobufReady && !audiobufReady) {
+            // Every track is off; keep draining pages rather than spin.
+            needData = 1;
+        }
+    }
+
+    /* helper: the stream we take audio from; if we have both Vorbis and Opus, prefer Opus */
+    ogg_stream_state *Decoder::impl::audio_stream() {
 #ifdef OPUS
-            if (opusHeaders) {
-                if (ogg_stream_packetpeek(&opusStreamState, &audioPacket) > 0) {
-                    audiobufReady = 1;
-                    if (audioPacket.granulepos == -1) {
-                        // we can't update the granulepos yet
-                    } else {
-                        audiobufGranulepos = audioPacket.granulepos;
-                        audiobufTime = (double)audiobufGranulepos / audioLayout->sampleRate;
-                    }
-                    //OgvJsOutputAudioReady(audiobufTime);
-                    isAudioReady = 1;
-                } else {
-                    needData = 1;
-                }
-            } else
+        if (opusHeaders) {
+            return &opusStreamState;
+        }
 #endif
-            if (vorbisHeaders) {
-                if (ogg_stream_packetpeek(&vorbisStreamState, &audioPacket) > 0) {
-                    audiobufReady = 1;
-                    if (audioPacket.granulepos == -1) {
-                        // we can't update the granulepos yet
-                    } else {
-                        audiobufGranulepos = audioPacket.granulepos;
-                        audiobufTime = vorbis_granule_time(&vorbisDspState, audiobufGranulepos);
-                    }
-                    //OgvJsOutputAudioReady(audiobufTime);
-                    isAudioReady = 1;
-                } else {
-                    needData = 1;
-                }
-            }
+        if (vorbisHeaders) {
+            return &vorbisStreamState;
         }
+        return nullptr;
     }
 
-    bool Decoder::impl::decodeFrame(std::function<void(FrameBuffer &aBuffer)> aCallback)
-    {
-        if (ogg_stream_packetout(&theoraStreamState, &videoPacket) <= 0) {
-            printf("Theora packet didn't come out of stream\n");
-            return 0;
+    /* helper: peek the next video packet and track its time, unless one is already waiting */
+    bool Decoder::impl::ready_video_packet() {
+        if (videobufReady) {
+            return true;
         }
-        videobufReady = 0;
-        int ret = th_decode_packetin(theoraDecoderContext, &videoPacket, NULL);
-        if (ret == 0) {
-            double t = th_granule_time(theoraDecoderContext, videobufGranulepos);
-            if (t > 0) {
-                videobufTime = t;
+        int ret;
+        while ((ret = ogg_stream_packetpeek(&theoraStreamState, &videoPacket)) > 0 &&
+               awaiting_video_keyframe(&videoPacket)) {
+            ogg_stream_packetout(&theoraStreamState, NULL);
+        }
+        if (ret <= 0) {
+            return false;
+        }
+        videobufReady = 1;
+        track_video_packet(&videoPacket);
+
+        //OgvJsOutputFrameReady(videobufTime, keyframeTime);
+        isFrameReady = 1;
+        return true;
+    }
+
+    /* helper: granulepos bookkeeping for the next video packet, before it's decoded */
+    void Decoder::impl::track_video_packet(ogg_packet *packet) {
+        if (packet->granulepos < 0) {
+            // granulepos is actually listed per-page, not per-packet,
+            // so not every packet lists a granulepos.
+            // Scary, huh?
+            if (videobufGranulepos < 0) {
+                // don't know our position yet
             } else {
-                // For some reason sometimes we get a bunch of 0s out of th_granule_time
-                videobufTime += 1.0 / ((double) theoraInfo.fps_numerator / theoraInfo.fps_denominator);
+                videobufGranulepos++;
             }
+        } else {
+            videobufGranulepos = packet->granulepos;
+            th_decode_ctl(theoraDecoderContext, TH_DECCTL_SET_GRANPOS, &videobufGranulepos, sizeof(videobufGranulepos));
+        }
 
-            //printf("granulepos: %llx; time %lf; offset %d\n",(unsigned long long)videobufGranulepos, (double)videobufTime, (int)theoraInfo.keyframe_granule_shift);
+        if (videobufGranulepos >= 0) {
+            // Extract the previous-keyframe info from the granule pos. It might be handy.
+            keyframeGranulepos = (videobufGranulepos >> theoraInfo.keyframe_granule_shift) << theoraInfo.keyframe_granule_shift;
 
-            frames++;
-            video_write(aCallback);
-            return 1;
-        } else if (ret == TH_DUPFRAME) {
-            // Duplicated frame, advance time
-            videobufTime += 1.0 / ((double) theoraInfo.fps_numerator / theoraInfo.fps_denominator);
-            //printf("dupe videobuf time %lf\n", (double)videobufTime);
-            frames++;
-            video_write(aCallback);
-            return 1;
-        } else {
-            printf("Theora decoder failed mysteriously? %d\n", ret);
-            return 0;
+            // Convert to precious, precious seconds. Yay linear units!
+            videobufTime = th_granule_time(theoraDecoderContext, videobufGranulepos);
+            keyframeTime = th_granule_time(theoraDecoderContext, keyframeGranulepos);
+
+            // Also, if we've just resynced a stream we need to feed this down to the decoder
         }
+        //printf("packet granulepos: %llx; offset %d\n",(unsigned long long)packet->granulepos, (int)theoraInfo.keyframe_granule_shift);
     }
 
-    void Decoder::impl::discardFrame()
-    {
+    /* helper: true while video is waiting for a keyframe to resume on, and the packet isn't one */
+    bool Decoder::impl::awaiting_video_keyframe(ogg_packet *packet) {
+        if (!videoNeedsKeyframe) {
+            return false;
+        }
+        if (th_packet_iskeyframe(packet) <= 0) {
+            return true;
+        }
+        // Count frames afresh from here; the dropped ones never happened.
+        videoNeedsKeyframe = false;
+        videobufGranulepos = -1;
+        videobufTime = -1;
+        keyframeGranulepos = -1;
+        keyframeTime = -1;
+        return false;
+    }
+
+    /* helper: granulepos bookkeeping for the next audio packet, before it's decoded */
+    void Decoder::impl::track_audio_packet(ogg_packet *packet) {
+        if (packet->granulepos == -1) {
+            // we can't update the granulepos yet
+            return;
+        }
+        // granulepos dates the packet's last sample; we want its first.
+        audiobufGranulepos = packet->granulepos - audio_packet_duration(packet, audioPrevBlocksize);
+#ifdef OPUS
+        if (opusHeaders) {
+            audiobufTime = (double)audiobufGranulepos / OPUS_GRANULE_RATE;
+            return;
+        }
+#endif
+        audiobufTime = vorbis_granule_time(&vorbisDspState, audiobufGranulepos);
+    }
+
+    /* helper: the next audio packet to decode, returning as ogg_stream_packetpeek/packetout */
+    /* while a seek target is pending, packets come from the held queue instead */
+    int Decoder::impl::next_audio_packet(ogg_packet *packet, bool peek) {
+        ogg_stream_state *audioStream = audio_stream();
+        if (!audioStream) {
+            return 0;
+        }
+        if (audioSeekGranule >= 0 && !resolve_audio_seek(audioStream)) {
+            // Still waiting on a page end to date the held packets.
+            return 0;
+        }
+        if (!audioSeekPackets.empty()) {
+            *packet = audioSeekPackets.front()->packet;
+            if (!peek) {
+                audioSeekCurrent = std::move(audioSeekPackets.front());
+                audioSeekPackets.pop_front();
+                audioSeekDurations.pop_front();
+            }
+            return 1;
+        }
+        return peek ? ogg_stream_packetpeek(audioStream, packet) : ogg_stream_packetout(audioStream, packet);
+    }
+
+    /* helper: pull packets after a seek until we know which is the first worth decoding */
+    /* held packets are dated back from the next page end; those ending before
+       the decoder's pre-roll window are dropped without being decoded */
+    bool Decoder::impl::resolve_audio_seek(ogg_stream_state *stream) {
+        ogg_packet packet;
+        int ret;
+        while ((ret = ogg_stream_packetout(stream, &packet)) != 0) {
+            if (ret < 0) {
+                // A hole; whatever we'd counted from is gone.
+                audioSeekPosition = -1;
+                continue;
+            }
+            int blocksize = audio_packet_blocksize(&packet);
+            int duration = audio_packet_duration(&packet, audioSeekBlocksize);
+            audioSeekBlocksize = blocksize;
+
+            std::unique_ptr<OwnedPacket> held(new OwnedPacket());
+            held->copyFrom(packet);
+            audioSeekPackets.push_back(std::move(held));
+            audioSeekDurations.push_back(duration);
+
+            if (packet.granulepos != -1) {
+                if (audioSeekPosition == -1) {
+                    // First page end since the seek: date everything held so far.
+                    ogg_int64_t end = packet.granulepos;
+                    for (size_t i = audioSeekPackets.size(); i-- > 0;) {
+                        audioSeekPackets[i]->packet.granulepos = end;
+                        end -= audioSeekDurations[i];
+                    }
+                }
+                audioSeekPosition = packet.granulepos;
+            } else if (audioSeekPosition != -1) {
+                audioSeekPosition += duration;
+                audioSeekPackets.back()->packet.granulepos = audioSeekPosition;
+            } else {
+                continue;
+            }
+
+            while (!audioSeekPackets.empty() && !audio_seek_needed(audioSeekPackets.front()->packet.granulepos)) {
+                audioSeekPackets.pop_front();
+                audioSeekDurations.pop_front();
+            }
+            if (!audioSeekPackets.empty()) {
+                // Everything from here on is decoded; the decode side does the final cut.
+                audioSeekGranule = -1;
+                audioSeekPosition = -1;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    /* helper: whether a packet ending at end must be decoded to start output at the seek target */
+    bool Decoder::impl::audio_seek_needed(ogg_int64_t end) {
+#ifdef OPUS
+        if (opusHeaders) {
+            return end > audioSeekGranule - OPUS_SEEK_PREROLL;
+        }
+#endif
+        // A Vorbis packet's output starts where the previous one's ends,
+        // so keep the one before the target to overlap with.
+        return end + vorbis_info_blocksize(&vorbisInfo, 1) / 2 > audioSeekGranule;
+    }
+
+    /* helper: how many of a packet's count output samples, ending at end, fall before the seek target */
+    int Decoder::impl::seek_trim(ogg_int64_t end, int count) {
+        if (audioTrimGranule < 0 || end < 0) {
+            return 0;
+        }
+        ogg_int64_t trim = audioTrimGranule - (end - count);
+        if (end >= audioTrimGranule) {
+            // Everything after this packet is wanted.
+            audioTrimGranule = -1;
+        }
+        return (int)std::max<ogg_int64_t>(0, std::min<ogg_int64_t>(trim, count));
+    }
+
+    /* helper: the packet's block size, read from its header without decoding it */
+    int Decoder::impl::audio_packet_blocksize(ogg_packet *packet) {
+#ifdef OPUS
+        if (opusHeaders) {
+            int samples = opus_packet_get_nb_samples(packet->packet, (opus_int32)packet->bytes, OPUS_GRANULE_RATE);
+            return samples > 0 ? samples : 0;
+        }
+#endif
+        long blocksize = vorbis_packet_blocksize(&vorbisInfo, packet);
+        return blocksize > 0 ? (int)blocksize : 0;
+    }
+
+    /* helper: how far a packet moves the granulepos, given the block size of the one before */
+    int Decoder::impl::audio_packet_duration(ogg_packet *packet, int prevBlocksize) {
+        int blocksize = audio_packet_blocksize(packet);
+#ifdef OPUS
+        if (opusHeaders) {
+            return blocksize;
+        }
+#endif
+        // Vorbis returns the overlap of consecutive blocks; the first after a restart gives none.
+        return prevBlocksize ? (prevBlocksize + blocksize) / 4 : 0;
+    }
+
+    /* helper: granulepos units per second on the audio stream */
+    int Decoder::impl::audio_granule_rate() {
+#ifdef OPUS
+        if (opusHeaders) {
+            return OPUS_GRANULE_RATE;
+        }
+#endif
+        return (int)vorbisInfo.rate;
+    }
+
+    /* helper: drop the decoder's history so audio from before a discontinuity doesn't overlap what follows */
+    /* packets held for a seek target go too; the target itself stays */
+    void Decoder::impl::reset_audio_decoder() {
+        audioSeekPosition = -1;
+        audioSeekBlocksize = 0;
+        audioSeekPackets.clear();
+        audioSeekDurations.clear();
+        if (appState != OGVCORE_STATE_DECODING) {
+            return;
+        }
+#ifdef OPUS
+        if (opusHeaders) {
+            opus_multistream_decoder_ctl(opusDecoder, OPUS_RESET_STATE);
+            opusPrevPacketGranpos = -1;
+        } else
+#endif
+        if (vorbisHeaders) {
+            vorbis_synthesis_restart(&vorbisDspState);
+        }
+        audioPrevBlocksize = 0;
+        if (resampler) {
+            resampler->reset();
+        }
+    }
+
+    bool Decoder::impl::decodeFrame(std::function<void(FrameBuffer &aBuffer)> aCallback)
+    {
+        if (!take_video_packet()) {
+            return 0;
+        }
+        return decode_video_packet(&videoPacket, aCallback);
+    }
+
+    bool Decoder::impl::skipFrame()
+    {
+        if (!take_video_packet()) {
+            return 0;
+        }
+        return decode_video_packet(&videoPacket, nullptr);
+    }
+
+    /* helper: pull out the packet frameTimestamp() describes, peeking and tracking it first if need be */
+    bool Decoder::impl::take_video_packet() {
+        // A packet nobody peeked would skip its granulepos bookkeeping.
+        if (!ready_video_packet() || ogg_stream_packetout(&theoraStreamState, &videoPacket) <= 0) {
+            printf("Theora packet didn't come out of stream\n");
+            return false;
+        }
+        videobufReady = 0;
+        isFrameReady = false;
+        return true;
+    }
+
+    /* helper: decode one Theora packet and output the frame */
+    /* with a null callback the frame only updates the reference state */
+    bool Decoder::impl::decode_video_packet(ogg_packet *packet, std::function<void(FrameBuffer &aBuffer)> aCallback) {
+        int ret = th_decode_packetin(theoraDecoderContext, packet, NULL);
+        if (ret == 0) {
+            double t = th_granule_time(theoraDecoderContext, videobufGranulepos);
+            if (t > 0) {
+                videobufTime = t;
+            } else {
+                // For some reason sometimes we get a bunch of 0s out of th_granule_time
+                videobufTime += 1.0 / ((double) theoraInfo.fps_numerator / theoraInfo.fps_denominator);
+            }
+
+            //printf("granulepos: %llx; time %lf; offset %d\n",(unsigned long long)videobufGranulepos, (double)videobufTime, (int)theoraInfo.keyframe_granule_shift);
+
+            frames++;
+            if (aCallback) {
+                video_write(aCallback);
+            }
+            return 1;
+        } else if (ret == TH_DUPFRAME) {
+            // Duplicated frame, advance time
+            videobufTime += 1.0 / ((double) theoraInfo.fps_numerator / theoraInfo.fps_denominator);
+            //printf("dupe videobuf time %lf\n", (double)videobufTime);
+            frames++;
+            if (aCallback) {
+                video_write(aCallback);
+            }
+            return 1;
+        } else {
+            printf("Theora decoder failed mysteriously? %d\n", ret);
+            return 0;
+        }
+    }
+
+    void Decoder::impl::discardFrame()
+    {
         if (videobufReady) {
             if (theoraHeaders) {
                 ogg_stream_packetout(&theoraStreamState, &videoPacket);
             }
             videobufReady = 0;
+            isFrameReady = false;
+        }
+    }
+
+    void Decoder::impl::setOwnedFrames(bool aOwned, int aPreallocate, bool aHugePages)
+    {
+        if (aOwned) {
+            framePool.reset(new FramePool(aPreallocate > 0 ? aPreallocate : 0, aHugePages));
+        } else {
+            // Frames already handed out keep their blocks alive.
+            framePool.reset();
         }
     }
 
+    std::shared_ptr<FrameBuffer> Decoder::impl::dequeueFrame()
+    {
+        if (!framePool) {
+            setOwnedFrames(true, 4, false);
+        }
+        std::shared_ptr<FrameBuffer> frame;
+        decodeFrame([this, &frame](FrameBuffer &aBuffer) {
+            frame = queuedFrame;
+        });
+        return frame;
+    }
+
     bool Decoder::impl::decodeAudio(std::function<void(AudioBuffer &aBuffer)> aCallback)
     {
-        int packetRet = 0;
         audiobufReady = 0;
+        if (next_audio_packet(&audioPacket, false) > 0) {
+            return decode_audio_packet(&audioPacket, aCallback);
+        }
+        return 0;
+    }
+
+    std::shared_ptr<AudioBuffer> Decoder::impl::decodeAudioSamples(int aSampleCount)
+    {
+        ogg_stream_state *audioStream = audio_stream();
+        if (!audioStream || appState != OGVCORE_STATE_DECODING) {
+            return nullptr;
+        }
+
+        // Size the batch once so every packet lands in the same block;
+        // the last packet may run past the target by up to its length.
+        int packetFrames = max_audio_packet_samples();
+        if (resampler) {
+            packetFrames = resampler->maxOutputFrames(packetFrames);
+        }
+        assert(queuedAudio.get() == NULL);
+        queuedAudio = audioPool.acquire(*audioLayout, aSampleCount + packetFrames, audioFormat);
+        queuedAudio->sampleCount = 0;
+
+        audiobufReady = 0;
+        while (queuedAudio->sampleCount < aSampleCount) {
+            if (next_audio_packet(&audioPacket, false) > 0) {
+                track_audio_packet(&audioPacket);
+                decode_audio_samples(&audioPacket);
+                continue;
+            }
+            int ret = demux_page();
+            if (ret == 0) {
+                // out of input; hand back what we have
+                needData = 1;
+                break;
+            }
+        }
+
+        std::shared_ptr<AudioBuffer> batch;
+        if (queuedAudio->sampleCount > 0) {
+            batch = queuedAudio;
+        }
+        queuedAudio.reset();
+        return batch;
+    }
+
+    int Decoder::impl::decodeAudioInto(AudioRing &aRing)
+    {
+        ogg_stream_state *audioStream = audio_stream();
+        if (!audioStream || appState != OGVCORE_STATE_DECODING) {
+            return 0;
+        }
+        const AudioLayout &ringLayout = aRing.layout();
+        if (aRing.format() != audioFormat ||
+            ringLayout.channelCount != audioLayout->channelCount ||
+            ringLayout.sampleRate != audioLayout->sampleRate) {
+            return -1;
+        }
+        int packetFrames = max_audio_packet_samples();
+        if (resampler) {
+            packetFrames = resampler->maxOutputFrames(packetFrames);
+        }
+        if (packetFrames > aRing.maxWrite()) {
+            return -1;
+        }
+
+        // The decode path appends to queuedAudio; point it at the ring instead.
+        assert(queuedAudio.get() == NULL);
+        if (!ringView) {
+            ringView = std::make_shared<AudioBuffer>();
+        }
+        ringView->layout = *audioLayout;
+        ringView->format = audioFormat;
+        ringView->channelStride = 0;
+
+        int written = 0;
+        audiobufReady = 0;
+        while (void *space = aRing.beginWrite(packetFrames)) {
+            if (next_audio_packet(&audioPacket, false) > 0) {
+                ringView->data = (float *)space;
+                ringView->sampleCount = 0;
+                queuedAudio = ringView;
+                track_audio_packet(&audioPacket);
+                decode_audio_samples(&audioPacket);
+                aRing.commitWrite(ringView->sampleCount);
+                written += ringView->sampleCount;
+                queuedAudio.reset();
+                continue;
+            }
+            int ret = demux_page();
+            if (ret == 0) {
+                needData = 1;
+                break;
+            }
+        }
+        return written;
+    }
+
+    std::shared_ptr<AudioBuffer> Decoder::impl::decodeAudioDuration(double aSeconds)
+    {
+        if (!audioLayout) {
+            return nullptr;
+        }
+        return decodeAudioSamples((int)ceil(aSeconds * audioLayout->sampleRate));
+    }
+
+    /* helper: decode one Vorbis or Opus packet and output its samples */
+    bool Decoder::impl::decode_audio_packet(ogg_packet *packet, std::function<void(AudioBuffer &aBuffer)> aCallback) {
+        assert(queuedAudio.get() == NULL);
+        bool foundSome = decode_audio_samples(packet);
+        if (foundSome) {
+            aCallback(*queuedAudio);
+            queuedAudio.reset();
+        }
+        return foundSome;
+    }
+
+    /* helper: the most samples per channel a single audio packet can produce */
+    int Decoder::impl::max_audio_packet_samples() {
+#ifdef OPUS
+        if (opusHeaders) {
+            return OPUS_MAX_FRAME_SIZE;
+        }
+#endif
+        return (int)vorbis_info_blocksize(&vorbisInfo, 1);
+    }
+
+    /* helper: make room for aSampleCount more samples in queuedAudio, which is
+       either the batch being filled or a fresh pooled buffer; returns the offset */
+    int Decoder::impl::append_audio(int aSampleCount) {
+        if (!queuedAudio) {
+            queuedAudio = audioPool.acquire(*audioLayout, aSampleCount, audioFormat);
+            return 0;
+        }
+        int offset = queuedAudio->sampleCount;
+        assert(audioFormat != AUDIO_SAMPLE_FLOAT_PLANAR || offset + aSampleCount <= queuedAudio->channelStride);
+        queuedAudio->sampleCount += aSampleCount;
+        return offset;
+    }
+
+    /* helper: where frame aOffset of an interleaved queuedAudio starts */
+    void *Decoder::impl::audio_frame(int aOffset) {
+        size_t frameBytes = audioSampleSize(audioFormat) * audioLayout->channelCount;
+        return (unsigned char *)queuedAudio->interleaved() + aOffset * frameBytes;
+    }
+
+    /* helper: set up downmix, resampling and audioLayout for a newly found stream */
+    void Decoder::impl::prepare_audio_output(int aChannels, int aRate, bool aKnownOrder) {
+        int frames = max_audio_packet_samples();
+        int channels = aChannels;
+        downmixMatrix.clear();
+        if (audioDownmix && audioDownmix < aChannels && aKnownOrder) {
+            downmixMatrix.resize(audioDownmix * aChannels);
+            if (audioDownmixMatrix(aChannels, audioDownmix, downmixMatrix.data())) {
+                channels = audioDownmix;
+            } else {
+                downmixMatrix.clear();
+            }
+        }
+
+        int rate = aRate;
+        resampler.reset();
+        if (audioOutputRate && audioOutputRate != aRate) {
+            resampler.reset(new Resampler(channels, aRate, audioOutputRate, resampleQuality, frames));
+            rate = audioOutputRate;
+        }
+        audioLayout.reset(new AudioLayout(channels, rate));
+
+        // Scratch for any stage that can't write straight into queuedAudio.
+        bool interleave = audioFormat != AUDIO_SAMPLE_FLOAT_PLANAR;
+        if (!downmixMatrix.empty() && (interleave || resampler)) {
+            mixOutput.resize(frames * channels);
+            mixPlanes.resize(channels);
+            for (int c = 0; c < channels; c++) {
+                mixPlanes[c] = mixOutput.data() + c * frames;
+            }
+        }
+        if (resampler && interleave) {
+            int resampled = resampler->maxOutputFrames(frames);
+            resampleOutput.resize(resampled * channels);
+            resamplePlanes.resize(channels);
+            for (int c = 0; c < channels; c++) {
+                resamplePlanes[c] = resampleOutput.data() + c * resampled;
+            }
+        }
+        outputPlanes.resize(channels);
+    }
+
+    /* helper: queuedAudio's planes, starting at frame aOffset */
+    float *const *Decoder::impl::queued_planes(int aOffset) {
+        for (int c = 0; c < audioLayout->channelCount; c++) {
+            outputPlanes[c] = queuedAudio->channel(c) + aOffset;
+        }
+        return outputPlanes.data();
+    }
+
+    /* helper: append decoded planes to queuedAudio, mixing down, resampling and converting as asked */
+    void Decoder::impl::write_planar_audio(const float *const *aPlanes, int aFrames) {
+        int channels = audioLayout->channelCount;
+        bool interleave = audioFormat != AUDIO_SAMPLE_FLOAT_PLANAR;
+        int frames = resampler ? resampler->outputFrames(aFrames) : aFrames;
+        int offset = append_audio(frames);
+
+        // Each stage writes into queuedAudio itself if it's the last one to touch float planes.
+        const float *const *planes = aPlanes;
+        bool written = false;
+        if (!downmixMatrix.empty()) {
+            int sourceChannels = (int)downmixMatrix.size() / channels;
+            float *const *mixed = (interleave || resampler) ? mixPlanes.data() : queued_planes(offset);
+            audioMix(planes, sourceChannels, aFrames, downmixMatrix.data(), channels, mixed);
+            planes = mixed;
+            written = !(interleave || resampler);
+        }
+        if (resampler) {
+            float *const *resampled = interleave ? resamplePlanes.data() : queued_planes(offset);
+            resampler->process(planes, aFrames, resampled);
+            planes = resampled;
+            written = !interleave;
+        }
+
+        if (interleave) {
+            audioInterleave(planes, channels, frames, audioFormat, audio_frame(offset), ditherAudio ? &audioDither : nullptr);
+        } else if (!written) {
+            for (int c = 0; c < channels; c++) {
+                memcpy(queuedAudio->channel(c) + offset, planes[c], sizeof(float) * frames);
+            }
+        }
+    }
+
+    /* helper: decode one Vorbis or Opus packet onto the end of queuedAudio */
+    bool Decoder::impl::decode_audio_samples(ogg_packet *packet) {
         int foundSome = 0;
 
 #ifdef OPUS
         if (opusHeaders) {
-            if (ogg_stream_packetout(&opusStreamState, &audioPacket) > 0) {
-                float *output = (float *)malloc(sizeof (float)*OPUS_MAX_FRAME_SIZE * opusChannels);
-                int sampleCount = opus_multistream_decode_float(opusDecoder, (unsigned char*) audioPacket.packet, audioPacket.bytes, output, OPUS_MAX_FRAME_SIZE, 0);
-                if (sampleCount < 0) {
-                    printf("Opus decoding error, code %d\n", sampleCount);
-                } else {
-                    int skip = opusPreskip;
-                    if (audioPacket.granulepos != -1) {
-                        if (audioPacket.granulepos <= opusPrevPacketGranpos) {
-                            sampleCount = 0;
-                        } else {
-                            ogg_int64_t endSample = opusPrevPacketGranpos + sampleCount;
-                            if (audioPacket.granulepos < endSample) {
-                                sampleCount = (int) (endSample - audioPacket.granulepos);
-                            }
-                        }
-                        opusPrevPacketGranpos = audioPacket.granulepos;
+            float *output = opusOutput.data();
+            int frames = opus_multistream_decode_float(opusDecoder, (unsigned char*) packet->packet, packet->bytes, output, OPUS_MAX_FRAME_SIZE, 0);
+            if (frames < 0) {
+                printf("Opus decoding error, code %d\n", frames);
+            } else {
+                // Trim in 48kHz granule units, then map the ends onto output frames.
+                int decimation = OPUS_GRANULE_RATE / opusDecodeRate;
+                int sampleCount = frames * decimation;
+                int skip = opusPreskip;
+                if (packet->granulepos != -1) {
+                    // After a reset we don't know where the last packet ended, so can't trim.
+                    if (opusPrevPacketGranpos == -1) {
+                        // nothing to compare against
+                    } else if (packet->granulepos <= opusPrevPacketGranpos) {
+                        sampleCount = 0;
                     } else {
-                        opusPrevPacketGranpos += sampleCount;
+                        ogg_int64_t endSample = opusPrevPacketGranpos + sampleCount;
+                        if (packet->granulepos < endSample) {
+                            // end trimming: keep only up to the final granulepos
+                            sampleCount = (int) (packet->granulepos - opusPrevPacketGranpos);
+                        }
                     }
-                    if (skip >= sampleCount) {
-                        skip = sampleCount;
-                    } else {
-                        foundSome = 1;
-                        // reorder Opus' interleaved samples into two-dimensional [channel][sample] form
-                        float *pcm = (float *)malloc(sizeof (*pcm)*(sampleCount - skip) * opusChannels);
-                        float **pcmp = (float **)malloc(sizeof (*pcmp) * opusChannels);
+                    opusPrevPacketGranpos = packet->granulepos;
+                } else if (opusPrevPacketGranpos != -1) {
+                    opusPrevPacketGranpos += sampleCount;
+                }
+                if (skip > sampleCount) {
+                    skip = sampleCount;
+                }
+                opusPreskip -= skip;
+
+                // keep track of how much time we've decoded
+                ogg_int64_t end = (packet->granulepos != -1) ? packet->granulepos :
+                                  (audiobufGranulepos != -1) ? audiobufGranulepos + sampleCount : -1;
+                int trim = seek_trim(end, sampleCount - skip);
+                if (end != -1) {
+                    audiobufGranulepos = end;
+                    audiobufTime = (double)audiobufGranulepos / OPUS_GRANULE_RATE;
+                }
+                if (skip + trim < sampleCount) {
+                    foundSome = 1;
+                    int first = (skip + trim) / decimation;
+                    int count = sampleCount / decimation - first;
+                    const float *decoded = output + first * opusChannels;
+                    if (!downmixMatrix.empty() || resampler) {
                         for (int c = 0; c < opusChannels; ++c) {
-                            pcmp[c] = pcm + c * (sampleCount - skip);
-                            for (int s = skip; s < sampleCount; ++s) {
-                                pcmp[c][s - skip] = output[s * opusChannels + c];
-                            }
-                        }
-                        if (audiobufGranulepos != -1) {
-                            // keep track of how much time we've decodec
-                            audiobufGranulepos += (sampleCount - skip);
-                            audiobufTime = (double)audiobufGranulepos / audioLayout->sampleRate;
+                            opusPlanes[c] = opusPlanar.data() + c * OPUS_MAX_FRAME_SIZE;
                         }
-                        assert(queuedAudio.get() == NULL);
-                        queuedAudio.reset(new AudioBuffer(*audioLayout, sampleCount, (const float **)pcmp));
-
-                        free(pcmp);
-                        free(pcm);
+                        audioDeinterleave(decoded, opusChannels, count, opusPlanes.data());
+                        write_planar_audio(opusPlanes.data(), count);
+                    } else if (audioFormat == AUDIO_SAMPLE_FLOAT_PLANAR) {
+                        // reorder Opus' interleaved samples straight into a pooled [channel][sample] buffer
+                        int offset = append_audio(count);
+                        audioDeinterleave(decoded, opusChannels, count, queued_planes(offset));
+                    } else {
+                        // already interleaved; just convert on the way out
+                        int offset = append_audio(count);
+                        audioConvert(decoded, (size_t)count * opusChannels,
+                                     audioFormat, audio_frame(offset), ditherAudio ? &audioDither : nullptr);
                     }
-                    opusPreskip -= skip;
                 }
-                free(output);
             }
         } else
 #endif
         if (vorbisHeaders) {
-            if (ogg_stream_packetout(&vorbisStreamState, &audioPacket) > 0) {
-                int ret = vorbis_synthesis(&vorbisBlock, &audioPacket);
-                if (ret == 0) {
+            int ret = vorbis_synthesis(&vorbisBlock, packet);
+            if (ret == 0) {
+                vorbis_synthesis_blockin(&vorbisDspState, &vorbisBlock);
+                audioPrevBlocksize = audio_packet_blocksize(packet);
+
+                float **pcm;
+                int sampleCount = vorbis_synthesis_pcmout(&vorbisDspState, &pcm);
+
+                // keep track of how much time we've decoded
+                ogg_int64_t end = (packet->granulepos != -1) ? packet->granulepos :
+                                  (audiobufGranulepos != -1) ? audiobufGranulepos + sampleCount : -1;
+                int trim = seek_trim(end, sampleCount);
+                if (end != -1) {
+                    audiobufGranulepos = end;
+                    audiobufTime = vorbis_granule_time(&vorbisDspState, audiobufGranulepos);
+                }
+                //OgvJsOutputAudio(pcm, vorbisInfo.channels, sampleCount);
+
+                if (trim == 0) {
+                    foundSome = 1;
+                    write_planar_audio(pcm, sampleCount);
+                } else if (trim < sampleCount) {
+                    // first packet after a seek: start right at the target sample
                     foundSome = 1;
-                    vorbis_synthesis_blockin(&vorbisDspState, &vorbisBlock);
-
-                    float **pcm;
-                    int sampleCount = vorbis_synthesis_pcmout(&vorbisDspState, &pcm);
-                    if (audiobufGranulepos != -1) {
-                        // keep track of how much time we've decodec
-                        audiobufGranulepos += sampleCount;
-                        audiobufTime = vorbis_granule_time(&vorbisDspState, audiobufGranulepos);
+                    trimmedPlanes.resize(vorbisInfo.channels);
+                    for (int c = 0; c < vorbisInfo.channels; c++) {
+                        trimmedPlanes[c] = pcm[c] + trim;
                     }
-                    //OgvJsOutputAudio(pcm, vorbisInfo.channels, sampleCount);
-
-                    assert(queuedAudio.get() == NULL);
-                    queuedAudio.reset(new AudioBuffer(*audioLayout, sampleCount, (const float **)pcm));
-
-                    vorbis_synthesis_read(&vorbisDspState, sampleCount);
-                } else {
-                    printf("Vorbis decoder failed mysteriously? %d", ret);
+                    write_planar_audio(trimmedPlanes.data(), sampleCount - trim);
                 }
+
+                vorbis_synthesis_read(&vorbisDspState, sampleCount);
+            } else {
+                printf("Vorbis decoder failed mysteriously? %d", ret);
             }
         }
-        
-        if (foundSome) {
-            aCallback(*queuedAudio);
-            queuedAudio.reset();
+
+        if (foundSome && queuedAudio->timestamp < 0 && audiobufGranulepos != -1) {
+            // audiobufTime is the end of everything decoded so far, so this
+            // also dates a batch whose first packets came before any granulepos.
+            double endTime = audiobufTime;
+            if (resampler) {
+                // Output trails input by the filter's lookahead; date it from
+                // where the two streams started instead.
+                endTime = audiobufTime - (double)resampler->framesIn() / resampler->inRate()
+                                       + (double)resampler->framesOut() / resampler->outRate();
+            }
+            queuedAudio->timestamp = endTime - (double)queuedAudio->sampleCount / audioLayout->sampleRate;
         }
 
         return foundSome;
@@ -893,23 +2040,86 @@ namespace OGVCore {
     void Decoder::impl::discardAudio()
     {
         if (audiobufReady) {
-            if (vorbisHeaders) {
-                ogg_stream_packetout(&vorbisStreamState, &audioPacket);
-            }
+            next_audio_packet(&audioPacket, false);
+            audiobufReady = 0;
+        }
+    }
+
+    void Decoder::impl::setAudioOutputFormat(AudioSampleFormat aFormat, bool aDither)
+    {
+        audioFormat = aFormat;
+        // Dither only matters where the quantization step is audible.
+        ditherAudio = aDither && aFormat == AUDIO_SAMPLE_S16;
+    }
+
+    bool Decoder::impl::setOpusDecodeRate(int aRate)
+    {
+        if (aRate != 48000 && aRate != 24000 && aRate != 16000 && aRate != 12000 && aRate != 8000) {
+            return false;
+        }
 #ifdef OPUS
-            if (opusHeaders) {
-                ogg_stream_packetout(&opusStreamState, &audioPacket);
-            }
+        opusDecodeRate = aRate;
 #endif
-            audiobufReady = 0;
+        return true;
+    }
+
+    void Decoder::impl::setAudioDownmix(int aChannels)
+    {
+        audioDownmix = (aChannels == 1 || aChannels == 2) ? aChannels : 0;
+    }
+
+    void Decoder::impl::setAudioSeekTarget(double aTime)
+    {
+        with_decode_ahead_stopped([this, aTime]() {
+            ogg_int64_t target = -1;
+            if (aTime >= 0 && appState == OGVCORE_STATE_DECODING && audio_stream()) {
+                target = (ogg_int64_t)llround(aTime * audio_granule_rate());
+            }
+            audioSeekGranule = target;
+            audioTrimGranule = target;
+        });
+    }
+
+    void Decoder::impl::setAudioOutputRate(int aRate, ResampleQuality aQuality)
+    {
+        audioOutputRate = (aRate > 0) ? aRate : 0;
+        resampleQuality = aQuality;
+    }
+
+    void Decoder::impl::flush()
+    {
+        with_decode_ahead_stopped([this]() {
+            flushBuffers();
+            discardFrame();
+            discardAudio();
+        });
+    }
+
+    /* helper: change decode state with any decode-ahead workers parked, then restart them as they were */
+    void Decoder::impl::with_decode_ahead_stopped(const std::function<void()> &aChange)
+    {
+        int restartDepth = decodeAheadRunning ? decodeAheadDepth : 0;
+        bool restartSplit = decodeAheadSplit;
+        DecoderScheduler *restartScheduler = scheduler;
+        stopDecodeAhead();
+
+        aChange();
+
+        if (restartDepth && restartScheduler) {
+            startDecodeAhead(restartDepth, *restartScheduler);
+        } else if (restartDepth) {
+            startDecodeAhead(restartDepth, restartSplit);
         }
     }
 
     void Decoder::impl::flushBuffers()
     {
-        // First, read out anything left in our input buffer
-        while (ogg_sync_pageout(&oggSyncState, &oggPage) > 0) {
-            queue_page(&oggPage);
+        // First, read out anything left in our input buffer.
+        // A mapped file has no buffer; its remaining pages stay put.
+        if (!pageParser) {
+            while (demux_page() > 0) {
+                // queued as it came out
+            }
         }
 
         // Then, dump all packets from the streams
@@ -934,19 +2144,360 @@ namespace OGVCore {
 #endif
 
         // And reset sync state for good measure.
-        ogg_sync_reset(&oggSyncState);
+        {
+            std::lock_guard<std::mutex> lock(inputMutex);
+            ogg_sync_reset(&oggSyncState);
+            inputReserved = nullptr;
+            inputCommitted = 0;
+        }
+        haveTimestampedPage = false;
         videobufReady = 0;
         audiobufReady = 0;
+        isFrameReady = false;
+        isAudioReady = false;
         videobufGranulepos = -1;
         videobufTime = -1;
         keyframeGranulepos = -1;
         keyframeTime = -1;
         audiobufGranulepos = -1;
         audiobufTime = -1;
+        // Don't smear pre-seek audio into what comes next.
+        reset_audio_decoder();
 
         needData = 1;
     }
 
+    /* helper: output queues and owned frames shared by every decode-ahead mode */
+    void Decoder::impl::prepare_decode_ahead(int aDepth)
+    {
+        decodeAheadDepth = (aDepth > 0) ? aDepth : 1;
+        frameQueue.reset(new SPSCQueue<std::shared_ptr<FrameBuffer>>(decodeAheadDepth));
+        // Audio packets are much shorter than frames; leave it some slack.
+        audioQueue.reset(new SPSCQueue<std::shared_ptr<AudioBuffer>>(decodeAheadDepth * 4));
+        if (!framePool) {
+            // Queued frames must outlive libtheora's buffers.
+            setOwnedFrames(true, decodeAheadDepth + 2, false);
+        }
+    }
+
+    void Decoder::impl::startDecodeAhead(int aDepth, bool aSplitAudioVideo)
+    {
+        if (decodeAheadRunning) {
+            return;
+        }
+        prepare_decode_ahead(aDepth);
+        decodeAheadSplit = aSplitAudioVideo;
+        scheduler = nullptr;
+        decodeAheadRunning = true;
+        if (decodeAheadSplit) {
+            videoPackets.reset(new PacketQueue(decodeAheadDepth));
+            audioPackets.reset(new PacketQueue(decodeAheadDepth * 4));
+            decodeAheadThread = std::thread(&Decoder::impl::runLoop, this, &Decoder::impl::demuxStep, &decodeAheadWake);
+            videoThread = std::thread(&Decoder::impl::runLoop, this, &Decoder::impl::videoStep, &videoWake);
+            audioThread = std::thread(&Decoder::impl::runLoop, this, &Decoder::impl::audioStep, &audioWake);
+        } else {
+            decodeAheadThread = std::thread(&Decoder::impl::runLoop, this, &Decoder::impl::decodeAheadStep, &decodeAheadWake);
+        }
+    }
+
+    void Decoder::impl::startDecodeAhead(int aDepth, DecoderScheduler &aScheduler)
+    {
+        if (decodeAheadRunning) {
+            return;
+        }
+        prepare_decode_ahead(aDepth);
+        decodeAheadSplit = false;
+        scheduler = &aScheduler;
+        decodeAheadRunning = true;
+        wakeRequested = true;
+        schedule_step();
+    }
+
+    void Decoder::impl::stopDecodeAhead()
+    {
+        if (!decodeAheadRunning) {
+            return;
+        }
+        decodeAheadRunning = false;
+        if (scheduler) {
+            // Let the step in flight, if any, finish and drop the chain.
+            std::unique_lock<std::mutex> lock(stepMutex);
+            while (stepScheduled) {
+                lock.unlock();
+                stepIdleWake.wait();
+                lock.lock();
+            }
+            scheduler = nullptr;
+        } else {
+            decodeAheadWake.wake();
+            decodeAheadThread.join();
+        }
+        if (decodeAheadSplit) {
+            videoWake.wake();
+            audioWake.wake();
+            videoThread.join();
+            audioThread.join();
+            videoPackets.reset();
+            audioPackets.reset();
+        }
+        frameQueue.reset();
+        audioQueue.reset();
+    }
+
+    void Decoder::impl::runLoop(bool (Decoder::impl::*aStep)(), Waker *aWaker)
+    {
+        while (decodeAheadRunning) {
+            if (!(this->*aStep)()) {
+                // Out of input, or whoever's downstream is behind.
+                // Sleep until they poke us.
+                aWaker->wait();
+            }
+        }
+    }
+
+    /* helper: poke an idle worker thread, or restart our scheduler task chain */
+    void Decoder::impl::wake_worker(Waker &aWaker)
+    {
+        if (scheduler) {
+            wakeRequested = true;
+            schedule_step();
+        } else {
+            aWaker.wake();
+        }
+    }
+
+    /* helper: put a step on the scheduler unless one is already queued or running */
+    void Decoder::impl::schedule_step()
+    {
+        if (!decodeAheadRunning || stepScheduled.exchange(true)) {
+            return;
+        }
+        // An input thread can get here as stopDecodeAhead() runs. Once we
+        // hold the claim it waits for us, so look again before submitting.
+        DecoderScheduler *target = scheduler;
+        if (!decodeAheadRunning || !target) {
+            stepScheduled = false;
+            stepIdleWake.wake();
+            return;
+        }
+        target->submit([this] { scheduled_step(); });
+    }
+
+    /* helper: one scheduler task; resubmits itself for as long as there's work */
+    void Decoder::impl::scheduled_step()
+    {
+        std::lock_guard<std::mutex> lock(stepMutex);
+        wakeRequested = false;
+        if (decodeAheadRunning && decodeAheadStep()) {
+            // Back of the queue, so hundreds of decoders take turns.
+            scheduler.load()->submit([this] { scheduled_step(); });
+            return;
+        }
+        stepScheduled = false;
+        // A wake that landed while we ran found stepScheduled still set.
+        if (wakeRequested) {
+            schedule_step();
+        }
+        stepIdleWake.wake();
+    }
+
+    /* helper: do one unit of single-worker decode-ahead; false if there was nothing to do */
+    bool Decoder::impl::decodeAheadStep()
+    {
+        if (appState != OGVCORE_STATE_DECODING) {
+            return process();
+        }
+
+        bool didWork = false;
+        if (videobufReady && !frameQueue->full()) {
+            std::shared_ptr<FrameBuffer> frame = dequeueFrame();
+            if (frame) {
+                frameQueue->push(std::move(frame));
+                framesDecoded++;
+            }
+            didWork = true;
+        }
+        if (audiobufReady && !audioQueue->full()) {
+            std::shared_ptr<AudioBuffer> audio;
+            decodeAudio([this, &audio](AudioBuffer &aBuffer) {
+                audio = queuedAudio;
+            });
+            if (audio) {
+                audioQueue->push(std::move(audio));
+            }
+            didWork = true;
+        }
+        if (!didWork) {
+            // Only demux more when a track is actually waiting on a packet;
+            // otherwise packets would just pile up behind a full queue.
+            bool wantVideo = theoraHeaders && processVideo && !videobufReady;
+            bool wantAudio = audioLayout && processAudio && !audiobufReady;
+            if (wantVideo || wantAudio) {
+                didWork = process();
+            } else {
+                producerStalls++;
+            }
+        }
+        return didWork;
+    }
+
+    /* helper: split mode demux stage; hands whole packets to the decode threads */
+    bool Decoder::impl::demuxStep()
+    {
+        if (appState != OGVCORE_STATE_DECODING) {
+            return process();
+        }
+
+        bool didWork = false;
+        if (theoraHeaders && processVideo) {
+            while (!videoPackets->full() && ogg_stream_packetout(&theoraStreamState, &videoPacket) > 0) {
+                if (awaiting_video_keyframe(&videoPacket)) {
+                    continue;
+                }
+                videoPackets->push(videoPacket);
+                videoWake.wake();
+                didWork = true;
+            }
+        }
+        ogg_stream_state *audioStream = processAudio ? audio_stream() : nullptr;
+        if (audioStream) {
+            while (!audioPackets->full() && next_audio_packet(&audioPacket, false) > 0) {
+                audioPackets->push(audioPacket);
+                audioWake.wake();
+                didWork = true;
+            }
+        }
+        if (!didWork) {
+            bool wantVideo = theoraHeaders && processVideo && !videoPackets->full();
+            bool wantAudio = audioStream && !audioPackets->full();
+            if (wantVideo || wantAudio) {
+                didWork = (demux_page() != 0);
+            } else {
+                producerStalls++;
+            }
+        }
+        return didWork;
+    }
+
+    /* helper: split mode video stage; owns the Theora decoder */
+    bool Decoder::impl::videoStep()
+    {
+        if (frameQueue->full()) {
+            producerStalls++;
+            return false;
+        }
+        std::unique_ptr<OwnedPacket> packet = videoPackets->pop();
+        if (!packet) {
+            return false;
+        }
+        decodeAheadWake.wake();
+
+        std::shared_ptr<FrameBuffer> frame;
+        track_video_packet(&packet->packet);
+        decode_video_packet(&packet->packet, [this, &frame](FrameBuffer &aBuffer) {
+            frame = queuedFrame;
+        });
+        videoPackets->recycle(std::move(packet));
+        if (frame) {
+            frameQueue->push(std::move(frame));
+            framesDecoded++;
+        }
+        return true;
+    }
+
+    /* helper: split mode audio stage; owns the Vorbis or Opus decoder */
+    bool Decoder::impl::audioStep()
+    {
+        if (audioQueue->full()) {
+            producerStalls++;
+            return false;
+        }
+        std::unique_ptr<OwnedPacket> packet = audioPackets->pop();
+        if (!packet) {
+            return false;
+        }
+        decodeAheadWake.wake();
+
+        std::shared_ptr<AudioBuffer> audio;
+        track_audio_packet(&packet->packet);
+        decode_audio_packet(&packet->packet, [this, &audio](AudioBuffer &aBuffer) {
+            audio = queuedAudio;
+        });
+        audioPackets->recycle(std::move(packet));
+        if (audio) {
+            audioQueue->push(std::move(audio));
+        }
+        return true;
+    }
+
+    std::shared_ptr<FrameBuffer> Decoder::impl::popFrame()
+    {
+        std::shared_ptr<FrameBuffer> frame;
+        if (!frameQueue || !frameQueue->pop(frame)) {
+            consumerStalls++;
+            return nullptr;
+        }
+        wake_worker(decodeAheadSplit ? videoWake : decodeAheadWake);
+        return frame;
+    }
+
+    std::shared_ptr<AudioBuffer> Decoder::impl::popAudio()
+    {
+        std::shared_ptr<AudioBuffer> audio;
+        if (!audioQueue || !audioQueue->pop(audio)) {
+            return nullptr;
+        }
+        wake_worker(decodeAheadSplit ? audioWake : decodeAheadWake);
+        return audio;
+    }
+
+    DecodeAheadStats Decoder::impl::getDecodeAheadStats() const
+    {
+        DecodeAheadStats stats;
+        stats.queueDepth = decodeAheadDepth;
+        stats.framesQueued = frameQueue ? (int)frameQueue->size() : 0;
+        stats.audioQueued = audioQueue ? (int)audioQueue->size() : 0;
+        stats.videoPacketsQueued = videoPackets ? (int)videoPackets->size() : 0;
+        stats.audioPacketsQueued = audioPackets ? (int)audioPackets->size() : 0;
+        stats.framesDecoded = framesDecoded;
+        stats.consumerStalls = consumerStalls;
+        stats.producerStalls = producerStalls;
+        return stats;
+    }
+
+    // Target length of a parallel decode segment split from the Skeleton index.
+    static const double SEGMENT_SECONDS = 2.0;
+
+    long Decoder::impl::decodeSegments(int aThreads, std::function<void(FrameBuffer &aBuffer)> aCallback)
+    {
+        if (!mappedFile || !theoraHeaders || appState != OGVCORE_STATE_DECODING) {
+            return -1;
+        }
+        SegmentDecoder segments(mappedFile->data(), mappedFile->length(), (uint32_t)theoraStreamState.serialno,
+                                theoraInfo, theoraSetupInfo, *frameLayout);
+        segments.setVerifyChecksums(verifyChecksums);
+
+        // The Skeleton index spares us the scan. A few segments per
+        // worker keeps them all busy as GOP sizes vary, and short ones
+        // keep workers from idling at the queued-frame cap; pieces that
+        // land on the same keypoint collapse into one segment.
+        double duration = getDuration();
+        if (skeletonHeaders && duration > 0 && getKeypointOffset(0) >= 0) {
+            int threads = aThreads > 0 ? aThreads : (int)std::thread::hardware_concurrency();
+            int pieces = std::max((threads > 0 ? threads : 1) * 8, (int)(duration / SEGMENT_SECONDS));
+            for (int i = 0; i < pieces; i++) {
+                long offset = getKeypointOffset(duration * i / pieces);
+                if (offset >= 0) {
+                    segments.addBoundary((uint64_t)offset);
+                }
+            }
+        }
+        if (segments.segmentCount() == 0) {
+            segments.scanKeyframes();
+        }
+        return segments.decode(aThreads, aCallback);
+    }
+
     long Decoder::impl::getSegmentLength() const
     {
         ogg_int64_t segment_len = -1;
@@ -1010,9 +2561,30 @@ namespace OGVCore {
 
             return lastSample - firstSample;
         }
+        int64_t serial = index_serial();
+        if (serial >= 0 && sidecarIndex.hasStream((uint32_t)serial)) {
+            return sidecarIndex.duration((uint32_t)serial);
+        }
+        std::lock_guard<std::mutex> lock(indexMutex);
+        if (keyframeIndex) {
+            return keyframeIndex->duration();
+        }
         return -1;
     }
 
+    DemuxStats Decoder::impl::getDemuxStats() const
+    {
+        return demuxStats;
+    }
+
+    bool Decoder::impl::firstTimestampedPage(TimestampedPage &aPage) const
+    {
+        if (haveTimestampedPage) {
+            aPage = timestampedPage;
+        }
+        return haveTimestampedPage;
+    }
+
     long Decoder::impl::getKeypointOffset(double aTime)
     {
         long time_ms = (long)(aTime * 1000.0);
@@ -1034,6 +2606,107 @@ namespace OGVCore {
             }
             oggskel_get_keypoint_offset(skeleton, serial_nos, nstreams, time_ms, &offset);
         }
+        int64_t serial = index_serial();
+        if (offset < 0 && serial >= 0 && sidecarIndex.hasStream((uint32_t)serial)) {
+            offset = sidecarIndex.keypointOffset((uint32_t)serial, aTime);
+        } else if (offset < 0) {
+            std::lock_guard<std::mutex> lock(indexMutex);
+            if (keyframeIndex) {
+                offset = keyframeIndex->keypointOffset(aTime);
+            }
+        }
         return (long)offset;
     }
+
+    bool Decoder::impl::buildKeyframeIndex(bool aBackground)
+    {
+        int64_t serial = index_serial();
+        if (!mappedFile || appState != OGVCORE_STATE_DECODING || serial < 0) {
+            return false;
+        }
+        if (sidecarIndex.hasStream((uint32_t)serial)) {
+            // Saved last time; nothing to scan.
+            return true;
+        }
+        std::shared_ptr<KeyframeIndex> index;
+        if (theoraHeaders) {
+            // Theora 3.2.1 and later count frames from 1.
+            bool fromOne = (theoraInfo.version_major << 16 | theoraInfo.version_minor << 8 | theoraInfo.version_subminor) >= 0x030201;
+            index = std::make_shared<KeyframeIndex>((uint32_t)serial, theoraInfo.keyframe_granule_shift,
+                (double)theoraInfo.fps_numerator / theoraInfo.fps_denominator, fromOne ? 1 : 0);
+        } else {
+            index = std::make_shared<KeyframeIndex>((uint32_t)serial, 0, (double)audio_granule_rate());
+        }
+
+        stop_index_build();
+        const unsigned char *data = mappedFile->data();
+        uint64_t length = mappedFile->length();
+        if (!aBackground) {
+            index->scan(data, length);
+            std::lock_guard<std::mutex> lock(indexMutex);
+            keyframeIndex = index;
+            return true;
+        }
+
+        indexCancel = false;
+        indexThread = std::thread([this, index, data, length] () {
+            // In slices, so closing the file needn't wait out the scan.
+            while (!indexCancel && !index->scan(data, length, 64 << 20)) {}
+            if (!indexCancel) {
+                std::lock_guard<std::mutex> lock(indexMutex);
+                keyframeIndex = index;
+            }
+        });
+        return true;
+    }
+
+    bool Decoder::impl::keyframeIndexReady() const
+    {
+        int64_t serial = index_serial();
+        if (serial >= 0 && sidecarIndex.hasStream((uint32_t)serial)) {
+            return true;
+        }
+        std::lock_guard<std::mutex> lock(indexMutex);
+        return keyframeIndex != nullptr;
+    }
+
+    bool Decoder::impl::saveKeyframeIndex(const std::string &aPath)
+    {
+        std::shared_ptr<KeyframeIndex> index;
+        {
+            std::lock_guard<std::mutex> lock(indexMutex);
+            index = keyframeIndex;
+        }
+        if (!index || !mappedFile) {
+            return false;
+        }
+        return SidecarIndex::write(aPath.empty() ? filePath + ".ogvidx" : aPath, *mappedFile, { index.get() });
+    }
+
+    /* helper: the stream keyframe indexes cover: video if there is any, else audio */
+    /* -1 before the headers are in */
+    int64_t Decoder::impl::index_serial() const
+    {
+        if (theoraHeaders) {
+            return (uint32_t)theoraStreamState.serialno;
+        }
+#ifdef OPUS
+        if (opusHeaders) {
+            return (uint32_t)opusStreamState.serialno;
+        }
+#endif
+        if (vorbisHeaders) {
+            return (uint32_t)vorbisStreamState.serialno;
+        }
+        return -1;
+    }
+
+    /* helper: abandon a background index scan, before the mapping it reads goes */
+    void Decoder::impl::stop_index_build()
+    {
+        if (indexThread.joinable()) {
+            indexCancel = true;
+            indexThread.join();
+        }
+    }
 }
@@ -0,0 +1,226 @@
+//
+// Platform-independent Ogg Vorbis/Theora/Opus decoder/player base
+//
+// Copyright (c) 2013-2015 Brion Vibber <brion@pobox.com>
+// MIT-style license
+// Please reuse and redistribute with the LICENSE notes intact.
+//
+
+// C++ awesome
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// And our own headers.
+#include <OGVCore.h>
+
+namespace OGVCore {
+
+#pragma mark - Declarations
+
+    class DecoderScheduler::impl {
+    public:
+        impl(int aWorkers);
+        ~impl();
+
+        void submit(std::function<void()> aTask);
+        int workerCount() const;
+        SchedulerStats getStats() const;
+
+    private:
+        struct Worker {
+            std::mutex mutex;
+            std::deque<std::function<void()>> tasks;
+            std::thread thread;
+        };
+
+        std::vector<std::unique_ptr<Worker>> workers;
+        std::atomic<unsigned> nextWorker {0};
+
+        /* tasks queued but not yet claimed, and workers about to sleep or
+           sleeping; a submit only takes idleMutex if there's a sleeper */
+        std::atomic<long> pending {0};
+        std::atomic<int> sleepers {0};
+
+        /* sleeping workers wait here until something is queued anywhere */
+        std::mutex idleMutex;
+        std::condition_variable idleCondition;
+        bool stopping = false;
+
+        std::atomic<long> tasksRun {0};
+        std::atomic<long> tasksStolen {0};
+
+        void run(size_t aIndex);
+        bool claim();
+        bool take(size_t aIndex, std::function<void()> &aTask);
+    };
+
+    /* which of our workers the current thread is, if any */
+    static thread_local const void *currentScheduler = nullptr;
+    static thread_local size_t currentWorker = 0;
+
+#pragma mark - DecoderScheduler methods
+
+    DecoderScheduler::DecoderScheduler(int aWorkers) :
+        pimpl(new impl(aWorkers))
+    {}
+
+    DecoderScheduler::~DecoderScheduler()
+    {}
+
+#pragma mark - public method pimpl bouncers
+
+    void DecoderScheduler::submit(std::function<void()> aTask)
+    {
+        pimpl->submit(aTask);
+    }
+
+    int DecoderScheduler::workerCount() const
+    {
+        return pimpl->workerCount();
+    }
+
+    SchedulerStats DecoderScheduler::getStats() const
+    {
+        return pimpl->getStats();
+    }
+
+#pragma mark - Internal implementation
+
+    DecoderScheduler::impl::impl(int aWorkers)
+    {
+        int cores = (int)std::thread::hardware_concurrency();
+        if (cores <= 0) {
+            cores = 1;
+        }
+        if (aWorkers <= 0 || aWorkers > cores) {
+            aWorkers = cores;
+        }
+        for (int i = 0; i < aWorkers; i++) {
+            workers.emplace_back(new Worker());
+        }
+        // Start them only once the vector is complete; they steal from each other.
+        for (size_t i = 0; i < workers.size(); i++) {
+            workers[i]->thread = std::thread(&DecoderScheduler::impl::run, this, i);
+        }
+    }
+
+    DecoderScheduler::impl::~impl()
+    {
+        {
+            std::lock_guard<std::mutex> lock(idleMutex);
+            stopping = true;
+        }
+        idleCondition.notify_all();
+        for (auto &worker : workers) {
+            worker->thread.join();
+        }
+    }
+
+    void DecoderScheduler::impl::submit(std::function<void()> aTask)
+    {
+        // Keep a worker's follow-up work local; spread outside submissions.
+        size_t index;
+        if (currentScheduler == this) {
+            index = currentWorker;
+        } else {
+            index = nextWorker++ % workers.size();
+        }
+        {
+            std::lock_guard<std::mutex> lock(workers[index]->mutex);
+            workers[index]->tasks.push_back(std::move(aTask));
+        }
+        // Both this and a worker going to sleep bump one counter then
+        // read the other, so at least one of us sees the other's.
+        pending++;
+        if (sleepers > 0) {
+            // Taking the lock orders us against a sleeper between its
+            // check of pending and its wait, so the notify isn't lost.
+            { std::lock_guard<std::mutex> lock(idleMutex); }
+            idleCondition.notify_one();
+        }
+    }
+
+    int DecoderScheduler::impl::workerCount() const
+    {
+        return (int)workers.size();
+    }
+
+    SchedulerStats DecoderScheduler::impl::getStats() const
+    {
+        SchedulerStats stats;
+        stats.workers = (int)workers.size();
+        stats.tasksRun = tasksRun;
+        stats.tasksStolen = tasksStolen;
+        return stats;
+    }
+
+    /* helper: claim one task's worth of pending work, if there is any */
+    bool DecoderScheduler::impl::claim()
+    {
+        long count = pending.load();
+        while (count > 0) {
+            if (pending.compare_exchange_weak(count, count - 1)) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    /* helper: pop from our own queue's front, or steal from the back of another's */
+    bool DecoderScheduler::impl::take(size_t aIndex, std::function<void()> &aTask)
+    {
+        {
+            Worker &own = *workers[aIndex];
+            std::lock_guard<std::mutex> lock(own.mutex);
+            if (!own.tasks.empty()) {
+                // FIFO, so a decoder that keeps resubmitting can't starve the rest.
+                aTask = std::move(own.tasks.front());
+                own.tasks.pop_front();
+                return true;
+            }
+        }
+        for (size_t i = 1; i < workers.size(); i++) {
+            Worker &victim = *workers[(aIndex + i) % workers.size()];
+            std::lock_guard<std::mutex> lock(victim.mutex);
+            if (!victim.tasks.empty()) {
+                aTask = std::move(victim.tasks.back());
+                victim.tasks.pop_back();
+                tasksStolen++;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void DecoderScheduler::impl::run(size_t aIndex)
+    {
+        currentScheduler = this;
+        currentWorker = aIndex;
+        while (true) {
+            if (!claim()) {
+                sleepers++;
+                std::unique_lock<std::mutex> lock(idleMutex);
+                idleCondition.wait(lock, [this] { return pending > 0 || stopping; });
+                sleepers--;
+                if (stopping && pending == 0) {
+                    break;
+                }
+                continue;
+            }
+            // The claimed task is somewhere in the queues.
+            std::function<void()> task;
+            while (!take(aIndex, task)) {
+                // Someone stole the one we saw; ours is in a queue we already passed.
+                std::this_thread::yield();
+            }
+            task();
+            tasksRun++;
+        }
+        currentScheduler = nullptr;
+    }
+
+}
@@ -0,0 +1,89 @@
+//
+// Platform-independent Ogg Vorbis/Theora/Opus decoder/player base
+//
+// Copyright (c) 2013-2015 Brion Vibber <brion@pobox.com>
+// MIT-style license
+// Please reuse and redistribute with the LICENSE notes intact.
+//
+
+// good ol' C library
+#include <stddef.h>
+#include <string.h>
+
+#include "FramePool.h"
+
+namespace OGVCore {
+
+    static size_t alignUp(size_t aValue, size_t aAlignment)
+    {
+        return (aValue + aAlignment - 1) / aAlignment * aAlignment;
+    }
+
+    FramePool::FramePool(size_t aPreallocate, bool aHugePages) :
+        buffers_(aHugePages),
+        preallocate_(aPreallocate),
+        frames_(std::make_shared<FreeList<FrameBuffer>>()),
+        handles_(std::make_shared<FreeList<HandleChunk>>())
+    {}
+
+    std::shared_ptr<FrameBuffer> FramePool::recycledFrame()
+    {
+        FrameBuffer *frame = frames_->pop();
+        if (!frame) {
+            frame = new FrameBuffer();
+        }
+        return recycledHandle(frame, frames_, handles_);
+    }
+
+    std::shared_ptr<FrameBuffer> FramePool::copyFrame(const FrameLayout &aLayout,
+                                                      double aTimestamp, double aKeyframeTimestamp,
+                                                      const PlaneBuffer &aY, const PlaneBuffer &aCb, const PlaneBuffer &aCr)
+    {
+        const PlaneBuffer *source[3] = { &aY, &aCb, &aCr };
+        int widths[3] = {
+            aLayout.frame.width,
+            aLayout.frame.width >> aLayout.subsampling.x,
+            aLayout.frame.width >> aLayout.subsampling.x
+        };
+
+        // Tight, aligned strides; all three planes share one block.
+        int strides[3];
+        size_t offsets[3];
+        size_t total = 0;
+        for (int i = 0; i < 3; i++) {
+            strides[i] = (int)alignUp(widths[i], 32);
+            offsets[i] = total;
+            total += alignUp((size_t)strides[i] * source[i]->height, BufferPool::ALIGNMENT);
+        }
+
+        if (preallocate_) {
+            buffers_.reserve(total, preallocate_);
+            while (frames_->size() < preallocate_) {
+                frames_->push(new FrameBuffer());
+            }
+            preallocate_ = 0;
+        }
+
+        std::shared_ptr<FrameBuffer> frame = recycledFrame();
+        std::shared_ptr<BufferPool::Block> block = buffers_.acquire(total);
+        PlaneBuffer *dest[3];
+        dest[0] = &frame->Y;
+        dest[1] = &frame->Cb;
+        dest[2] = &frame->Cr;
+
+        for (int i = 0; i < 3; i++) {
+            unsigned char *bytes = block->bytes() + offsets[i];
+            for (int y = 0; y < source[i]->height; y++) {
+                memcpy(bytes + (size_t)y * strides[i], source[i]->bytes + (ptrdiff_t)y * source[i]->stride, widths[i]);
+            }
+            *dest[i] = PlaneBuffer(bytes, strides[i], source[i]->height);
+        }
+
+        frame->layout = aLayout;
+        frame->timestamp = aTimestamp;
+        frame->keyframeTimestamp = aKeyframeTimestamp;
+        frame->storage = block;
+        return frame;
+    }
+
+}
@@ -0,0 +1,54 @@
+//
+// Platform-independent Ogg Vorbis/Theora/Opus decoder/player base
+//
+// Copyright (c) 2013-2015 Brion Vibber <brion@pobox.com>
+// MIT-style license
+// Please reuse and redistribute with the LICENSE notes intact.
+//
+
+#pragma once
+
+#include <memory>
+
+#include <OGVCore.h>
+#include "BufferPool.h"
+#include "FreeList.h"
+
+namespace OGVCore {
+
+	/* a released frame lets go of its block right away */
+	inline void recycleReset(FrameBuffer *aFrame)
+	{
+		aFrame->storage.reset();
+	}
+
+	/**
+	 * Hands out owned, ref-counted FrameBuffers whose planes live in one
+	 * pooled block. Dropping the last shared_ptr puts the FrameBuffer
+	 * back on the pool's free list and its block back on the
+	 * BufferPool's, from whatever thread drops it, so steady state
+	 * decoding does no allocation. Acquire from one thread at a time.
+	 */
+	class FramePool {
+	public:
+		FramePool(size_t aPreallocate, bool aHugePages);
+
+		/**
+		 * Copy borrowed planes (eg libtheora's output) into a pooled frame.
+		 */
+		std::shared_ptr<FrameBuffer> copyFrame(const FrameLayout &aLayout,
+		                                       double aTimestamp, double aKeyframeTimestamp,
+		                                       const PlaneBuffer &aY, const PlaneBuffer &aCb, const PlaneBuffer &aCr);
+
+		const BufferPool &bufferPool() const { return buffers_; }
+
+	private:
+		BufferPool buffers_;
+		size_t preallocate_;
+		std::shared_ptr<FreeList<FrameBuffer>> frames_;
+		std::shared_ptr<FreeList<HandleChunk>> handles_;
+
+		std::shared_ptr<FrameBuffer> recycledFrame();
+	};
+
+}
@@ -0,0 +1,175 @@
+//
+// Platform-independent Ogg Vorbis/Theora/Opus decoder/player base
+//
+// Copyright (c) 2013-2015 Brion Vibber <brion@pobox.com>
+// MIT-style license
+// Please reuse and redistribute with the LICENSE notes intact.
+//
+
+#pragma once
+
+#include <stddef.h>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <vector>
+
+namespace OGVCore {
+
+	/**
+	 * Stack of released pool items, shared by a pool and every handle
+	 * it has given out. A handle's deleter pushes its item back from
+	 * whatever thread drops the last reference; the pool pops from its
+	 * own. The mutex orders the two, so everything the releasing thread
+	 * did with the item happens before the pool hands it out again.
+	 *
+	 * Owns whatever it holds; items still out when the pool goes away
+	 * land here and are freed with it.
+	 */
+	template <typename T>
+	class FreeList {
+	public:
+		FreeList() {}
+
+		~FreeList()
+		{
+			clear();
+		}
+
+		/**
+		 * @return an item, or null if none are free
+		 */
+		T *pop()
+		{
+			std::lock_guard<std::mutex> lock(mutex_);
+			if (items_.empty()) {
+				return nullptr;
+			}
+			T *item = items_.back();
+			items_.pop_back();
+			return item;
+		}
+
+		void push(T *aItem)
+		{
+			std::lock_guard<std::mutex> lock(mutex_);
+			items_.push_back(aItem);
+		}
+
+		void clear()
+		{
+			std::vector<T *> items;
+			{
+				std::lock_guard<std::mutex> lock(mutex_);
+				items.swap(items_);
+			}
+			for (T *item : items) {
+				delete item;
+			}
+		}
+
+		size_t size() const
+		{
+			std::lock_guard<std::mutex> lock(mutex_);
+			return items_.size();
+		}
+
+	private:
+		mutable std::mutex mutex_;
+		std::vector<T *> items_;
+
+		FreeList(const FreeList &);
+		FreeList &operator=(const FreeList &);
+	};
+
+	/**
+	 * Room for one shared_ptr control block with a recycling deleter.
+	 */
+	struct HandleChunk {
+		union {
+			max_align_t align;
+			unsigned char bytes[128];
+		};
+	};
+
+	/**
+	 * Allocator for shared_ptr control blocks that recycles them
+	 * through a FreeList, so handing out a pooled item in steady state
+	 * costs no heap allocation.
+	 */
+	template <typename T>
+	class HandleAllocator {
+	public:
+		typedef T value_type;
+
+		explicit HandleAllocator(const std::shared_ptr<FreeList<HandleChunk>> &aChunks) :
+			chunks_(aChunks)
+		{}
+
+		template <typename U>
+		HandleAllocator(const HandleAllocator<U> &aOther) :
+			chunks_(aOther.chunks_)
+		{}
+
+		T *allocate(size_t aCount)
+		{
+			if (aCount * sizeof(T) > sizeof(HandleChunk)) {
+				return static_cast<T *>(::operator new(aCount * sizeof(T)));
+			}
+			HandleChunk *chunk = chunks_->pop();
+			if (!chunk) {
+				chunk = new HandleChunk;
+			}
+			return reinterpret_cast<T *>(chunk);
+		}
+
+		void deallocate(T *aPointer, size_t aCount)
+		{
+			if (aCount * sizeof(T) > sizeof(HandleChunk)) {
+				::operator delete(aPointer);
+			} else {
+				chunks_->push(reinterpret_cast<HandleChunk *>(aPointer));
+			}
+		}
+
+		template <typename U>
+		bool operator==(const HandleAllocator<U> &aOther) const { return chunks_ == aOther.chunks_; }
+		template <typename U>
+		bool operator!=(const HandleAllocator<U> &aOther) const { return chunks_ != aOther.chunks_; }
+
+	private:
+		template <typename U> friend class HandleAllocator;
+		std::shared_ptr<FreeList<HandleChunk>> chunks_;
+	};
+
+	/* what to drop before an item goes back on its free list; nothing by default */
+	template <typename T>
+	inline void recycleReset(T *)
+	{}
+
+	/**
+	 * shared_ptr deleter that hands the item back to its FreeList,
+	 * after letting go of anything it holds onto.
+	 */
+	template <typename T>
+	struct Recycler {
+		std::shared_ptr<FreeList<T>> freeList;
+
+		void operator()(T *aItem) const
+		{
+			recycleReset(aItem);
+			freeList->push(aItem);
+		}
+	};
+
+	/**
+	 * Wrap a pool item in a handle that recycles it.
+	 */
+	template <typename T>
+	std::shared_ptr<T> recycledHandle(T *aItem, const std::shared_ptr<FreeList<T>> &aFreeList,
+	                                  const std::shared_ptr<FreeList<HandleChunk>> &aChunks)
+	{
+		return std::shared_ptr<T>(aItem, Recycler<T> { aFreeList }, HandleAllocator<T>(aChunks));
+	}
+
+}
@@ -0,0 +1,145 @@
+//
+// Platform-independent Ogg Vorbis/Theora/Opus decoder/player base
+//
+// Copyright (c) 2013-2015 Brion Vibber <brion@pobox.com>
+// MIT-style license
+// Please reuse and redistribute with the LICENSE notes intact.
+//
+
+#include <algorithm>
+
+#include "KeyframeIndex.h"
+
+namespace OGVCore {
+
+    namespace {
+
+        // Audio can start at any page; this many seconds apart is plenty.
+        const double AUDIO_KEYPOINT_SPACING = 1.0;
+
+    }
+
+    KeyframeIndex::KeyframeIndex(uint32_t aSerial, int aGranuleShift, double aGranuleRate, int64_t aGranuleOffset) :
+        serial_(aSerial),
+        granuleShift_(aGranuleShift),
+        granuleRate_(aGranuleRate),
+        granuleOffset_(aGranuleOffset),
+        position_(0),
+        complete_(false),
+        lastGranule_(-1),
+        lastKeyframe_(-1),
+        nextStart_(-1)
+    {}
+
+    bool KeyframeIndex::scan(const unsigned char *aData, uint64_t aLength, uint64_t aMaxBytes)
+    {
+        if (complete_) {
+            return true;
+        }
+
+        // Headers only: the checksum would mean reading every payload.
+        OggPageParser parser(aData, aLength);
+        parser.setVerifyChecksums(false);
+        parser.seek(position_);
+        uint64_t stop = (aMaxBytes < aLength - position_) ? position_ + aMaxBytes : aLength;
+
+        OggPageView page;
+        int ret;
+        while (parser.position() < stop && (ret = parser.nextPage(page)) != 0) {
+            if (ret > 0 && page.serialno() == serial_) {
+                addPage(page);
+            }
+        }
+        position_ = parser.position();
+        if (position_ >= stop && stop < aLength) {
+            return false;
+        }
+        complete_ = true;
+        return true;
+    }
+
+    void KeyframeIndex::finish(uint64_t aLength)
+    {
+        position_ = aLength;
+        complete_ = true;
+    }
+
+    int64_t KeyframeIndex::keypointOffset(double aTime) const
+    {
+        if (!complete_ && (lastGranule_ < 0 || aTime > granuleTime(lastGranule_))) {
+            // There may be a later seek point we haven't seen yet.
+            return -1;
+        }
+        auto after = std::upper_bound(keypoints_.begin(), keypoints_.end(), aTime,
+            [] (double time, const Keypoint &keypoint) {
+                return time < keypoint.time;
+            });
+        if (after == keypoints_.begin()) {
+            return -1;
+        }
+        return (int64_t)(after - 1)->offset;
+    }
+
+    double KeyframeIndex::duration() const
+    {
+        if (lastGranule_ < 0) {
+            return -1;
+        }
+        if (granuleShift_ > 0) {
+            // A frame's granulepos dates its start; it lasts one more.
+            return granuleTime(lastGranule_) + 1.0 / granuleRate_;
+        }
+        return granuleTime(lastGranule_);
+    }
+
+    /* helper: note a seek point if this page dates a new one */
+    void KeyframeIndex::addPage(const OggPageView &aPage)
+    {
+        if (aPage.bos()) {
+            // Headers; the stream's data starts afterwards.
+            nextStart_ = -1;
+            return;
+        }
+        if (nextStart_ < 0) {
+            // The last dated page ended on a packet boundary, so the
+            // next packet starts here.
+            nextStart_ = (int64_t)aPage.offset;
+        }
+        int64_t granule = aPage.granulepos();
+        if (granule < 0) {
+            // Nothing ends here; it's all one packet carrying on.
+            return;
+        }
+
+        if (granuleShift_ > 0) {
+            int64_t keyframe = granule >> granuleShift_;
+            if (keyframe != lastKeyframe_ && keyframe >= granuleOffset_ && granule > 0) {
+                keypoints_.push_back({ (uint64_t)nextStart_, granuleTime(keyframe << granuleShift_) });
+            }
+            lastKeyframe_ = keyframe;
+        } else if (lastGranule_ >= 0 && granule > lastGranule_) {
+            // Decoding from nextStart_ picks up right after lastGranule_.
+            double time = std::max(granuleTime(lastGranule_), 0.0);
+            if (keypoints_.empty() || time - keypoints_.back().time >= AUDIO_KEYPOINT_SPACING) {
+                keypoints_.push_back({ (uint64_t)nextStart_, time });
+            }
+        }
+        lastGranule_ = granule;
+
+        // A packet left unfinished at the end starts on this page.
+        int segments = aPage.segmentCount();
+        bool unfinished = segments > 0 && aPage.lacing()[segments - 1] == 255;
+        nextStart_ = unfinished ? (int64_t)aPage.offset : -1;
+    }
+
+    /* helper: seconds for a granulepos, Theora's being split in two */
+    double KeyframeIndex::granuleTime(int64_t aGranule) const
+    {
+        int64_t units = aGranule;
+        if (granuleShift_ > 0) {
+            units = (aGranule >> granuleShift_) + (aGranule & (((int64_t)1 << granuleShift_) - 1));
+        }
+        return (double)(units - granuleOffset_) / granuleRate_;
+    }
+
+}
@@ -0,0 +1,101 @@
+//
+// Platform-independent Ogg Vorbis/Theora/Opus decoder/player base
+//
+// Copyright (c) 2013-2015 Brion Vibber <brion@pobox.com>
+// MIT-style license
+// Please reuse and redistribute with the LICENSE notes intact.
+//
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <vector>
+
+#include "OggPageParser.h"
+
+namespace OGVCore {
+
+	/**
+	 * Seek points for one logical stream of a mapped file, found from
+	 * the page headers alone, for files without a Skeleton index.
+	 * Payloads are never read, so a scan runs at about the speed the
+	 * file can be paged in.
+	 *
+	 * For Theora, a keyframe's number is its granulepos shifted down by
+	 * keyframe_granule_shift, so a page whose granulepos names a new
+	 * keyframe marks one starting since the stream's previous granulepos.
+	 * Audio has no keyframes; every page start is a seek point, and they
+	 * are thinned out to about one a second.
+	 */
+	class KeyframeIndex {
+	public:
+		struct Keypoint {
+			uint64_t offset;
+			double time;
+		};
+
+		/**
+		 * @param aSerial stream to index
+		 * @param aGranuleShift Theora's keyframe_granule_shift, or 0 for audio
+		 * @param aGranuleRate frames or samples per second
+		 * @param aGranuleOffset granules to take off before converting to
+		 *        time: 1 for Theora 3.2.1 and later, which counts frames
+		 *        from 1, or Opus's pre-skip
+		 */
+		KeyframeIndex(uint32_t aSerial, int aGranuleShift, double aGranuleRate, int64_t aGranuleOffset = 0);
+
+		/**
+		 * Scan on through up to aMaxBytes more of the file, so a caller
+		 * can do it in slices.
+		 *
+		 * @return true once the whole file has been scanned
+		 */
+		bool scan(const unsigned char *aData, uint64_t aLength, uint64_t aMaxBytes = UINT64_MAX);
+		/**
+		 * Or walk the file yourself, eg to index several streams in one
+		 * pass: feed every page of the stream in file order, then call
+		 * finish() with the file length.
+		 */
+		void addPage(const OggPageView &aPage);
+		void finish(uint64_t aLength);
+
+		bool complete() const { return complete_; }
+		uint64_t position() const { return position_; }
+
+		/**
+		 * @return the offset of a page to start decoding from to reach
+		 *         aTime from a seek point at or before it, or -1 if the
+		 *         scan hasn't got that far
+		 */
+		int64_t keypointOffset(double aTime) const;
+		/**
+		 * @return the end time of the last granulepos scanned, or -1
+		 */
+		double duration() const;
+		size_t size() const { return keypoints_.size(); }
+		/**
+		 * @return the seek points so far, in file order
+		 */
+		const std::vector<Keypoint> &keypoints() const { return keypoints_; }
+		uint32_t serial() const { return serial_; }
+
+	private:
+		uint32_t serial_;
+		int granuleShift_;
+		double granuleRate_;
+		int64_t granuleOffset_;
+
+		std::vector<Keypoint> keypoints_;
+		uint64_t position_;
+		bool complete_;
+
+		int64_t lastGranule_;   // of the stream's last page with one, or -1
+		int64_t lastKeyframe_;  // keyframe number in it
+		int64_t nextStart_;     // page the packet after it starts on; -1 for the stream's next page
+
+		double granuleTime(int64_t aGranule) const;
+	};
+
+}
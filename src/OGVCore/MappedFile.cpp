@@ -0,0 +1,70 @@
+//
+// Platform-independent Ogg Vorbis/Theora/Opus decoder/player base
+//
+// Copyright (c) 2013-2015 Brion Vibber <brion@pobox.com>
+// MIT-style license
+// Please reuse and redistribute with the LICENSE notes intact.
+//
+
+// POSIX
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "MappedFile.h"
+
+namespace OGVCore {
+
+    MappedFile::MappedFile() :
+        data_(nullptr),
+        length_(0),
+        mtime_(0)
+    {}
+
+    MappedFile::~MappedFile()
+    {
+        close();
+    }
+
+    bool MappedFile::open(const std::string &aPath)
+    {
+        close();
+
+        int fd = ::open(aPath.c_str(), O_RDONLY);
+        if (fd < 0) {
+            return false;
+        }
+
+        struct stat st;
+        if (fstat(fd, &st) < 0 || st.st_size <= 0 || (uint64_t)st.st_size > (uint64_t)SIZE_MAX) {
+            ::close(fd);
+            return false;
+        }
+
+        void *mapping = mmap(nullptr, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+        // The mapping keeps its own reference to the file.
+        ::close(fd);
+        if (mapping == MAP_FAILED) {
+            return false;
+        }
+        // Demuxing is mostly a front-to-back walk.
+        madvise(mapping, (size_t)st.st_size, MADV_SEQUENTIAL);
+
+        data_ = (const unsigned char *)mapping;
+        length_ = (uint64_t)st.st_size;
+        mtime_ = (int64_t)st.st_mtime;
+        return true;
+    }
+
+    void MappedFile::close()
+    {
+        if (data_) {
+            munmap((void *)data_, (size_t)length_);
+            data_ = nullptr;
+            length_ = 0;
+            mtime_ = 0;
+        }
+    }
+
+}
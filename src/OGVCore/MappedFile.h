@@ -0,0 +1,44 @@
+//
+// Platform-independent Ogg Vorbis/Theora/Opus decoder/player base
+//
+// Copyright (c) 2013-2015 Brion Vibber <brion@pobox.com>
+// MIT-style license
+// Please reuse and redistribute with the LICENSE notes intact.
+//
+
+#pragma once
+
+#include <stdint.h>
+#include <string>
+
+namespace OGVCore {
+
+	/**
+	 * Read-only memory mapping of a whole local file.
+	 * Needs a 64-bit address space for multi-GB files.
+	 */
+	class MappedFile {
+	public:
+		MappedFile();
+		~MappedFile();
+
+		/**
+		 * @return false if the file couldn't be opened or mapped
+		 */
+		bool open(const std::string &aPath);
+		void close();
+
+		const unsigned char *data() const { return data_; }
+		uint64_t length() const { return length_; }
+		int64_t modificationTime() const { return mtime_; }
+
+	private:
+		const unsigned char *data_;
+		uint64_t length_;
+		int64_t mtime_;
+
+		MappedFile(const MappedFile &);
+		MappedFile &operator=(const MappedFile &);
+	};
+
+}
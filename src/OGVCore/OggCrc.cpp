@@ -0,0 +1,330 @@
+//
+// Platform-independent Ogg Vorbis/Theora/Opus decoder/player base
+//
+// Copyright (c) 2013-2015 Brion Vibber <brion@pobox.com>
+// MIT-style license
+// Please reuse and redistribute with the LICENSE notes intact.
+//
+
+#include <assert.h>
+#include <string.h>
+
+#include "OggCrc.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define OGVCORE_CRC_PCLMUL 1
+#endif
+
+#if defined(__aarch64__)
+#include <arm_acle.h>
+#if defined(__linux__)
+#include <sys/auxv.h>
+#include <asm/hwcap.h>
+#endif
+#define OGVCORE_CRC_ARMV8 1
+#if defined(__clang__)
+#define OGVCORE_TARGET_CRC __attribute__((target("crc")))
+#else
+#define OGVCORE_TARGET_CRC __attribute__((target("+crc")))
+#endif
+#endif
+
+namespace OGVCore {
+
+    namespace {
+
+        const uint32_t OGG_CRC_POLY = 0x04c11db7U;
+
+        /* slice[k][i] is the checksum of byte i followed by k zero bytes */
+        struct CrcTables {
+            uint32_t slice[8][256];
+
+            CrcTables()
+            {
+                for (uint32_t i = 0; i < 256; i++) {
+                    uint32_t r = i << 24;
+                    for (int j = 0; j < 8; j++) {
+                        r = (r & 0x80000000U) ? ((r << 1) ^ OGG_CRC_POLY) : (r << 1);
+                    }
+                    slice[0][i] = r;
+                }
+                for (int k = 1; k < 8; k++) {
+                    for (uint32_t i = 0; i < 256; i++) {
+                        uint32_t prev = slice[k - 1][i];
+                        slice[k][i] = (prev << 8) ^ slice[0][prev >> 24];
+                    }
+                }
+            }
+        };
+
+        const CrcTables &crcTables()
+        {
+            static const CrcTables tables;
+            return tables;
+        }
+
+        uint32_t crcBytewise(uint32_t crc, const unsigned char *data, size_t length)
+        {
+            const uint32_t *table = crcTables().slice[0];
+            for (size_t i = 0; i < length; i++) {
+                crc = (crc << 8) ^ table[(crc >> 24) ^ data[i]];
+            }
+            return crc;
+        }
+
+        uint32_t crcSlice8(uint32_t crc, const unsigned char *data, size_t length)
+        {
+            const CrcTables &t = crcTables();
+            while (length >= 8) {
+                uint32_t hi = crc ^ (((uint32_t)data[0] << 24) |
+                                     ((uint32_t)data[1] << 16) |
+                                     ((uint32_t)data[2] << 8) |
+                                     (uint32_t)data[3]);
+                crc = t.slice[7][hi >> 24] ^
+                      t.slice[6][(hi >> 16) & 0xff] ^
+                      t.slice[5][(hi >> 8) & 0xff] ^
+                      t.slice[4][hi & 0xff] ^
+                      t.slice[3][data[4]] ^
+                      t.slice[2][data[5]] ^
+                      t.slice[1][data[6]] ^
+                      t.slice[0][data[7]];
+                data += 8;
+                length -= 8;
+            }
+            return crcBytewise(crc, data, length);
+        }
+
+        /* x^n mod P, for the folding constants */
+        uint32_t xPowModP(int n)
+        {
+            uint32_t r = 1;
+            for (int i = 0; i < n; i++) {
+                r = (r & 0x80000000U) ? ((r << 1) ^ OGG_CRC_POLY) : (r << 1);
+            }
+            return r;
+        }
+
+#ifdef OGVCORE_CRC_PCLMUL
+        struct FoldConstants {
+            uint64_t fold128[2]; // lo: x^128 mod P, hi: x^192 mod P
+            uint64_t fold512[2]; // lo: x^512 mod P, hi: x^576 mod P
+
+            FoldConstants()
+            {
+                fold128[0] = xPowModP(128);
+                fold128[1] = xPowModP(192);
+                fold512[0] = xPowModP(512);
+                fold512[1] = xPowModP(576);
+            }
+        };
+
+        const FoldConstants &foldConstants()
+        {
+            static const FoldConstants constants;
+            return constants;
+        }
+
+        /*
+         * Blocks are loaded byte-reversed so bit 127 of a register is the
+         * first message bit, letting the MSB-first polynomial be folded with
+         * plain carry-less multiplies: X * x^n == hi * (x^(n+64) mod P)
+         * + lo * (x^n mod P). The folded 128 bits are then run through the
+         * table code, which yields X * x^32 mod P, ie the checksum.
+         */
+        __attribute__((target("pclmul,ssse3")))
+        uint32_t crcPclmul(uint32_t crc, const unsigned char *data, size_t length)
+        {
+            if (length < 64) {
+                return crcSlice8(crc, data, length);
+            }
+
+            const __m128i reverse = _mm_setr_epi8(15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0);
+            const FoldConstants &fc = foldConstants();
+            const __m128i k128 = _mm_loadu_si128((const __m128i *)fc.fold128);
+            const __m128i k512 = _mm_loadu_si128((const __m128i *)fc.fold512);
+
+            __m128i x0 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(data + 0)), reverse);
+            __m128i x1 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(data + 16)), reverse);
+            __m128i x2 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(data + 32)), reverse);
+            __m128i x3 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(data + 48)), reverse);
+            // The running checksum is xored into the first message bits.
+            x0 = _mm_xor_si128(x0, _mm_set_epi32((int)crc, 0, 0, 0));
+            data += 64;
+            length -= 64;
+
+#define OGVCORE_FOLD(x, k, next) \
+            _mm_xor_si128(_mm_xor_si128(_mm_clmulepi64_si128(x, k, 0x11), \
+                                        _mm_clmulepi64_si128(x, k, 0x00)), next)
+
+            while (length >= 64) {
+                x0 = OGVCORE_FOLD(x0, k512, _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(data + 0)), reverse));
+                x1 = OGVCORE_FOLD(x1, k512, _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(data + 16)), reverse));
+                x2 = OGVCORE_FOLD(x2, k512, _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(data + 32)), reverse));
+                x3 = OGVCORE_FOLD(x3, k512, _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(data + 48)), reverse));
+                data += 64;
+                length -= 64;
+            }
+
+            // Collapse the four lanes, then eat any remaining whole blocks.
+            x0 = OGVCORE_FOLD(x0, k128, x1);
+            x0 = OGVCORE_FOLD(x0, k128, x2);
+            x0 = OGVCORE_FOLD(x0, k128, x3);
+            while (length >= 16) {
+                x0 = OGVCORE_FOLD(x0, k128, _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)data), reverse));
+                data += 16;
+                length -= 16;
+            }
+#undef OGVCORE_FOLD
+
+            unsigned char folded[16];
+            _mm_storeu_si128((__m128i *)folded, _mm_shuffle_epi8(x0, reverse));
+            crc = crcSlice8(0, folded, 16);
+            return crcSlice8(crc, data, length);
+        }
+
+        bool pclmulAvailable()
+        {
+            __builtin_cpu_init();
+            return __builtin_cpu_supports("pclmul") && __builtin_cpu_supports("ssse3");
+        }
+#endif
+
+#ifdef OGVCORE_CRC_ARMV8
+        /*
+         * The ARMv8 instructions compute the bit-reflected form of the same
+         * polynomial, so feed them bit-reversed bytes and reverse the result.
+         */
+        OGVCORE_TARGET_CRC
+        uint32_t crcArmv8(uint32_t crc, const unsigned char *data, size_t length)
+        {
+            uint32_t r = __rbit(crc);
+            while (length >= 8) {
+                uint64_t v;
+                memcpy(&v, data, 8);
+                r = __crc32d(r, __builtin_bswap64(__rbitll(v)));
+                data += 8;
+                length -= 8;
+            }
+            while (length > 0) {
+                r = __crc32b(r, (uint8_t)(__rbit((uint32_t)*data) >> 24));
+                data++;
+                length--;
+            }
+            return __rbit(r);
+        }
+
+        bool armv8CrcAvailable()
+        {
+#if defined(__ARM_FEATURE_CRC32) || defined(__APPLE__)
+            return true;
+#elif defined(__linux__)
+            return (getauxval(AT_HWCAP) & HWCAP_CRC32) != 0;
+#else
+            return false;
+#endif
+        }
+#endif
+
+        typedef uint32_t (*CrcFunc)(uint32_t, const unsigned char *, size_t);
+
+        CrcFunc kernelFunc(OggCrcKernel kernel)
+        {
+            switch (kernel) {
+                case OGG_CRC_BYTEWISE:
+                    return crcBytewise;
+                case OGG_CRC_SLICE8:
+                    return crcSlice8;
+#ifdef OGVCORE_CRC_PCLMUL
+                case OGG_CRC_PCLMUL:
+                    return pclmulAvailable() ? crcPclmul : nullptr;
+#endif
+#ifdef OGVCORE_CRC_ARMV8
+                case OGG_CRC_ARMV8:
+                    return armv8CrcAvailable() ? crcArmv8 : nullptr;
+#endif
+                default:
+                    return nullptr;
+            }
+        }
+
+        struct Dispatch {
+            OggCrcKernel kernel;
+            CrcFunc func;
+
+            Dispatch() :
+                kernel(OGG_CRC_SLICE8),
+                func(crcSlice8)
+            {
+                const OggCrcKernel preferred[] = {OGG_CRC_PCLMUL, OGG_CRC_ARMV8};
+                for (size_t i = 0; i < sizeof(preferred) / sizeof(preferred[0]); i++) {
+                    CrcFunc f = kernelFunc(preferred[i]);
+                    if (f) {
+                        kernel = preferred[i];
+                        func = f;
+                        break;
+                    }
+                }
+            }
+        };
+
+        const Dispatch &dispatch()
+        {
+            static const Dispatch selected;
+            return selected;
+        }
+
+    }
+
+    bool oggCrcKernelAvailable(OggCrcKernel kernel)
+    {
+        return kernelFunc(kernel) != nullptr;
+    }
+
+    const char *oggCrcKernelName(OggCrcKernel kernel)
+    {
+        switch (kernel) {
+            case OGG_CRC_BYTEWISE: return "bytewise";
+            case OGG_CRC_SLICE8:   return "slice8";
+            case OGG_CRC_PCLMUL:   return "pclmul";
+            case OGG_CRC_ARMV8:    return "armv8";
+            default:               return "unknown";
+        }
+    }
+
+    OggCrcKernel oggCrcSelectedKernel()
+    {
+        return dispatch().kernel;
+    }
+
+    uint32_t oggCrcUpdate(uint32_t crc, const unsigned char *data, size_t length)
+    {
+        return dispatch().func(crc, data, length);
+    }
+
+    uint32_t oggCrcUpdateWith(OggCrcKernel kernel, uint32_t crc, const unsigned char *data, size_t length)
+    {
+        CrcFunc func = kernelFunc(kernel);
+        assert(func != nullptr);
+        return func(crc, data, length);
+    }
+
+    bool oggPageCrcValid(const unsigned char *header, size_t headerLength,
+                         const unsigned char *body, size_t bodyLength)
+    {
+        static const unsigned char zeroes[4] = {0, 0, 0, 0};
+
+        // The checksum lives at bytes 22-25 of the page header.
+        uint32_t crc = oggCrcUpdate(0, header, 22);
+        crc = oggCrcUpdate(crc, zeroes, 4);
+        crc = oggCrcUpdate(crc, header + 26, headerLength - 26);
+        crc = oggCrcUpdate(crc, body, bodyLength);
+
+        uint32_t stored = (uint32_t)header[22] |
+                          ((uint32_t)header[23] << 8) |
+                          ((uint32_t)header[24] << 16) |
+                          ((uint32_t)header[25] << 24);
+        return crc == stored;
+    }
+
+}
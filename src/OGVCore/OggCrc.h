@@ -0,0 +1,54 @@
+//
+// Platform-independent Ogg Vorbis/Theora/Opus decoder/player base
+//
+// Copyright (c) 2013-2015 Brion Vibber <brion@pobox.com>
+// MIT-style license
+// Please reuse and redistribute with the LICENSE notes intact.
+//
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace OGVCore {
+
+	/**
+	 * Available checksum implementations; the fastest one the CPU
+	 * supports is picked at runtime for oggCrcUpdate().
+	 */
+	enum OggCrcKernel {
+		OGG_CRC_BYTEWISE,  // one table lookup per byte, like libogg
+		OGG_CRC_SLICE8,    // slicing-by-8 tables, portable
+		OGG_CRC_PCLMUL,    // x86 carry-less multiply folding
+		OGG_CRC_ARMV8,     // ARMv8 CRC32 instructions on bit-reversed data
+		OGG_CRC_KERNEL_COUNT
+	};
+
+	bool oggCrcKernelAvailable(OggCrcKernel kernel);
+	const char *oggCrcKernelName(OggCrcKernel kernel);
+	OggCrcKernel oggCrcSelectedKernel();
+
+	/**
+	 * Ogg page checksum: CRC-32, polynomial 0x04c11db7, MSB-first,
+	 * zero initial value and no final xor.
+	 *
+	 * @param crc running checksum, 0 to start
+	 * @return updated checksum
+	 */
+	uint32_t oggCrcUpdate(uint32_t crc, const unsigned char *data, size_t length);
+
+	/**
+	 * Run a specific kernel, for testing and benchmarking.
+	 * Kernel must be available.
+	 */
+	uint32_t oggCrcUpdateWith(OggCrcKernel kernel, uint32_t crc, const unsigned char *data, size_t length);
+
+	/**
+	 * Check a complete page in place, treating the checksum field as zero
+	 * the way the encoder did, without copying the header.
+	 */
+	bool oggPageCrcValid(const unsigned char *header, size_t headerLength,
+	                     const unsigned char *body, size_t bodyLength);
+
+}
@@ -0,0 +1,91 @@
+//
+// Platform-independent Ogg Vorbis/Theora/Opus decoder/player base
+//
+// Copyright (c) 2013-2015 Brion Vibber <brion@pobox.com>
+// MIT-style license
+// Please reuse and redistribute with the LICENSE notes intact.
+//
+
+#include <string.h>
+
+#include "OggPageParser.h"
+#include "OggCrc.h"
+
+namespace OGVCore {
+
+    static const size_t OGG_PAGE_HEADER_MIN = 27;
+
+    OggPageParser::OggPageParser(const unsigned char *aData, uint64_t aLength) :
+        data_(aData),
+        length_(aLength),
+        position_(0),
+        verifyChecksums_(true)
+    {}
+
+    void OggPageParser::seek(uint64_t aOffset)
+    {
+        position_ = (aOffset > length_) ? length_ : aOffset;
+    }
+
+    /* skip ahead to the next possible capture pattern */
+    bool OggPageParser::resync()
+    {
+        uint64_t start = position_ + 1;
+        while (start + 4 <= length_) {
+            const unsigned char *found = (const unsigned char *)memchr(data_ + start, 'O', (size_t)(length_ - start));
+            if (!found) {
+                break;
+            }
+            start = found - data_;
+            if (start + 4 <= length_ && memcmp(found, "OggS", 4) == 0) {
+                position_ = start;
+                return true;
+            }
+            start++;
+        }
+        position_ = length_;
+        return false;
+    }
+
+    int OggPageParser::nextPage(OggPageView &aPage)
+    {
+        if (length_ - position_ < OGG_PAGE_HEADER_MIN) {
+            return 0;
+        }
+
+        const unsigned char *p = data_ + position_;
+        if (memcmp(p, "OggS", 4) != 0 || p[4] != 0) {
+            resync();
+            return -1;
+        }
+
+        size_t headerLength = OGG_PAGE_HEADER_MIN + p[26];
+        if (length_ - position_ < headerLength) {
+            return 0;
+        }
+        size_t bodyLength = 0;
+        for (size_t i = OGG_PAGE_HEADER_MIN; i < headerLength; i++) {
+            bodyLength += p[i];
+        }
+        if (length_ - position_ < headerLength + bodyLength) {
+            // truncated final page
+            return 0;
+        }
+
+        if (verifyChecksums_ && !oggPageCrcValid(p, headerLength, p + headerLength, bodyLength)) {
+            // Not a real page, or a damaged one; look for the next.
+            resync();
+            return -1;
+        }
+
+        aPage.header = p;
+        aPage.headerLength = headerLength;
+        aPage.body = p + headerLength;
+        aPage.bodyLength = bodyLength;
+        aPage.offset = position_;
+
+        position_ += headerLength + bodyLength;
+        return 1;
+    }
+
+}
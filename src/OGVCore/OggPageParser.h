@@ -0,0 +1,144 @@
+//
+// Platform-independent Ogg Vorbis/Theora/Opus decoder/player base
+//
+// Copyright (c) 2013-2015 Brion Vibber <brion@pobox.com>
+// MIT-style license
+// Please reuse and redistribute with the LICENSE notes intact.
+//
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace OGVCore {
+
+	/**
+	 * One packet (or packet fragment) inside a page, pointing into the
+	 * page body; nothing is copied.
+	 */
+	struct OggPacketView {
+		const unsigned char *bytes;
+		size_t length;
+		bool continued; // began on an earlier page
+		bool complete;  // ends on this page
+
+		OggPacketView() :
+			bytes(0),
+			length(0),
+			continued(false),
+			complete(false)
+		{}
+	};
+
+	/**
+	 * A page parsed in place; header and body point into the source
+	 * buffer and stay valid as long as it does.
+	 */
+	struct OggPageView {
+		const unsigned char *header;
+		size_t headerLength;
+		const unsigned char *body;
+		size_t bodyLength;
+		uint64_t offset;
+
+		OggPageView() :
+			header(0),
+			headerLength(0),
+			body(0),
+			bodyLength(0),
+			offset(0)
+		{}
+
+		int version() const { return header[4]; }
+		bool continued() const { return (header[5] & 0x01) != 0; }
+		bool bos() const { return (header[5] & 0x02) != 0; }
+		bool eos() const { return (header[5] & 0x04) != 0; }
+		int64_t granulepos() const { return (int64_t)readLE64(header + 6); }
+		uint32_t serialno() const { return readLE32(header + 14); }
+		uint32_t pageno() const { return readLE32(header + 18); }
+		int segmentCount() const { return header[26]; }
+		const unsigned char *lacing() const { return header + 27; }
+		uint64_t length() const { return headerLength + bodyLength; }
+
+		/**
+		 * Walk the lacing values to the next packet in the body.
+		 *
+		 * @param cursor iteration state, start at 0
+		 * @return false when the page has no more packets
+		 */
+		bool nextPacket(int &cursor, size_t &bodyOffset, OggPacketView &packet) const
+		{
+			int segments = segmentCount();
+			if (cursor == 0) {
+				bodyOffset = 0;
+			}
+			if (cursor >= segments) {
+				return false;
+			}
+			const unsigned char *lacingValues = lacing();
+			packet.continued = (cursor == 0) && continued();
+			packet.bytes = body + bodyOffset;
+			packet.length = 0;
+			packet.complete = false;
+			while (cursor < segments) {
+				int val = lacingValues[cursor++];
+				packet.length += val;
+				if (val < 255) {
+					packet.complete = true;
+					break;
+				}
+			}
+			bodyOffset += packet.length;
+			return true;
+		}
+
+		static uint32_t readLE32(const unsigned char *p)
+		{
+			return (uint32_t)p[0] | ((uint32_t)p[1] << 8) |
+			       ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+		}
+
+		static uint64_t readLE64(const unsigned char *p)
+		{
+			return (uint64_t)readLE32(p) | ((uint64_t)readLE32(p + 4) << 32);
+		}
+	};
+
+	/**
+	 * Native demux front end over a contiguous byte range, typically a
+	 * memory-mapped file. Finds capture patterns and parses pages in
+	 * place, so payload bytes are never copied; ogg_sync_pageout() is
+	 * still used for pushed network input.
+	 */
+	class OggPageParser {
+	public:
+		OggPageParser(const unsigned char *aData, uint64_t aLength);
+
+		/**
+		 * Same contract as ogg_sync_pageout():
+		 * @return 1 with a page, 0 at the end of data, -1 after skipping
+		 *         garbage or a corrupt page
+		 */
+		int nextPage(OggPageView &aPage);
+
+		void seek(uint64_t aOffset);
+		uint64_t position() const { return position_; }
+
+		/**
+		 * Skip the page CRC for input we produced ourselves. Structure
+		 * is still checked, but resync after corruption gets less robust.
+		 */
+		void setVerifyChecksums(bool aVerify) { verifyChecksums_ = aVerify; }
+		uint64_t length() const { return length_; }
+
+	private:
+		const unsigned char *data_;
+		uint64_t length_;
+		uint64_t position_;
+		bool verifyChecksums_;
+
+		bool resync();
+	};
+
+}
@@ -0,0 +1,105 @@
+//
+// Platform-independent Ogg Vorbis/Theora/Opus decoder/player base
+//
+// Copyright (c) 2013-2015 Brion Vibber <brion@pobox.com>
+// MIT-style license
+// Please reuse and redistribute with the LICENSE notes intact.
+//
+
+#include <utility>
+
+#include "OggTrackReader.h"
+
+namespace OGVCore {
+
+    OggTrackReader::OggTrackReader(const unsigned char *aData, uint64_t aLength, uint32_t aSerial, bool aAssemble) :
+        parser_(aData, aLength),
+        serial_(aSerial),
+        assemble_(aAssemble),
+        readyIndex_(0),
+        inPartial_(false)
+    {}
+
+    void OggTrackReader::seek(uint64_t aOffset)
+    {
+        parser_.seek(aOffset);
+        ready_.clear();
+        readyIndex_ = 0;
+        inPartial_ = false;
+    }
+
+    bool OggTrackReader::nextPacket(OggTrackPacket &aPacket)
+    {
+        while (readyIndex_ >= ready_.size()) {
+            if (!readPage()) {
+                return false;
+            }
+        }
+        aPacket = std::move(ready_[readyIndex_++]);
+        if (!aPacket.spill.empty()) {
+            aPacket.bytes = aPacket.spill.data();
+        }
+        return true;
+    }
+
+    /* helper: split the next page of our stream into whole packets */
+    /* false at the end of data */
+    bool OggTrackReader::readPage()
+    {
+        ready_.clear();
+        readyIndex_ = 0;
+
+        OggPageView page;
+        int ret = parser_.nextPage(page);
+        while (ret != 0 && (ret < 0 || page.serialno() != serial_)) {
+            ret = parser_.nextPage(page);
+        }
+        if (ret == 0) {
+            return false;
+        }
+
+        int cursor = 0;
+        size_t bodyOffset = 0;
+        OggPacketView view;
+        while (page.nextPacket(cursor, bodyOffset, view)) {
+            if (view.continued) {
+                if (!inPartial_) {
+                    // Tail of a packet that started before our seek point.
+                    continue;
+                }
+                if (assemble_) {
+                    partial_.spill.insert(partial_.spill.end(), view.bytes, view.bytes + view.length);
+                    partial_.length += view.length;
+                }
+                if (view.complete) {
+                    inPartial_ = false;
+                    ready_.push_back(std::move(partial_));
+                }
+                continue;
+            }
+
+            // A fresh packet; anything still open was lost to a gap.
+            inPartial_ = false;
+            OggTrackPacket packet;
+            packet.bytes = view.bytes;
+            packet.length = view.length;
+            packet.pageOffset = page.offset;
+            if (view.complete) {
+                ready_.push_back(std::move(packet));
+            } else {
+                if (assemble_) {
+                    packet.spill.assign(view.bytes, view.bytes + view.length);
+                }
+                partial_ = std::move(packet);
+                inPartial_ = true;
+            }
+        }
+
+        // The page granulepos belongs to the last packet finishing on it.
+        if (!ready_.empty()) {
+            ready_.back().granulepos = page.granulepos();
+        }
+        return true;
+    }
+
+}
@@ -0,0 +1,78 @@
+//
+// Platform-independent Ogg Vorbis/Theora/Opus decoder/player base
+//
+// Copyright (c) 2013-2015 Brion Vibber <brion@pobox.com>
+// MIT-style license
+// Please reuse and redistribute with the LICENSE notes intact.
+//
+
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "OggPageParser.h"
+
+namespace OGVCore {
+
+	/**
+	 * One whole packet of a logical stream. Packets that fit in a page
+	 * point straight into the source buffer; ones spanning pages are
+	 * stitched together in spill.
+	 */
+	struct OggTrackPacket {
+		const unsigned char *bytes;
+		size_t length;
+		uint64_t pageOffset;  // page the packet starts on
+		int64_t granulepos;   // -1 unless it's the last packet to end on its page
+		std::vector<unsigned char> spill;
+
+		OggTrackPacket() :
+			bytes(0),
+			length(0),
+			pageOffset(0),
+			granulepos(-1)
+		{}
+	};
+
+	/**
+	 * Pulls the packets of a single serial number out of a mapped file,
+	 * independently of any Decoder's demux state, so several can walk
+	 * the same file at once.
+	 */
+	class OggTrackReader {
+	public:
+		/**
+		 * @param aAssemble false to skip stitching packets that span
+		 *        pages; they come back truncated to their first fragment,
+		 *        which is enough to look at packet type bits cheaply.
+		 */
+		OggTrackReader(const unsigned char *aData, uint64_t aLength, uint32_t aSerial, bool aAssemble = true);
+
+		/**
+		 * Restart at a page boundary. A packet continued from before
+		 * aOffset is dropped, not returned as a fragment.
+		 */
+		void seek(uint64_t aOffset);
+		void setVerifyChecksums(bool aVerify) { parser_.setVerifyChecksums(aVerify); }
+
+		/**
+		 * @return false at the end of data
+		 */
+		bool nextPacket(OggTrackPacket &aPacket);
+
+	private:
+		OggPageParser parser_;
+		uint32_t serial_;
+		bool assemble_;
+
+		std::vector<OggTrackPacket> ready_;
+		size_t readyIndex_;
+
+		bool inPartial_;
+		OggTrackPacket partial_;
+
+		bool readPage();
+	};
+
+}
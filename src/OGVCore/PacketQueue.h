@@ -0,0 +1,92 @@
+//
+// Platform-independent Ogg Vorbis/Theora/Opus decoder/player base
+//
+// Copyright (c) 2013-2015 Brion Vibber <brion@pobox.com>
+// MIT-style license
+// Please reuse and redistribute with the LICENSE notes intact.
+//
+
+#pragma once
+
+#include <memory>
+#include <vector>
+
+#include <ogg/ogg.h>
+
+#include "SPSCQueue.h"
+
+namespace OGVCore {
+
+	/**
+	 * A packet copied out of an ogg_stream_state, which reuses its
+	 * buffer on the next packetout.
+	 */
+	struct OwnedPacket {
+		std::vector<unsigned char> bytes;
+		ogg_packet packet;
+
+		void copyFrom(const ogg_packet &aPacket)
+		{
+			bytes.assign(aPacket.packet, aPacket.packet + aPacket.bytes);
+			packet = aPacket;
+			packet.packet = bytes.data();
+		}
+	};
+
+	/**
+	 * Hands packets from the demux thread to one decode thread.
+	 * Spent packets travel back on a second ring so their buffers get
+	 * reused instead of reallocated.
+	 */
+	class PacketQueue {
+	public:
+		explicit PacketQueue(size_t aCapacity) :
+			filled_(aCapacity),
+			spare_(aCapacity + 2)
+		{}
+
+		size_t size() const { return filled_.size(); }
+		bool full() const { return filled_.full(); }
+
+		/**
+		 * Demux side: copy the packet in.
+		 * @return false if the queue is full
+		 */
+		bool push(const ogg_packet &aPacket)
+		{
+			if (filled_.full()) {
+				return false;
+			}
+			std::unique_ptr<OwnedPacket> owned;
+			if (!spare_.pop(owned)) {
+				owned.reset(new OwnedPacket());
+			}
+			owned->copyFrom(aPacket);
+			return filled_.push(std::move(owned));
+		}
+
+		/**
+		 * Decode side.
+		 * @return the next packet, or null if empty
+		 */
+		std::unique_ptr<OwnedPacket> pop()
+		{
+			std::unique_ptr<OwnedPacket> owned;
+			filled_.pop(owned);
+			return owned;
+		}
+
+		/**
+		 * Decode side: give a packet back once it's been decoded.
+		 */
+		void recycle(std::unique_ptr<OwnedPacket> &&aPacket)
+		{
+			spare_.push(std::move(aPacket));
+		}
+
+	private:
+		SPSCQueue<std::unique_ptr<OwnedPacket>> filled_;
+		SPSCQueue<std::unique_ptr<OwnedPacket>> spare_;
+	};
+
+}
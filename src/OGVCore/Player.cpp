@@ -19,7 +19,9 @@
 
 // And our own headers.
 #include <OGVCore.h>
-#include "Bisector.h"
+#include "AudioGovernor.h"
+#include "SeekCache.h"
+#include "Seeker.h"
 
 namespace OGVCore {
 
@@ -50,7 +52,7 @@ namespace OGVCore {
 
         void process()
         {
-            // TODO
+            doProcessing();
         }
 
         double getDuration()
@@ -114,12 +116,23 @@ namespace OGVCore {
             return false; // TODO
         }
 
+        void setAudioWatermarks(double aLowWater, double aHighWater)
+        {
+            audioGovernor.setWatermarks(aLowWater, aHighWater);
+        }
+
+        AudioGovernorStats getAudioGovernorStats()
+        {
+            return audioGovernor.stats(timer->getTimestamp());
+        }
+
     private:
         std::shared_ptr<Player::Delegate> delegate;
         std::shared_ptr<Timer> timer;
         std::shared_ptr<FrameSink> frameSink;
 
         std::shared_ptr<AudioFeeder> audioFeeder;
+        AudioGovernor audioGovernor;
         bool muted = false;
         double initialAudioPosition = 0.0;
         double initialAudioOffset = 0.0;
@@ -134,6 +147,7 @@ namespace OGVCore {
             void onStarved() {
                 // If we're in a background tab, timers may be throttled.
                 // When audio buffers run out, go decode some more stuff.
+                owner->audioGovernor.starved();
                 owner->pingProcessing();
             }
         };
@@ -149,6 +163,8 @@ namespace OGVCore {
 
         void startAudio(double offset)
         {
+            // The drain rate seen before a pause or seek says nothing now.
+            audioGovernor.restart();
             audioFeeder->start();
             initialAudioPosition = audioFeeder->getPlaybackPosition();
             if (offset >= 0) {
@@ -172,8 +188,8 @@ namespace OGVCore {
 
 
         std::shared_ptr<StreamFile> stream;
-        long byteLength;
-        double duration;
+        int64_t byteLength;
+        double duration = NAN;
 
         class StreamDelegate : public StreamFile::Delegate {
         private:
@@ -188,6 +204,8 @@ namespace OGVCore {
             {
                 // Fire off the read/decode/draw loop...
                 owner->byteLength = owner->stream->bytesTotal();
+                owner->readPosition = 0;
+                owner->seekCache.clear();
 
                 // If we get X-Content-Duration, that's as good as an explicit hint
                 auto durationHeader = owner->stream->getResponseHeader("X-Content-Duration");
@@ -200,10 +218,26 @@ namespace OGVCore {
             virtual void onBuffer()
             {}
         
-            virtual void onRead(std::vector<unsigned char> data)
+            virtual void onRead(const unsigned char *aBytes, size_t aLength)
             {
                 // Pass chunk into the codec's buffer
-                owner->codec->receiveInput(data);
+                owner->codec->receiveInput(aBytes, aLength);
+                owner->readPosition += aLength;
+
+                // Continue the read/decode/draw loop...
+                owner->pingProcessing();
+            }
+
+            virtual unsigned char *acquireReadBuffer(size_t aLength)
+            {
+                // Let the backend read straight into the codec's buffer
+                return owner->codec->acquireInputBuffer(aLength);
+            }
+
+            virtual void commitReadBuffer(size_t aLength)
+            {
+                owner->codec->commitInputBuffer(aLength);
+                owner->readPosition += aLength;
 
                 // Continue the read/decode/draw loop...
                 owner->pingProcessing();
@@ -212,6 +246,8 @@ namespace OGVCore {
             virtual void onDone()
             {
                 if (owner->state == STATE_SEEKING) {
+                    // A probe can run off the end before any timestamp turns up.
+                    owner->seekInputEnded = true;
                     owner->pingProcessing();
                 } else if (owner->state == STATE_SEEKING_END) {
                     owner->pingProcessing();
@@ -252,8 +288,12 @@ namespace OGVCore {
 
         void processFrame()
         {
-            //yCbCrBuffer = codec->dequeueFrame(); // @todo
-            frameEndTimestamp = yCbCrBuffer->timestamp;
+            // Owned frames stay valid until the sink is done with them.
+            yCbCrBuffer = codec->dequeueFrame();
+            if (yCbCrBuffer) {
+                frameEndTimestamp = yCbCrBuffer->timestamp;
+                seekCache.addPassed(readPosition, frameEndTimestamp);
+            }
         }
 
         void drawFrame()
@@ -278,30 +318,31 @@ namespace OGVCore {
         double seekTargetTime = 0.0;
         double seekTargetKeypoint = 0.0;
         double bisectTargetTime = 0.0;
-        long lastSeekPosition = 0.0;
+        int64_t lastSeekPosition = 0;
         bool lastFrameSkipped;
-        std::unique_ptr<Bisector> seekBisector;
+        std::unique_ptr<Seeker> seeker;
+        SeekCache seekCache;           // where earlier seeks and playback found times
+        int64_t readPosition = 0;      // byte offset of the next input from the stream
+        bool seekInputEnded = false;   // the stream ran out since the last seek or probe
 
         void startBisection(double targetTime)
         {
             bisectTargetTime = targetTime;
-            seekBisector.reset(new Bisector(
-                /* start */ 0,
-                /* end */ byteLength - 1,
-                /* process */ [this] (int start, int end, int position) {
-                    if (position == lastSeekPosition) {
-                        return false;
-                    } else {
-                        lastSeekPosition = position;
-                        lastFrameSkipped = false;
-                        codec->flush();
-                        stream->seek(position);
-                        stream->readBytes();
-                        return true;
-                    }
-                }
-            ));
-            seekBisector->start();
+            seeker.reset(new Seeker(byteLength, 0.0, std::isnan(duration) ? -1.0 : duration, targetTime));
+            seekCache.narrow(*seeker, targetTime);
+            int64_t position = seeker->start();
+            seekProbe(position >= 0 ? position : seeker->result());
+        }
+
+        void seekProbe(int64_t position)
+        {
+            lastSeekPosition = position;
+            lastFrameSkipped = false;
+            readPosition = position;
+            seekInputEnded = false;
+            codec->flush();
+            stream->seek(position);
+            stream->readBytes();
         }
     
         void seek(double toTime)
@@ -315,19 +356,22 @@ namespace OGVCore {
             seekTargetKeypoint = -1;
             lastFrameSkipped = false;
             lastSeekPosition = -1;
+            seekInputEnded = false;
             codec->flush();
     
             if (codec->hasAudio() && audioFeeder) {
                 stopAudio();
             }
     
-            long offset = codec->getKeypointOffset(toTime);
+            int64_t offset = codec->getKeypointOffset(toTime);
             if (offset > 0) {
                 // This file has an index!
                 //
                 // Start at the keypoint, then decode forward to the desired time.
                 //
                 seekState = SEEKSTATE_LINEAR_TO_TARGET;
+                codec->setAudioSeekTarget(toTime);
+                readPosition = offset;
                 stream->seek(offset);
                 stream->readBytes();
             } else {
@@ -342,19 +386,125 @@ namespace OGVCore {
             }
         }
 
-        void continueSeekedPlayback();
-        void doProcessLinearSeeking();
-        void doProcessBisectionSeek();
+        void continueSeekedPlayback()
+        {
+            seekState = SEEKSTATE_NOT_SEEKING;
+            state = paused ? STATE_PAUSED : STATE_PLAYING;
+            if (codec->hasVideo() && codec->frameReady()) {
+                frameEndTimestamp = codec->frameTimestamp();
+            }
+            if (codec->hasAudio() && audioFeeder) {
+                // The codec trimmed audio to the target, so the clock starts there.
+                if (paused) {
+                    initialAudioOffset = seekTargetTime;
+                } else {
+                    startAudio(seekTargetTime);
+                }
+            }
+            pingProcessing();
+        }
+
+        void doProcessLinearSeeking()
+        {
+            if (codec->hasVideo()) {
+                if (!codec->frameReady()) {
+                    // Need more packets before we can see the next frame's time.
+                    codec->process();
+                } else if (codec->frameTimestamp() < seekTargetTime) {
+                    // Still short of the target; keep the reference frames
+                    // current without paying for YCbCr output.
+                    seekCache.addPassed(readPosition, codec->frameTimestamp());
+                    codec->skipFrame();
+                } else {
+                    continueSeekedPlayback();
+                }
+            } else if (codec->hasAudio()) {
+                // The codec pre-rolls and trims to the target itself.
+                if (!codec->audioReady()) {
+                    codec->process();
+                } else {
+                    continueSeekedPlayback();
+                }
+            }
+        }
+
+        void doProcessBisectionSeek()
+        {
+            // Read on from the probe until a timestamped page turns up.
+            TimestampedPage page;
+            if (!codec->firstTimestampedPage(page)) {
+                if (!codec->process() && seekInputEnded) {
+                    // Every page from the probe on is read, and none had a
+                    // timestamp; it's past the last one in the file.
+                    continueBisection(seeker->report(lastSeekPosition, lastSeekPosition, -1.0));
+                }
+                return;
+            }
+            if (codec->hasVideo() && page.time <= bisectTargetTime) {
+                // The latest keyframe at or before the target so far.
+                seekTargetKeypoint = page.keyframeTime;
+            }
+
+            seekCache.addProbe(lastSeekPosition, page.time);
+
+            // Page offsets count from where input resumed, at the probe.
+            continueBisection(seeker->report(lastSeekPosition + page.offset, lastSeekPosition + page.end, page.time));
+        }
+
+        void continueBisection(int64_t next)
+        {
+            if (next >= 0) {
+                seekProbe(next);
+            } else if (seekState == SEEKSTATE_BISECT_TO_TARGET && codec->hasVideo() &&
+                       seekTargetKeypoint >= 0 && seekTargetKeypoint < seeker->resultTime()) {
+                // Frames from here depend on an earlier keyframe; go find that.
+                seekState = SEEKSTATE_BISECT_TO_KEYPOINT;
+                startBisection(seekTargetKeypoint);
+            } else {
+                seekState = SEEKSTATE_LINEAR_TO_TARGET;
+                seekProbe(seeker->result());
+                codec->setAudioSeekTarget(seekTargetTime);
+            }
+        }
+
+        /**
+         * Top the audio output up in one batch if it's run low, and
+         * return how long until it needs looking at again.
+         */
+        double doProcessAudio()
+        {
+            double now = timer->getTimestamp();
+            double batch = audioGovernor.wake(now, audioFeeder->getBufferedTime());
+            if (batch > 0) {
+                std::shared_ptr<AudioBuffer> audio = codec->decodeAudioDuration(batch);
+                if (audio) {
+                    audioFeeder->bufferData(audio);
+                }
+            }
+            return audioGovernor.refilled(timer->getTimestamp(), audioFeeder->getBufferedTime());
+        }
 
         // Main stuff!
         void doProcessing()
         {
-            // TODO
+            if (state == STATE_SEEKING) {
+                if (seekState == SEEKSTATE_LINEAR_TO_TARGET) {
+                    doProcessLinearSeeking();
+                } else if (seekState != SEEKSTATE_NOT_SEEKING) {
+                    doProcessBisectionSeek();
+                }
+                return;
+            }
+            if (state == STATE_PLAYING && codec && audioFeeder && codec->hasAudio()) {
+                pingProcessing(doProcessAudio());
+            }
+            // TODO: video
         }
     
         void pingProcessing(double delay = -1.0)
         {
-            // TODO
+            // No delay means as soon as possible.
+            timer->setTimeout(delay < 0 ? 0 : delay);
         }
     
         std::shared_ptr<FrameLayout> videoInfo;
@@ -440,4 +590,14 @@ namespace OGVCore {
         return pimpl->getSeeking();
     }
 
+    void Player::setAudioWatermarks(double aLowWater, double aHighWater)
+    {
+        pimpl->setAudioWatermarks(aLowWater, aHighWater);
+    }
+
+    AudioGovernorStats Player::getAudioGovernorStats()
+    {
+        return pimpl->getAudioGovernorStats();
+    }
+
 }
@@ -0,0 +1,252 @@
+//
+// Platform-independent Ogg Vorbis/Theora/Opus decoder/player base
+//
+// Copyright (c) 2013-2015 Brion Vibber <brion@pobox.com>
+// MIT-style license
+// Please reuse and redistribute with the LICENSE notes intact.
+//
+
+// good ol' C library
+#include <math.h>
+#include <string.h>
+
+#include "Resampler.h"
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+namespace OGVCore {
+
+    namespace {
+
+        // Past this many phases, the nearest one is close enough.
+        const int MAX_PHASES = 1024;
+        const int MAX_TAPS = 256;
+
+        struct QualityPreset {
+            int taps;
+            double passband; // fraction of the lower Nyquist kept flat
+            double beta;     // Kaiser window shape; higher trades width for stopband
+        };
+
+        const QualityPreset presets[] = {
+            {16, 0.85, 6.0},  // RESAMPLE_FAST
+            {32, 0.91, 8.0},  // RESAMPLE_MEDIUM
+            {64, 0.95, 10.0}, // RESAMPLE_BEST
+        };
+
+        int gcd(int a, int b)
+        {
+            while (b) {
+                int t = a % b;
+                a = b;
+                b = t;
+            }
+            return a;
+        }
+
+        /* zeroth order modified Bessel function, for the Kaiser window */
+        double besselI0(double x)
+        {
+            double sum = 1.0, term = 1.0;
+            for (int k = 1; k < 50; k++) {
+                term *= (x / (2.0 * k)) * (x / (2.0 * k));
+                sum += term;
+                if (term < sum * 1e-12) {
+                    break;
+                }
+            }
+            return sum;
+        }
+
+        /* taps is always a multiple of 8 */
+        inline float dot(const float *a, const float *b, int taps)
+        {
+            int i = 0;
+#if defined(__SSE2__)
+            __m128 s0 = _mm_setzero_ps();
+            __m128 s1 = _mm_setzero_ps();
+            for (; i < taps; i += 8) {
+                s0 = _mm_add_ps(s0, _mm_mul_ps(_mm_loadu_ps(a + i), _mm_loadu_ps(b + i)));
+                s1 = _mm_add_ps(s1, _mm_mul_ps(_mm_loadu_ps(a + i + 4), _mm_loadu_ps(b + i + 4)));
+            }
+            s0 = _mm_add_ps(s0, s1);
+            s0 = _mm_add_ps(s0, _mm_movehl_ps(s0, s0));
+            s0 = _mm_add_ss(s0, _mm_shuffle_ps(s0, s0, 1));
+            return _mm_cvtss_f32(s0);
+#elif defined(__ARM_NEON)
+            float32x4_t s0 = vdupq_n_f32(0.0f);
+            float32x4_t s1 = vdupq_n_f32(0.0f);
+            for (; i < taps; i += 8) {
+                s0 = vmlaq_f32(s0, vld1q_f32(a + i), vld1q_f32(b + i));
+                s1 = vmlaq_f32(s1, vld1q_f32(a + i + 4), vld1q_f32(b + i + 4));
+            }
+            s0 = vaddq_f32(s0, s1);
+            float32x2_t s = vadd_f32(vget_low_f32(s0), vget_high_f32(s0));
+            return vget_lane_f32(vpadd_f32(s, s), 0);
+#else
+            float sum = 0;
+            for (; i < taps; i++) {
+                sum += a[i] * b[i];
+            }
+            return sum;
+#endif
+        }
+
+    }
+
+    Resampler::Resampler(int aChannels, int aInRate, int aOutRate, ResampleQuality aQuality, int aMaxInputFrames) :
+        channels_(aChannels),
+        inRate_(aInRate),
+        outRate_(aOutRate),
+        up_(aOutRate / gcd(aInRate, aOutRate)),
+        down_(aInRate / gcd(aInRate, aOutRate)),
+        taps_(0),
+        phases_(up_ < MAX_PHASES ? up_ : MAX_PHASES),
+        table_(),
+        history_(),
+        capacity_(0),
+        held_(0),
+        position_(0),
+        fraction_(0),
+        framesIn_(0),
+        framesOut_(0)
+    {
+        buildTable(aQuality);
+        reserve(taps_ + aMaxInputFrames);
+        reset();
+    }
+
+    void Resampler::buildTable(ResampleQuality aQuality)
+    {
+        const QualityPreset &preset = presets[aQuality];
+
+        // When shrinking, the cutoff drops below the input's Nyquist; widen
+        // the filter to match so the transition band stays as sharp.
+        double ratio = (double)outRate_ / inRate_;
+        double scale = ratio < 1.0 ? ratio : 1.0;
+        double cutoff = preset.passband * scale;
+        int taps = (int)ceil(preset.taps / scale / 8.0) * 8;
+        taps_ = taps < MAX_TAPS ? taps : MAX_TAPS;
+
+        // When phases are shared, rounding can land on offset 1.0; an
+        // extra row for it saves stepping a window that may not be held yet.
+        int rows = (phases_ < up_) ? phases_ + 1 : phases_;
+        table_.resize((size_t)rows * taps_);
+        double half = taps_ / 2;
+        double norm = besselI0(preset.beta);
+        for (int p = 0; p < rows; p++) {
+            // Tap j sits at input frame floor(t) - taps/2 + 1 + j.
+            double offset = (double)p / phases_;
+            float *row = &table_[(size_t)p * taps_];
+            double sum = 0;
+            for (int j = 0; j < taps_; j++) {
+                double x = j - (half - 1) - offset;
+                double sinc = (x == 0) ? 1.0 : sin(M_PI * cutoff * x) / (M_PI * cutoff * x);
+                double edge = x / half;
+                double window = (edge * edge < 1.0) ? besselI0(preset.beta * sqrt(1.0 - edge * edge)) / norm : 0.0;
+                row[j] = (float)(sinc * window);
+                sum += row[j];
+            }
+            // Unity gain at DC for every phase, so there's no ripple on steady signals.
+            for (int j = 0; j < taps_; j++) {
+                row[j] = (float)(row[j] / sum);
+            }
+        }
+    }
+
+    void Resampler::reserve(int aFrames)
+    {
+        if (aFrames <= capacity_) {
+            return;
+        }
+        std::vector<float> bigger((size_t)aFrames * channels_);
+        for (int c = 0; c < channels_; c++) {
+            memcpy(&bigger[(size_t)c * aFrames], &history_[(size_t)c * capacity_], sizeof(float) * held_);
+        }
+        history_.swap(bigger);
+        capacity_ = aFrames;
+    }
+
+    void Resampler::reset()
+    {
+        // Start with half a window of silence, so output 0 is centred on input 0.
+        held_ = taps_ / 2 - 1;
+        for (int c = 0; c < channels_; c++) {
+            memset(&history_[(size_t)c * capacity_], 0, sizeof(float) * held_);
+        }
+        position_ = 0;
+        fraction_ = 0;
+        framesIn_ = 0;
+        framesOut_ = 0;
+    }
+
+    int Resampler::outputFrames(int aFrames) const
+    {
+        // Output k's window starts at position_ + (fraction_ + k * down_) / up_
+        // and must end inside what's held.
+        int64_t room = (int64_t)held_ + aFrames - taps_ - position_;
+        if (room < 0) {
+            return 0;
+        }
+        return (int)(((room + 1) * up_ - fraction_ + down_ - 1) / down_);
+    }
+
+    int Resampler::maxOutputFrames(int aFrames) const
+    {
+        // Less than a window is ever left over, so that's the most extra history can add.
+        return (int)(((int64_t)aFrames * up_ + down_ - 1) / down_) + 1;
+    }
+
+    int Resampler::process(const float *const *aInput, int aFrames, float *const *aOutput)
+    {
+        int count = outputFrames(aFrames);
+        reserve(held_ + aFrames);
+        for (int c = 0; c < channels_; c++) {
+            memcpy(&history_[(size_t)c * capacity_ + held_], aInput[c], sizeof(float) * aFrames);
+        }
+        held_ += aFrames;
+
+        int step = down_ / up_;
+        int stepFraction = down_ % up_;
+        for (int c = 0; c < channels_; c++) {
+            const float *input = &history_[(size_t)c * capacity_];
+            float *output = aOutput[c];
+            int position = position_;
+            int fraction = fraction_;
+            for (int k = 0; k < count; k++) {
+                // Nearest shared phase, not the one below, to halve the timing error.
+                int phase = (phases_ == up_) ? fraction : (int)(((int64_t)fraction * phases_ + up_ / 2) / up_);
+                output[k] = dot(input + position, &table_[(size_t)phase * taps_], taps_);
+                position += step;
+                fraction += stepFraction;
+                if (fraction >= up_) {
+                    fraction -= up_;
+                    position++;
+                }
+            }
+        }
+
+        int64_t advance = fraction_ + (int64_t)count * down_;
+        position_ += (int)(advance / up_);
+        fraction_ = (int)(advance % up_);
+
+        // Slide what the next windows still need back to the front. A big
+        // downsampling step can land past the end; the rest waits on input.
+        int consumed = position_ < held_ ? position_ : held_;
+        held_ -= consumed;
+        for (int c = 0; c < channels_; c++) {
+            float *input = &history_[(size_t)c * capacity_];
+            memmove(input, input + consumed, sizeof(float) * held_);
+        }
+        position_ -= consumed;
+
+        framesIn_ += aFrames;
+        framesOut_ += count;
+        return count;
+    }
+
+}
@@ -0,0 +1,87 @@
+//
+// Platform-independent Ogg Vorbis/Theora/Opus decoder/player base
+//
+// Copyright (c) 2013-2015 Brion Vibber <brion@pobox.com>
+// MIT-style license
+// Please reuse and redistribute with the LICENSE notes intact.
+//
+
+#pragma once
+
+#include <stdint.h>
+#include <vector>
+
+#include <OGVCore.h>
+
+namespace OGVCore {
+
+	/**
+	 * Streaming polyphase windowed-sinc sample rate converter for planar
+	 * float audio. The rate ratio is kept as an exact fraction, so long
+	 * streams never drift. Filter tables are built once up front; input
+	 * history carries across calls, so packets can be fed one at a time.
+	 * Output frame k lines up with input time k * inRate / outRate: the
+	 * filter's lookahead holds output back but doesn't delay it.
+	 */
+	class Resampler {
+	public:
+		/**
+		 * @param aMaxInputFrames largest block expected per process() call;
+		 *        bigger ones still work, at the cost of one reallocation
+		 */
+		Resampler(int aChannels, int aInRate, int aOutRate, ResampleQuality aQuality, int aMaxInputFrames);
+
+		/**
+		 * @return exactly how many frames process() will write for aFrames
+		 *         more input, given the history held now
+		 */
+		int outputFrames(int aFrames) const;
+		/**
+		 * @return the most frames aFrames of input could ever produce
+		 */
+		int maxOutputFrames(int aFrames) const;
+
+		/**
+		 * @param aOutput one plane per channel, with room for outputFrames(aFrames)
+		 * @return frames written
+		 */
+		int process(const float *const *aInput, int aFrames, float *const *aOutput);
+
+		/**
+		 * Forget history and counters, eg after a seek.
+		 */
+		void reset();
+
+		int inRate() const { return inRate_; }
+		int outRate() const { return outRate_; }
+		int taps() const { return taps_; }
+		int phases() const { return phases_; }
+
+		// Totals since the last reset, for lining up timestamps.
+		int64_t framesIn() const { return framesIn_; }
+		int64_t framesOut() const { return framesOut_; }
+
+	private:
+		int channels_;
+		int inRate_;
+		int outRate_;
+		int up_;       // output step, in 1/up_ of an input frame...
+		int down_;     // ...and input advance per output frame, in the same units
+		int taps_;
+		int phases_;
+		std::vector<float> table_;   // phases_ rows of taps_ coefficients, +1 if phases are shared
+
+		std::vector<float> history_; // per channel: held input, then room for more
+		int capacity_;               // frames per channel in history_
+		int held_;                   // frames of input held
+		int position_;               // first held frame under the next output's window
+		int fraction_;               // next output's offset past position_, out of up_
+
+		int64_t framesIn_;
+		int64_t framesOut_;
+
+		void buildTable(ResampleQuality aQuality);
+		void reserve(int aFrames);
+	};
+
+}
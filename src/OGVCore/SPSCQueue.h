@@ -0,0 +1,110 @@
+//
+// Platform-independent Ogg Vorbis/Theora/Opus decoder/player base
+//
+// Copyright (c) 2013-2015 Brion Vibber <brion@pobox.com>
+// MIT-style license
+// Please reuse and redistribute with the LICENSE notes intact.
+//
+
+#pragma once
+
+#include <stddef.h>
+#include <atomic>
+#include <utility>
+#include <vector>
+
+namespace OGVCore {
+
+	/**
+	 * Spacing that keeps two hot atomics off each other's cache line.
+	 * Padding by a full line rather than alignas(64) keeps that true
+	 * for objects from plain new, which before C++17 only guarantees
+	 * fundamental alignment.
+	 */
+	static const size_t CACHE_LINE_SIZE = 64;
+
+	/**
+	 * Bounded lock-free ring for exactly one producer thread and one
+	 * consumer thread. Neither side ever blocks or allocates; push()
+	 * and pop() just report full or empty.
+	 */
+	template <typename T>
+	class SPSCQueue {
+	public:
+		explicit SPSCQueue(size_t aCapacity) :
+			slots_(aCapacity + 1),
+			head_(0),
+			tail_(0)
+		{}
+
+		size_t capacity() const
+		{
+			return slots_.size() - 1;
+		}
+
+		/**
+		 * Approximate when called from a third thread.
+		 */
+		size_t size() const
+		{
+			size_t head = head_.load(std::memory_order_acquire);
+			size_t tail = tail_.load(std::memory_order_acquire);
+			return (tail + slots_.size() - head) % slots_.size();
+		}
+
+		bool full() const
+		{
+			return size() == capacity();
+		}
+
+		/**
+		 * Producer side.
+		 * @return false if the queue is full; aItem is left untouched
+		 */
+		bool push(T &&aItem)
+		{
+			size_t tail = tail_.load(std::memory_order_relaxed);
+			size_t next = advance(tail);
+			if (next == head_.load(std::memory_order_acquire)) {
+				return false;
+			}
+			slots_[tail] = std::move(aItem);
+			tail_.store(next, std::memory_order_release);
+			return true;
+		}
+
+		/**
+		 * Consumer side.
+		 * @return false if the queue is empty
+		 */
+		bool pop(T &aItem)
+		{
+			size_t head = head_.load(std::memory_order_relaxed);
+			if (head == tail_.load(std::memory_order_acquire)) {
+				return false;
+			}
+			aItem = std::move(slots_[head]);
+			// Don't hold on to references (eg pooled frames) in dead slots.
+			slots_[head] = T();
+			head_.store(advance(head), std::memory_order_release);
+			return true;
+		}
+
+	private:
+		std::vector<T> slots_;
+		char headPad_[CACHE_LINE_SIZE];
+		std::atomic<size_t> head_;
+		char tailPad_[CACHE_LINE_SIZE - sizeof(std::atomic<size_t>)];
+		std::atomic<size_t> tail_;
+		char endPad_[CACHE_LINE_SIZE - sizeof(std::atomic<size_t>)];
+
+		size_t advance(size_t aIndex) const
+		{
+			return (aIndex + 1 == slots_.size()) ? 0 : aIndex + 1;
+		}
+
+		SPSCQueue(const SPSCQueue &);
+		SPSCQueue &operator=(const SPSCQueue &);
+	};
+
+}
@@ -0,0 +1,105 @@
+//
+// Platform-independent Ogg Vorbis/Theora/Opus decoder/player base
+//
+// Copyright (c) 2013-2015 Brion Vibber <brion@pobox.com>
+// MIT-style license
+// Please reuse and redistribute with the LICENSE notes intact.
+//
+
+#include <algorithm>
+
+#include "SeekCache.h"
+#include "Seeker.h"
+
+namespace OGVCore {
+
+    SeekCache::SeekCache(size_t aCapacity) :
+        capacity_(std::max<size_t>(aCapacity, 2))
+    {
+        entries_.reserve(capacity_ + 1);
+    }
+
+    void SeekCache::addProbe(int64_t aOffset, double aTime)
+    {
+        add(aOffset, aTime, true);
+    }
+
+    void SeekCache::addPassed(int64_t aOffset, double aTime)
+    {
+        add(aOffset, aTime, false);
+    }
+
+    void SeekCache::narrow(Seeker &aSeeker, double aTarget) const
+    {
+        // Times rise with offsets, so the entries split around the target.
+        auto split = std::partition_point(entries_.begin(), entries_.end(),
+            [aTarget] (const Entry &entry) {
+                return entry.time <= aTarget;
+            });
+
+        // Only a probe says where decoding can start from.
+        auto lo = split;
+        while (lo != entries_.begin()) {
+            --lo;
+            if (lo->exact) {
+                break;
+            }
+        }
+        bool haveLo = (lo != split && lo->exact);
+        bool haveHi = (split != entries_.end());
+        if (haveLo && haveHi && lo->offset >= split->offset) {
+            // The entries disagree; trust neither.
+            return;
+        }
+        if (haveLo || haveHi) {
+            aSeeker.narrow(haveLo ? lo->offset : -1, haveLo ? lo->time : -1,
+                           haveHi ? split->offset : -1, haveHi ? split->time : -1);
+        }
+    }
+
+    void SeekCache::clear()
+    {
+        entries_.clear();
+    }
+
+    /* helper: insert or update an entry, keeping offsets sorted */
+    void SeekCache::add(int64_t aOffset, double aTime, bool aExact)
+    {
+        if (aOffset < 0 || aTime < 0) {
+            return;
+        }
+        auto pos = std::lower_bound(entries_.begin(), entries_.end(), aOffset,
+            [] (const Entry &entry, int64_t offset) {
+                return entry.offset < offset;
+            });
+        if (pos != entries_.end() && pos->offset == aOffset) {
+            // A probe's time is exact; a passed one is only a lower bound.
+            if (aExact || !pos->exact) {
+                pos->time = aTime;
+                pos->exact = aExact;
+            }
+            return;
+        }
+        entries_.insert(pos, Entry { aOffset, aTime, aExact });
+        if (entries_.size() > capacity_) {
+            evict();
+        }
+    }
+
+    /* helper: drop the entry that leaves the smallest gap behind */
+    void SeekCache::evict()
+    {
+        // The ends bound the widest windows, so they stay.
+        size_t victim = 1;
+        int64_t smallest = -1;
+        for (size_t i = 1; i + 1 < entries_.size(); i++) {
+            int64_t gap = entries_[i + 1].offset - entries_[i - 1].offset;
+            if (smallest < 0 || gap < smallest) {
+                smallest = gap;
+                victim = i;
+            }
+        }
+        entries_.erase(entries_.begin() + victim);
+    }
+
+}
@@ -0,0 +1,70 @@
+//
+// Platform-independent Ogg Vorbis/Theora/Opus decoder/player base
+//
+// Copyright (c) 2013-2015 Brion Vibber <brion@pobox.com>
+// MIT-style license
+// Please reuse and redistribute with the LICENSE notes intact.
+//
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <vector>
+
+namespace OGVCore {
+
+	class Seeker;
+
+	/**
+	 * Remembers where times were found in a file across seeks, so a
+	 * new seek can start from the tightest window already known
+	 * instead of the whole file. Scrubbing back and forth over the
+	 * same stretch then costs fewer and fewer probes.
+	 *
+	 * Holds at most a fixed number of entries. When full, the entry
+	 * whose neighbours are closest together goes first, since it
+	 * narrows the fewest windows.
+	 */
+	class SeekCache {
+	public:
+		explicit SeekCache(size_t aCapacity = 1024);
+
+		/**
+		 * Decoding from aOffset, the first timestamp seen was aTime;
+		 * eg a Seeker probe.
+		 */
+		void addProbe(int64_t aOffset, double aTime);
+		/**
+		 * Everything from aOffset on comes at or after aTime; eg the
+		 * read position while decoding linearly, with the last
+		 * timestamp decoded. Only good for the upper end of a window.
+		 */
+		void addPassed(int64_t aOffset, double aTime);
+
+		/**
+		 * Narrow aSeeker's window to the tightest one known around its
+		 * target. Call before aSeeker.start().
+		 */
+		void narrow(Seeker &aSeeker, double aTarget) const;
+
+		void clear();
+		size_t size() const { return entries_.size(); }
+		size_t capacity() const { return capacity_; }
+
+	private:
+		struct Entry {
+			int64_t offset;
+			double time;
+			bool exact;     // a probe, not a passed position
+		};
+
+		size_t capacity_;
+		std::vector<Entry> entries_;  // sorted by offset
+
+		void add(int64_t aOffset, double aTime, bool aExact);
+		void evict();
+	};
+
+}
@@ -0,0 +1,115 @@
+//
+// Platform-independent Ogg Vorbis/Theora/Opus decoder/player base
+//
+// Copyright (c) 2013-2015 Brion Vibber <brion@pobox.com>
+// MIT-style license
+// Please reuse and redistribute with the LICENSE notes intact.
+//
+
+#include <algorithm>
+
+// good ol' C library
+#include <stdlib.h>
+
+#include "Seeker.h"
+
+namespace OGVCore {
+
+    namespace {
+
+        // A page's header alone; the window can't usefully get narrower.
+        const int64_t MIN_PAGE_SIZE = 282;
+
+        // Landing on the same side more often than this means the
+        // bitrate is lopsided here; bisect to break the run.
+        const int MAX_STREAK = 4;
+
+    }
+
+    Seeker::Seeker(int64_t aLength, double aStartTime, double aEndTime, double aTarget) :
+        target_(aTarget),
+        lo_(0),
+        loTime_(aStartTime),
+        hi_(aLength),
+        hiTime_(aEndTime),
+        probe_(-1),
+        pageSize_(MIN_PAGE_SIZE),
+        streak_(0),
+        probes_(0),
+        done_(false)
+    {}
+
+    void Seeker::narrow(int64_t aLo, double aLoTime, int64_t aHi, double aHiTime)
+    {
+        if (aLo > lo_ && aLo < hi_) {
+            lo_ = aLo;
+            loTime_ = aLoTime;
+        }
+        if (aHi >= 0 && aHi > lo_ && aHi < hi_) {
+            hi_ = aHi;
+            hiTime_ = aHiTime;
+        }
+    }
+
+    int64_t Seeker::start()
+    {
+        if (target_ <= loTime_) {
+            // Nothing before the start; decode from the top.
+            hi_ = lo_;
+        }
+        return next();
+    }
+
+    int64_t Seeker::report(int64_t aPageOffset, int64_t aPageEnd, double aTime)
+    {
+        if (done_) {
+            return -1;
+        }
+        pageSize_ = std::max(pageSize_, aPageEnd - aPageOffset);
+
+        if (aTime >= 0 && aTime <= target_) {
+            // Anything after this page comes later, but not past the target.
+            lo_ = std::max(lo_, std::max(aPageEnd, probe_));
+            loTime_ = aTime;
+            streak_ = (streak_ > 0) ? streak_ + 1 : 1;
+        } else {
+            // Nothing between the probe and this page was timestamped,
+            // so the last page before the target is before the probe.
+            hi_ = std::min(hi_, probe_);
+            if (aTime >= 0) {
+                hiTime_ = aTime;
+            }
+            streak_ = (streak_ < 0) ? streak_ - 1 : -1;
+        }
+        return next();
+    }
+
+    int64_t Seeker::next()
+    {
+        if (hi_ - lo_ <= pageSize_) {
+            done_ = true;
+            return -1;
+        }
+
+        int64_t offset;
+        if (hiTime_ > loTime_ && std::abs(streak_) <= MAX_STREAK) {
+            double fraction = (target_ - loTime_) / (hiTime_ - loTime_);
+            fraction = std::min(std::max(fraction, 0.0), 1.0);
+            offset = lo_ + (int64_t)(fraction * (double)(hi_ - lo_));
+            // Aim a little to the side we haven't been landing on, twice
+            // as far each time, so the far end of the window gets pulled
+            // in too rather than creeping up on the target a page a time.
+            int64_t margin = (pageSize_ / 2) << std::abs(streak_);
+            offset += (streak_ > 0) ? margin : -margin;
+        } else {
+            offset = lo_ + (hi_ - lo_) / 2;
+            streak_ = 0;
+        }
+
+        // Leave room for a page to start between the probe and hi_.
+        probe_ = std::min(std::max(offset, lo_), hi_ - pageSize_);
+        probes_++;
+        return probe_;
+    }
+
+}
@@ -0,0 +1,92 @@
+//
+// Platform-independent Ogg Vorbis/Theora/Opus decoder/player base
+//
+// Copyright (c) 2013-2015 Brion Vibber <brion@pobox.com>
+// MIT-style license
+// Please reuse and redistribute with the LICENSE notes intact.
+//
+
+#pragma once
+
+#include <stdint.h>
+
+namespace OGVCore {
+
+	/**
+	 * Finds the byte offset to start decoding from to reach a target
+	 * time in a file with no index, in as few probes as it can.
+	 *
+	 * Keeps a window of offsets known to come before and after the
+	 * target, along with the timestamps seen there, and guesses where
+	 * in it the target falls by linear interpolation (regula falsi).
+	 * If that keeps landing on the same side, as it will where the
+	 * bitrate swings, it bisects instead for a step. It's done once the
+	 * window is no wider than the biggest page seen, since then no probe
+	 * could turn up a new page start in it.
+	 *
+	 * Give it the timestamps as you find them: seek the stream to each
+	 * offset it hands out, read forward to the first timestamped page,
+	 * and report() that. Then start decoding from result().
+	 */
+	class Seeker {
+	public:
+		/**
+		 * @param aLength file size in bytes
+		 * @param aStartTime timestamp at the start of the data
+		 * @param aEndTime timestamp at the end, or negative if unknown;
+		 *        then the first probe bisects
+		 * @param aTarget timestamp to find
+		 */
+		Seeker(int64_t aLength, double aStartTime, double aEndTime, double aTarget);
+
+		/**
+		 * Start from a tighter window already known, eg from earlier
+		 * seeks. Decoding from aLo first finds aLoTime, at or before
+		 * the target, and from aHi aHiTime, after it; pass a negative
+		 * offset to leave that end be. Call before start().
+		 */
+		void narrow(int64_t aLo, double aLoTime, int64_t aHi, double aHiTime);
+
+		/**
+		 * @return the first offset to probe, or -1 if the answer is
+		 *         already known
+		 */
+		int64_t start();
+		/**
+		 * The last probe's first timestamped page started at aPageOffset
+		 * and ended at aPageEnd, with timestamp aTime; a negative aTime
+		 * means the probe ran off the end of the file. Pass the probe
+		 * offset for both if the page boundaries aren't known.
+		 *
+		 * @return the next offset to probe, or -1 when done
+		 */
+		int64_t report(int64_t aPageOffset, int64_t aPageEnd, double aTime);
+
+		bool done() const { return done_; }
+		/**
+		 * @return where to decode from: the end of the last page found
+		 *         timestamped at or before the target
+		 */
+		int64_t result() const { return lo_; }
+		/**
+		 * @return the timestamp at result()
+		 */
+		double resultTime() const { return loTime_; }
+		int probes() const { return probes_; }
+
+	private:
+		double target_;
+		int64_t lo_;        // decoding from here starts at or before the target...
+		double loTime_;
+		int64_t hi_;        // ...and from here, after it
+		double hiTime_;     // negative if not known yet
+		int64_t probe_;     // offset handed out last
+		int64_t pageSize_;  // biggest page seen, the window's finishing width
+		int streak_;        // consecutive probes landing on the same side; + before, - after
+		int probes_;
+		bool done_;
+
+		int64_t next();
+	};
+
+}
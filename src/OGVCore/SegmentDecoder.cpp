@@ -0,0 +1,190 @@
+//
+// Platform-independent Ogg Vorbis/Theora/Opus decoder/player base
+//
+// Copyright (c) 2013-2015 Brion Vibber <brion@pobox.com>
+// MIT-style license
+// Please reuse and redistribute with the LICENSE notes intact.
+//
+
+// C++ awesome
+#include <algorithm>
+#include <memory>
+#include <thread>
+#include <utility>
+
+// good ol' C library
+#include <stdio.h>
+
+#include "FramePool.h"
+#include "OggTrackReader.h"
+#include "SegmentDecoder.h"
+
+namespace OGVCore {
+
+    // About 80 1080p frames queued across all the workers.
+    static const size_t DEFAULT_MEMORY_LIMIT = 256 * 1024 * 1024;
+
+    static bool isKeyframePacket(const OggTrackPacket &aPacket)
+    {
+        // Data packets have the top bit clear; keyframes the next one too.
+        return aPacket.length > 0 && (aPacket.bytes[0] & 0xc0) == 0;
+    }
+
+    SegmentDecoder::SegmentDecoder(const unsigned char *aData, uint64_t aLength, uint32_t aSerial,
+                                   const th_info &aInfo, const th_setup_info *aSetup,
+                                   const FrameLayout &aLayout) :
+        data_(aData),
+        length_(aLength),
+        serial_(aSerial),
+        info_(aInfo),
+        setup_(aSetup),
+        layout_(aLayout),
+        verifyChecksums_(true),
+        memoryLimit_(DEFAULT_MEMORY_LIMIT)
+    {}
+
+    void SegmentDecoder::addBoundary(uint64_t aOffset)
+    {
+        if (boundaries_.empty() || aOffset > boundaries_.back()) {
+            boundaries_.push_back(aOffset);
+        }
+    }
+
+    void SegmentDecoder::scanKeyframes()
+    {
+        // Only the first byte of each packet matters, so don't stitch.
+        OggTrackReader reader(data_, length_, serial_, false);
+        reader.setVerifyChecksums(verifyChecksums_);
+        OggTrackPacket packet;
+        while (reader.nextPacket(packet)) {
+            if (isKeyframePacket(packet)) {
+                addBoundary(packet.pageOffset);
+            }
+        }
+    }
+
+    /* helper: decode one segment, emitting owned frames with their timestamps */
+    void SegmentDecoder::decodeSegment(size_t aIndex, th_dec_ctx *aContext, FramePool &aPool, const SegmentPipeline::Emit &aEmit)
+    {
+        uint64_t start = boundaries_[aIndex];
+        uint64_t end = (aIndex + 1 < boundaries_.size()) ? boundaries_[aIndex + 1] : length_;
+
+        OggTrackReader reader(data_, length_, serial_);
+        reader.setVerifyChecksums(verifyChecksums_);
+        reader.seek(start);
+
+        std::vector<OggTrackPacket> packets;
+        OggTrackPacket packet;
+        bool more = false;
+        while ((more = reader.nextPacket(packet))) {
+            bool keyframe = isKeyframePacket(packet);
+            if (packets.empty() && !keyframe) {
+                continue;
+            }
+            if (keyframe && !packets.empty() && packet.pageOffset >= end) {
+                break;
+            }
+            packets.push_back(std::move(packet));
+        }
+        if (packets.empty()) {
+            return;
+        }
+
+        // Only page-final packets carry a granulepos; count back from the
+        // first one we see, reading into the next segment if we must.
+        ogg_int64_t firstFrame = -1;
+        for (size_t i = 0; i < packets.size(); i++) {
+            if (packets[i].granulepos >= 0) {
+                firstFrame = th_granule_frame(aContext, packets[i].granulepos) - (ogg_int64_t)i;
+                break;
+            }
+        }
+        for (size_t i = packets.size(); firstFrame < 0 && more; i++) {
+            if (packet.granulepos >= 0) {
+                firstFrame = th_granule_frame(aContext, packet.granulepos) - (ogg_int64_t)i;
+            } else {
+                more = reader.nextPacket(packet);
+            }
+        }
+        if (firstFrame < 0) {
+            printf("No granulepos found for segment at %llu\n", (unsigned long long)start);
+            firstFrame = 0;
+        }
+
+        // Pre-3.2.1 streams count frames from 0 rather than 1 in the granule.
+        int shift = info_.keyframe_granule_shift;
+        ogg_int64_t granuleBias = 1 - th_granule_frame(aContext, (ogg_int64_t)1 << shift);
+
+        ogg_int64_t keyframeFrame = firstFrame;
+        for (size_t i = 0; i < packets.size(); i++) {
+            ogg_int64_t frame = firstFrame + (ogg_int64_t)i;
+            if (isKeyframePacket(packets[i])) {
+                keyframeFrame = frame;
+            }
+            ogg_int64_t keyframeGranulepos = (keyframeFrame + granuleBias) << shift;
+            ogg_int64_t granulepos = keyframeGranulepos + (frame - keyframeFrame);
+
+            ogg_packet op {};
+            op.packet = const_cast<unsigned char *>(packets[i].bytes);
+            op.bytes = (long)packets[i].length;
+            op.granulepos = granulepos;
+            op.packetno = (ogg_int64_t)i;
+            int ret = th_decode_packetin(aContext, &op, NULL);
+            if (ret != 0 && ret != TH_DUPFRAME) {
+                printf("Theora decoder failed mysteriously? %d\n", ret);
+                continue;
+            }
+
+            th_ycbcr_buffer ycbcr;
+            th_decode_ycbcr_out(aContext, ycbcr);
+            PlaneBuffer Y(ycbcr[0].data, ycbcr[0].stride, layout_.frame.height);
+            PlaneBuffer Cb(ycbcr[1].data, ycbcr[1].stride, layout_.frame.height >> layout_.subsampling.y);
+            PlaneBuffer Cr(ycbcr[2].data, ycbcr[2].stride, layout_.frame.height >> layout_.subsampling.y);
+            aEmit(aPool.copyFrame(layout_,
+                                  th_granule_time(aContext, granulepos),
+                                  th_granule_time(aContext, keyframeGranulepos),
+                                  Y, Cb, Cr));
+        }
+    }
+
+    long SegmentDecoder::decode(int aThreads, std::function<void(FrameBuffer &aBuffer)> aCallback)
+    {
+        if (boundaries_.empty()) {
+            return 0;
+        }
+        if (aThreads <= 0) {
+            aThreads = (int)std::thread::hardware_concurrency();
+            if (aThreads <= 0) {
+                aThreads = 1;
+            }
+        }
+
+        // Workers may only run this far ahead of delivery, and each
+        // segment only queue so many frames, which bounds memory however
+        // the file was split.
+        size_t window = (size_t)aThreads * 2;
+        size_t frameBytes = (size_t)layout_.frame.width * layout_.frame.height +
+                            2 * (size_t)(layout_.frame.width >> layout_.subsampling.x) *
+                                (size_t)(layout_.frame.height >> layout_.subsampling.y);
+        size_t framesPerSegment = std::max((size_t)1, memoryLimit_ / (window * std::max(frameBytes, (size_t)1)));
+
+        // A pool and decoder context per worker.
+        std::vector<std::unique_ptr<FramePool>> pools;
+        std::vector<th_dec_ctx *> contexts;
+        for (int i = 0; i < aThreads; i++) {
+            pools.emplace_back(new FramePool(std::min(framesPerSegment, window), false));
+            contexts.push_back(th_decode_alloc(&info_, setup_));
+        }
+
+        SegmentPipeline pipeline(boundaries_.size(), aThreads, window, framesPerSegment);
+        long frameCount = pipeline.run([&](size_t aIndex, int aWorker, const SegmentPipeline::Emit &aEmit) {
+            decodeSegment(aIndex, contexts[aWorker], *pools[aWorker], aEmit);
+        }, aCallback);
+
+        for (th_dec_ctx *context : contexts) {
+            th_decode_free(context);
+        }
+        return frameCount;
+    }
+
+}
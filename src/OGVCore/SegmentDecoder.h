@@ -0,0 +1,81 @@
+//
+// Platform-independent Ogg Vorbis/Theora/Opus decoder/player base
+//
+// Copyright (c) 2013-2015 Brion Vibber <brion@pobox.com>
+// MIT-style license
+// Please reuse and redistribute with the LICENSE notes intact.
+//
+
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+#include <theora/theoradec.h>
+
+#include <OGVCore.h>
+#include "SegmentPipeline.h"
+
+namespace OGVCore {
+
+	class FramePool;
+
+	/**
+	 * Decodes a Theora track of a mapped file in parallel, one segment
+	 * per task. Segments start at keyframes so each can be decoded
+	 * independently; every worker gets its own decoder context made
+	 * from the shared, read-only th_setup_info.
+	 */
+	class SegmentDecoder {
+	public:
+		SegmentDecoder(const unsigned char *aData, uint64_t aLength, uint32_t aSerial,
+		               const th_info &aInfo, const th_setup_info *aSetup,
+		               const FrameLayout &aLayout);
+
+		void setVerifyChecksums(bool aVerify) { verifyChecksums_ = aVerify; }
+
+		/**
+		 * Rough cap on decoded frame memory queued for delivery; decode
+		 * stays under it however long the segments are. Less than one
+		 * segment per worker costs parallelism.
+		 */
+		void setMemoryLimit(size_t aBytes) { memoryLimit_ = aBytes; }
+
+		/**
+		 * Add a segment boundary, eg from a Skeleton keypoint. A segment
+		 * begins with the first keyframe packet starting on or after
+		 * the page at aOffset. Offsets must be added in increasing order.
+		 */
+		void addBoundary(uint64_t aOffset);
+
+		/**
+		 * Scan the whole file for keyframes and split at each one.
+		 */
+		void scanKeyframes();
+
+		size_t segmentCount() const { return boundaries_.size(); }
+
+		/**
+		 * Decode every segment on aThreads workers, calling back on the
+		 * calling thread with frames in presentation order.
+		 *
+		 * @return number of frames delivered
+		 */
+		long decode(int aThreads, std::function<void(FrameBuffer &aBuffer)> aCallback);
+
+	private:
+		const unsigned char *data_;
+		uint64_t length_;
+		uint32_t serial_;
+		th_info info_;
+		const th_setup_info *setup_;
+		FrameLayout layout_;
+		bool verifyChecksums_;
+		size_t memoryLimit_;
+		std::vector<uint64_t> boundaries_;
+
+		void decodeSegment(size_t aIndex, th_dec_ctx *aContext, FramePool &aPool, const SegmentPipeline::Emit &aEmit);
+	};
+
+}
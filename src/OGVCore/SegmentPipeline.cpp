@@ -0,0 +1,110 @@
+//
+// Platform-independent Ogg Vorbis/Theora/Opus decoder/player base
+//
+// Copyright (c) 2013-2015 Brion Vibber <brion@pobox.com>
+// MIT-style license
+// Please reuse and redistribute with the LICENSE notes intact.
+//
+
+// C++ awesome
+#include <algorithm>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "SegmentPipeline.h"
+
+namespace OGVCore {
+
+    struct SegmentPipeline::Slot {
+        std::vector<std::shared_ptr<FrameBuffer>> frames;
+        bool done = false;
+    };
+
+    SegmentPipeline::SegmentPipeline(size_t aSegments, int aThreads, size_t aWindow, size_t aFramesPerSegment) :
+        segments_(aSegments),
+        threads_(aThreads > 0 ? aThreads : 1),
+        window_(aWindow > 0 ? aWindow : 1),
+        framesPerSegment_(aFramesPerSegment > 0 ? aFramesPerSegment : 1),
+        peakQueued_(0)
+    {}
+
+    long SegmentPipeline::run(Work aWork, std::function<void(FrameBuffer &aBuffer)> aCallback)
+    {
+        std::vector<Slot> slots(segments_);
+        std::mutex mutex;
+        std::condition_variable changed;
+        size_t nextSegment = 0;
+        size_t delivering = 0;
+        size_t queued = 0;
+        peakQueued_ = 0;
+
+        std::vector<std::thread> workers;
+        for (int i = 0; i < threads_; i++) {
+            workers.emplace_back([&, i]() {
+                while (true) {
+                    size_t index;
+                    {
+                        std::unique_lock<std::mutex> lock(mutex);
+                        changed.wait(lock, [&] {
+                            return nextSegment >= segments_ || nextSegment < delivering + window_;
+                        });
+                        if (nextSegment >= segments_) {
+                            break;
+                        }
+                        index = nextSegment++;
+                    }
+                    Slot &slot = slots[index];
+                    aWork(index, i, [&](std::shared_ptr<FrameBuffer> &&aFrame) {
+                        {
+                            std::unique_lock<std::mutex> lock(mutex);
+                            changed.wait(lock, [&] { return slot.frames.size() < framesPerSegment_; });
+                            slot.frames.push_back(std::move(aFrame));
+                            queued++;
+                            peakQueued_ = std::max(peakQueued_, queued);
+                        }
+                        changed.notify_all();
+                    });
+                    {
+                        std::lock_guard<std::mutex> lock(mutex);
+                        slot.done = true;
+                    }
+                    changed.notify_all();
+                }
+            });
+        }
+
+        long frameCount = 0;
+        std::vector<std::shared_ptr<FrameBuffer>> batch;
+        for (size_t i = 0; i < segments_; i++) {
+            // Take frames as they arrive, so the head segment streams.
+            bool finished = false;
+            while (!finished) {
+                {
+                    std::unique_lock<std::mutex> lock(mutex);
+                    changed.wait(lock, [&] { return !slots[i].frames.empty() || slots[i].done; });
+                    finished = slots[i].done;
+                    batch.swap(slots[i].frames);
+                    queued -= batch.size();
+                    if (finished) {
+                        delivering = i + 1;
+                    }
+                }
+                changed.notify_all();
+                for (auto &frame : batch) {
+                    aCallback(*frame);
+                    frameCount++;
+                }
+                // Back to the pools before the next batch.
+                batch.clear();
+            }
+        }
+
+        for (auto &worker : workers) {
+            worker.join();
+        }
+        return frameCount;
+    }
+
+}
@@ -0,0 +1,62 @@
+//
+// Platform-independent Ogg Vorbis/Theora/Opus decoder/player base
+//
+// Copyright (c) 2013-2015 Brion Vibber <brion@pobox.com>
+// MIT-style license
+// Please reuse and redistribute with the LICENSE notes intact.
+//
+
+#pragma once
+
+#include <stddef.h>
+#include <functional>
+#include <memory>
+
+#include <OGVCore.h>
+
+namespace OGVCore {
+
+	/**
+	 * Runs independent segments on a set of workers and hands their
+	 * frames back in order on the calling thread.
+	 *
+	 * Workers only start a segment within aWindow of the one being
+	 * delivered. Each segment may queue at most aFramesPerSegment
+	 * frames, and its worker waits at that point. The segment being
+	 * delivered is drained as it decodes, so it never blocks for long.
+	 * At most aWindow * aFramesPerSegment frames sit queued at once,
+	 * whatever the segment lengths.
+	 */
+	class SegmentPipeline {
+	public:
+		typedef std::function<void(std::shared_ptr<FrameBuffer> &&aFrame)> Emit;
+
+		/**
+		 * Produce segment aSegment's frames through aEmit, on worker
+		 * aWorker (0 to threads - 1) so per-worker state can be kept.
+		 */
+		typedef std::function<void(size_t aSegment, int aWorker, const Emit &aEmit)> Work;
+
+		SegmentPipeline(size_t aSegments, int aThreads, size_t aWindow, size_t aFramesPerSegment);
+
+		/**
+		 * @return number of frames delivered
+		 */
+		long run(Work aWork, std::function<void(FrameBuffer &aBuffer)> aCallback);
+
+		/**
+		 * @return most frames queued at once during the last run()
+		 */
+		size_t peakQueued() const { return peakQueued_; }
+
+	private:
+		struct Slot;
+
+		size_t segments_;
+		int threads_;
+		size_t window_;
+		size_t framesPerSegment_;
+		size_t peakQueued_;
+	};
+
+}
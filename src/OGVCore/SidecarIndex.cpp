@@ -0,0 +1,217 @@
+//
+// Platform-independent Ogg Vorbis/Theora/Opus decoder/player base
+//
+// Copyright (c) 2013-2015 Brion Vibber <brion@pobox.com>
+// MIT-style license
+// Please reuse and redistribute with the LICENSE notes intact.
+//
+
+#include <algorithm>
+
+// good ol' C library
+#include <stdio.h>
+#include <string.h>
+
+#include "SidecarIndex.h"
+#include "KeyframeIndex.h"
+
+namespace OGVCore {
+
+    struct SidecarIndex::Header {
+        char magic[8];
+        uint32_t version;
+        uint32_t recordSize;
+        uint32_t streamCount;
+        uint32_t byteOrder;
+        uint64_t mediaLength;
+        int64_t mediaMtime;
+        uint64_t mediaFingerprint;
+        uint64_t reserved[2];
+    };
+
+    struct SidecarIndex::Stream {
+        uint32_t serial;
+        uint32_t reserved;
+        double duration;
+        uint64_t recordOffset;  // from the start of the file
+        uint64_t recordCount;
+    };
+
+    struct SidecarIndex::Record {
+        double time;
+        uint64_t offset;
+    };
+
+    namespace {
+
+        const char SIDECAR_MAGIC[8] = { 'O', 'G', 'V', 'K', 'I', 'D', 'X', 0 };
+        const uint32_t SIDECAR_VERSION = 1;
+        // Reads back as 0x04030201 where the writer's byte order differs.
+        const uint32_t SIDECAR_BYTE_ORDER = 0x01020304;
+
+        // Enough to tell edited or swapped files apart without reading them through.
+        const uint64_t FINGERPRINT_SPAN = 16 * 1024;
+
+        /* FNV-1a */
+        uint64_t hashBytes(uint64_t hash, const unsigned char *data, uint64_t length)
+        {
+            for (uint64_t i = 0; i < length; i++) {
+                hash = (hash ^ data[i]) * 0x100000001b3ULL;
+            }
+            return hash;
+        }
+
+        uint64_t fingerprint(const MappedFile &aMedia)
+        {
+            uint64_t length = aMedia.length();
+            uint64_t head = std::min(length, FINGERPRINT_SPAN);
+            uint64_t tail = std::min(length - head, FINGERPRINT_SPAN);
+            uint64_t hash = hashBytes(0xcbf29ce484222325ULL, aMedia.data(), head);
+            return hashBytes(hash, aMedia.data() + length - tail, tail);
+        }
+
+    }
+
+    SidecarIndex::SidecarIndex() :
+        header_(nullptr),
+        streams_(nullptr)
+    {
+        // The file format is these structs as they lie in memory.
+        static_assert(sizeof(Header) == 64, "sidecar header layout");
+        static_assert(sizeof(Stream) == 32, "sidecar stream layout");
+        static_assert(sizeof(Record) == 16, "sidecar record layout");
+    }
+
+    bool SidecarIndex::open(const std::string &aPath, const MappedFile &aMedia)
+    {
+        header_ = nullptr;
+        streams_ = nullptr;
+        if (!aMedia.data() || !file_.open(aPath)) {
+            return false;
+        }
+
+        const unsigned char *data = file_.data();
+        uint64_t length = file_.length();
+        const Header *header = (const Header *)data;
+        if (length < sizeof(Header) ||
+            memcmp(header->magic, SIDECAR_MAGIC, sizeof(SIDECAR_MAGIC)) != 0 ||
+            header->version != SIDECAR_VERSION ||
+            header->recordSize != sizeof(Record) ||
+            header->byteOrder != SIDECAR_BYTE_ORDER ||
+            header->streamCount > (length - sizeof(Header)) / sizeof(Stream)) {
+            file_.close();
+            return false;
+        }
+        if (header->mediaLength != aMedia.length() ||
+            header->mediaMtime != aMedia.modificationTime() ||
+            header->mediaFingerprint != fingerprint(aMedia)) {
+            // Stale; the media has changed since.
+            file_.close();
+            return false;
+        }
+
+        const Stream *streams = (const Stream *)(data + sizeof(Header));
+        for (uint32_t i = 0; i < header->streamCount; i++) {
+            const Stream &stream = streams[i];
+            if (stream.recordOffset % sizeof(Record) != 0 || stream.recordOffset > length ||
+                stream.recordCount > (length - stream.recordOffset) / sizeof(Record)) {
+                file_.close();
+                return false;
+            }
+        }
+        header_ = header;
+        streams_ = streams;
+        return true;
+    }
+
+    int64_t SidecarIndex::keypointOffset(uint32_t aSerial, double aTime) const
+    {
+        const Stream *stream = findStream(aSerial);
+        if (!stream) {
+            return -1;
+        }
+        const Record *begin = (const Record *)(file_.data() + stream->recordOffset);
+        const Record *end = begin + stream->recordCount;
+        const Record *after = std::upper_bound(begin, end, aTime,
+            [] (double time, const Record &record) {
+                return time < record.time;
+            });
+        if (after == begin) {
+            return -1;
+        }
+        return (int64_t)(after - 1)->offset;
+    }
+
+    double SidecarIndex::duration(uint32_t aSerial) const
+    {
+        const Stream *stream = findStream(aSerial);
+        return stream ? stream->duration : -1;
+    }
+
+    /* helper: the stream table is short; a linear look is fine */
+    const SidecarIndex::Stream *SidecarIndex::findStream(uint32_t aSerial) const
+    {
+        if (!header_) {
+            return nullptr;
+        }
+        for (uint32_t i = 0; i < header_->streamCount; i++) {
+            if (streams_[i].serial == aSerial) {
+                return &streams_[i];
+            }
+        }
+        return nullptr;
+    }
+
+    bool SidecarIndex::write(const std::string &aPath, const MappedFile &aMedia,
+                             const std::vector<const KeyframeIndex *> &aStreams)
+    {
+        if (!aMedia.data()) {
+            return false;
+        }
+        Header header;
+        memset(&header, 0, sizeof(header));
+        memcpy(header.magic, SIDECAR_MAGIC, sizeof(SIDECAR_MAGIC));
+        header.version = SIDECAR_VERSION;
+        header.recordSize = sizeof(Record);
+        header.streamCount = (uint32_t)aStreams.size();
+        header.byteOrder = SIDECAR_BYTE_ORDER;
+        header.mediaLength = aMedia.length();
+        header.mediaMtime = aMedia.modificationTime();
+        header.mediaFingerprint = fingerprint(aMedia);
+
+        std::vector<Stream> streams(aStreams.size());
+        std::vector<Record> records;
+        uint64_t recordStart = sizeof(Header) + streams.size() * sizeof(Stream);
+        for (size_t i = 0; i < aStreams.size(); i++) {
+            const KeyframeIndex &index = *aStreams[i];
+            if (!index.complete()) {
+                return false;
+            }
+            memset(&streams[i], 0, sizeof(Stream));
+            streams[i].serial = index.serial();
+            streams[i].duration = index.duration();
+            streams[i].recordOffset = recordStart + records.size() * sizeof(Record);
+            streams[i].recordCount = index.keypoints().size();
+            for (const KeyframeIndex::Keypoint &keypoint : index.keypoints()) {
+                records.push_back({ keypoint.time, keypoint.offset });
+            }
+        }
+
+        // Written aside and renamed in, so a reader never maps half a file.
+        std::string temp = aPath + ".tmp";
+        FILE *out = fopen(temp.c_str(), "wb");
+        if (!out) {
+            return false;
+        }
+        bool ok = fwrite(&header, sizeof(header), 1, out) == 1 &&
+                  fwrite(streams.data(), sizeof(Stream), streams.size(), out) == streams.size() &&
+                  fwrite(records.data(), sizeof(Record), records.size(), out) == records.size();
+        ok = (fclose(out) == 0) && ok;
+        if (!ok || rename(temp.c_str(), aPath.c_str()) != 0) {
+            remove(temp.c_str());
+            return false;
+        }
+        return true;
+    }
+
+}
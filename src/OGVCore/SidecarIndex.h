@@ -0,0 +1,81 @@
+//
+// Platform-independent Ogg Vorbis/Theora/Opus decoder/player base
+//
+// Copyright (c) 2013-2015 Brion Vibber <brion@pobox.com>
+// MIT-style license
+// Please reuse and redistribute with the LICENSE notes intact.
+//
+
+#pragma once
+
+#include <stdint.h>
+
+#include <string>
+#include <vector>
+
+#include "MappedFile.h"
+
+namespace OGVCore {
+
+	class KeyframeIndex;
+
+	/**
+	 * A keyframe index saved beside a media file, so reopening it needs
+	 * no scan. The file is mapped and searched where it lies; nothing
+	 * is parsed or copied at load.
+	 *
+	 * Layout, all little-endian and naturally aligned:
+	 *
+	 *   header (64 bytes): magic "OGVKIDX\0", version, record size,
+	 *     stream count, byte order mark; then the media file's length,
+	 *     mtime and a fingerprint of its first and last 16KB
+	 *   stream table (32 bytes each): serial, duration, and where its
+	 *     records are and how many
+	 *   records (16 bytes each): time as a double and byte offset,
+	 *     sorted by time within each stream
+	 *
+	 * A file whose header doesn't match the media or this build is
+	 * ignored, never trusted; readers reject any other version.
+	 */
+	class SidecarIndex {
+	public:
+		SidecarIndex();
+
+		/**
+		 * Map an index file and check it belongs to aMedia as it is now.
+		 *
+		 * @return false if it's missing, damaged or stale
+		 */
+		bool open(const std::string &aPath, const MappedFile &aMedia);
+		bool isOpen() const { return header_ != nullptr; }
+
+		/**
+		 * @return where to start decoding aSerial's stream to reach
+		 *         aTime, or -1 if there's nothing for it
+		 */
+		int64_t keypointOffset(uint32_t aSerial, double aTime) const;
+		/**
+		 * @return the stream's duration in seconds, or -1
+		 */
+		double duration(uint32_t aSerial) const;
+		bool hasStream(uint32_t aSerial) const { return findStream(aSerial) != nullptr; }
+
+		/**
+		 * Save complete indexes of aMedia's streams to aPath.
+		 */
+		static bool write(const std::string &aPath, const MappedFile &aMedia,
+		                  const std::vector<const KeyframeIndex *> &aStreams);
+
+	private:
+		struct Header;
+		struct Stream;
+		struct Record;
+
+		MappedFile file_;
+		const Header *header_;
+		const Stream *streams_;
+
+		const Stream *findStream(uint32_t aSerial) const;
+	};
+
+}
@@ -0,0 +1,426 @@
+//
+// Platform-independent Ogg Vorbis/Theora/Opus decoder/player base
+//
+// Copyright (c) 2013-2015 Brion Vibber <brion@pobox.com>
+// MIT-style license
+// Please reuse and redistribute with the LICENSE notes intact.
+//
+
+// C++11
+#include <algorithm>
+#include <memory>
+#include <string>
+#include <vector>
+
+// good ol' C library
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+
+// And our own headers.
+#include <OGVCore.h>
+#include "KeyframeIndex.h"
+#include "MappedFile.h"
+#include "OggCrc.h"
+#include "OggPageParser.h"
+
+namespace OGVCore {
+
+    namespace {
+
+        // Keypoint times go in milliseconds, as Decoder asks for them.
+        const int64_t INDEX_TIME_DENOMINATOR = 1000;
+
+        const size_t FISHEAD_SIZE = 80;
+        const uint32_t FISBONE_MESSAGE_OFFSET = 44;
+        const size_t INDEX_HEADER_SIZE = 42;
+
+        uint32_t readBE32(const unsigned char *p)
+        {
+            return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | (uint32_t)p[3];
+        }
+
+        void putLE(std::vector<unsigned char> &aOut, uint64_t aValue, int aBytes)
+        {
+            for (int i = 0; i < aBytes; i++) {
+                aOut.push_back((unsigned char)(aValue >> (i * 8)));
+            }
+        }
+
+        /* Skeleton's variable-length integers: 7 bits a byte, low first, the high bit marking the last */
+        void putVarint(std::vector<unsigned char> &aOut, uint64_t aValue)
+        {
+            do {
+                unsigned char byte = aValue & 0x7f;
+                aValue >>= 7;
+                if (aValue == 0) {
+                    byte |= 0x80;
+                }
+                aOut.push_back(byte);
+            } while (aValue > 0);
+        }
+
+    }
+
+#pragma mark - Declarations
+
+    class SkeletonIndexer::impl {
+    public:
+
+        bool write(const std::string &aInputPath, const std::string &aOutputPath)
+        {
+            error.clear();
+            keypointCount = 0;
+            streams.clear();
+
+            MappedFile input;
+            if (!input.open(aInputPath)) {
+                return fail("can't open the input");
+            }
+            if (!scan_headers(input)) {
+                return false;
+            }
+
+            // One header-only pass feeds every stream's pages to its index.
+            OggPageParser parser(input.data(), input.length());
+            parser.setVerifyChecksums(false);
+            OggPageView page;
+            int ret;
+            while ((ret = parser.nextPage(page)) != 0) {
+                Stream *stream = (ret > 0) ? find_stream(page.serialno()) : nullptr;
+                if (stream) {
+                    stream->index->addPage(page);
+                }
+            }
+            for (Stream &stream : streams) {
+                stream.index->finish(input.length());
+                keypointCount += (long)stream.index->size();
+            }
+
+            // Everything from the insertion point on moves down by the
+            // Skeleton pages' size, which depends on the offsets it
+            // records; go round until it settles.
+            std::vector<unsigned char> head, body;
+            uint64_t shift = 0;
+            for (int pass = 0; pass < 8; pass++) {
+                build_skeleton(input.length(), shift, head, body);
+                if (head.size() + body.size() == shift) {
+                    break;
+                }
+                shift = head.size() + body.size();
+            }
+            if (head.size() + body.size() != shift) {
+                return fail("Skeleton layout didn't settle");
+            }
+
+            // Written aside and renamed in, so the output can even replace the input.
+            std::string temp = aOutputPath + ".tmp";
+            FILE *out = fopen(temp.c_str(), "wb");
+            if (!out) {
+                return fail("can't create the output");
+            }
+            bool ok = fwrite(head.data(), 1, head.size(), out) == head.size() &&
+                      fwrite(input.data(), 1, (size_t)insertOffset, out) == insertOffset &&
+                      fwrite(body.data(), 1, body.size(), out) == body.size() &&
+                      fwrite(input.data() + insertOffset, 1, (size_t)(input.length() - insertOffset), out) == input.length() - insertOffset;
+            ok = (fclose(out) == 0) && ok;
+            if (!ok || rename(temp.c_str(), aOutputPath.c_str()) != 0) {
+                remove(temp.c_str());
+                return fail("can't write the output");
+            }
+            return true;
+        }
+
+        std::string getError() const
+        {
+            return error;
+        }
+
+        long getKeypointCount() const
+        {
+            return keypointCount;
+        }
+
+    private:
+        struct Stream {
+            uint32_t serial;
+            const char *contentType;
+            const char *role;
+            int headerPackets;
+            int64_t granuleNumerator;
+            int64_t granuleDenominator;
+            uint32_t preroll;
+            int granuleShift;
+            int packetsStarted;
+            std::unique_ptr<KeyframeIndex> index;
+        };
+
+        std::string error;
+        long keypointCount = 0;
+        std::vector<Stream> streams;
+        uint64_t insertOffset = 0;    // end of the BOS pages, where Skeleton's other pages go
+        uint64_t contentOffset = 0;   // first page starting a data packet
+        uint32_t skeletonSerial = 0;
+        uint32_t skeletonPageno = 0;
+
+        bool fail(const char *aError)
+        {
+            error = aError;
+            return false;
+        }
+
+        /* helper: identify the streams and find where headers end */
+        bool scan_headers(const MappedFile &aInput)
+        {
+            OggPageParser parser(aInput.data(), aInput.length());
+            OggPageView page;
+            int ret;
+            bool inBos = true;
+            while ((ret = parser.nextPage(page)) != 0) {
+                if (ret < 0) {
+                    return fail(streams.empty() ? "not an Ogg file" : "damaged page in the headers");
+                }
+                if (page.bos()) {
+                    if (!inBos) {
+                        return fail("chained files aren't supported");
+                    }
+                    if (!add_stream(page)) {
+                        return false;
+                    }
+                    continue;
+                }
+                if (inBos) {
+                    inBos = false;
+                    insertOffset = page.offset;
+                }
+
+                Stream *stream = find_stream(page.serialno());
+                if (!stream) {
+                    return fail("page from a stream with no BOS page");
+                }
+                int cursor = 0;
+                size_t bodyOffset = 0;
+                OggPacketView packet;
+                while (page.nextPacket(cursor, bodyOffset, packet)) {
+                    if (!packet.continued && stream->packetsStarted++ >= stream->headerPackets) {
+                        contentOffset = page.offset;
+                        choose_serial();
+                        return true;
+                    }
+                }
+            }
+            return fail("no data after the headers");
+        }
+
+        /* helper: read a stream's identification header off its BOS page */
+        bool add_stream(const OggPageView &aPage)
+        {
+            int cursor = 0;
+            size_t bodyOffset = 0;
+            OggPacketView packet;
+            if (!aPage.nextPacket(cursor, bodyOffset, packet) || !packet.complete) {
+                return fail("BOS page without a whole packet");
+            }
+            const unsigned char *p = packet.bytes;
+            Stream stream;
+            stream.serial = aPage.serialno();
+            stream.packetsStarted = 0;
+            if (packet.length >= 42 && memcmp(p, "\x80theora", 7) == 0) {
+                stream.contentType = "video/theora";
+                stream.role = "video/main";
+                stream.headerPackets = 3;
+                stream.granuleNumerator = readBE32(p + 22);
+                stream.granuleDenominator = readBE32(p + 26);
+                stream.preroll = 0;
+                stream.granuleShift = ((p[40] & 0x03) << 3) | (p[41] >> 5);
+                if (stream.granuleNumerator == 0 || stream.granuleDenominator == 0) {
+                    return fail("Theora header with no frame rate");
+                }
+                // Theora 3.2.1 and later count frames from 1.
+                bool fromOne = ((p[7] << 16) | (p[8] << 8) | p[9]) >= 0x030201;
+                stream.index.reset(new KeyframeIndex(stream.serial, stream.granuleShift,
+                    (double)stream.granuleNumerator / stream.granuleDenominator, fromOne ? 1 : 0));
+            } else if (packet.length >= 30 && memcmp(p, "\x01vorbis", 7) == 0) {
+                stream.contentType = "audio/vorbis";
+                stream.role = "audio/main";
+                stream.headerPackets = 3;
+                stream.granuleNumerator = OggPageView::readLE32(p + 12);
+                stream.granuleDenominator = 1;
+                stream.preroll = 2;
+                stream.granuleShift = 0;
+            } else if (packet.length >= 19 && memcmp(p, "OpusHead", 8) == 0) {
+                stream.contentType = "audio/opus";
+                stream.role = "audio/main";
+                stream.headerPackets = 2;
+                // Granules count 48kHz samples whatever the input rate was.
+                stream.granuleNumerator = 48000;
+                stream.granuleDenominator = 1;
+                stream.preroll = 3840;
+                stream.granuleShift = 0;
+            } else if (packet.length >= 8 && memcmp(p, "fishead\0", 8) == 0) {
+                return fail("already has a Skeleton stream");
+            } else {
+                return fail("has a stream that isn't Theora, Vorbis or Opus");
+            }
+            if (stream.granuleNumerator == 0) {
+                return fail("audio header with no sample rate");
+            }
+            if (!stream.index) {
+                stream.index.reset(new KeyframeIndex(stream.serial, 0, (double)stream.granuleNumerator));
+            }
+            streams.push_back(std::move(stream));
+            return true;
+        }
+
+        Stream *find_stream(uint32_t aSerial)
+        {
+            for (Stream &stream : streams) {
+                if (stream.serial == aSerial) {
+                    return &stream;
+                }
+            }
+            return nullptr;
+        }
+
+        /* helper: a serial number for Skeleton that nothing else uses */
+        void choose_serial()
+        {
+            skeletonSerial = 0x736b656c; // "skel"
+            while (find_stream(skeletonSerial)) {
+                skeletonSerial++;
+            }
+        }
+
+        /* helper: lay out the fishead page, and the rest of Skeleton for after the BOS pages */
+        /* aShift is how far that moves the input's later pages */
+        void build_skeleton(uint64_t aInputLength, uint64_t aShift,
+                            std::vector<unsigned char> &aHead, std::vector<unsigned char> &aBody)
+        {
+            aHead.clear();
+            aBody.clear();
+            skeletonPageno = 0;
+
+            std::vector<unsigned char> packet;
+            packet.insert(packet.end(), "fishead\0", "fishead\0" + 8);
+            putLE(packet, 4, 2);                      // version 4.0
+            putLE(packet, 0, 2);
+            putLE(packet, 0, 8);                      // presentation time
+            putLE(packet, INDEX_TIME_DENOMINATOR, 8);
+            putLE(packet, 0, 8);                      // basetime
+            putLE(packet, INDEX_TIME_DENOMINATOR, 8);
+            packet.resize(packet.size() + 20, 0);     // UTC
+            putLE(packet, aInputLength + aShift, 8);  // segment length
+            putLE(packet, contentOffset + aShift, 8); // first data page
+            assert(packet.size() == FISHEAD_SIZE);
+            add_packet(aHead, packet, true, false);
+
+            for (const Stream &stream : streams) {
+                packet.clear();
+                packet.insert(packet.end(), "fisbone\0", "fisbone\0" + 8);
+                putLE(packet, FISBONE_MESSAGE_OFFSET, 4);
+                putLE(packet, stream.serial, 4);
+                putLE(packet, stream.headerPackets, 4);
+                putLE(packet, stream.granuleNumerator, 8);
+                putLE(packet, stream.granuleDenominator, 8);
+                putLE(packet, 0, 8);                  // base granule
+                putLE(packet, stream.preroll, 4);
+                putLE(packet, stream.granuleShift, 1);
+                putLE(packet, 0, 3);
+                std::string headers = std::string("Content-Type: ") + stream.contentType + "\r\n" +
+                                      "Role: " + stream.role + "\r\n";
+                packet.insert(packet.end(), headers.begin(), headers.end());
+                add_packet(aBody, packet, false, false);
+            }
+
+            for (const Stream &stream : streams) {
+                const std::vector<KeyframeIndex::Keypoint> &keypoints = stream.index->keypoints();
+                packet.clear();
+                packet.insert(packet.end(), "index\0", "index\0" + 6);
+                putLE(packet, stream.serial, 4);
+                putLE(packet, keypoints.size(), 8);
+                putLE(packet, INDEX_TIME_DENOMINATOR, 8);
+                putLE(packet, 0, 8);                  // first sample time
+                putLE(packet, (uint64_t)std::max<int64_t>(0, llround(stream.index->duration() * INDEX_TIME_DENOMINATOR)), 8);
+                assert(packet.size() == INDEX_HEADER_SIZE);
+                // Each keypoint is deltas from the one before.
+                uint64_t lastOffset = 0;
+                int64_t lastTime = 0;
+                for (const KeyframeIndex::Keypoint &keypoint : keypoints) {
+                    uint64_t offset = keypoint.offset + aShift;
+                    int64_t time = std::max<int64_t>(lastTime, llround(keypoint.time * INDEX_TIME_DENOMINATOR));
+                    putVarint(packet, offset - lastOffset);
+                    putVarint(packet, (uint64_t)(time - lastTime));
+                    lastOffset = offset;
+                    lastTime = time;
+                }
+                add_packet(aBody, packet, false, false);
+            }
+
+            packet.clear();
+            add_packet(aBody, packet, false, true);
+        }
+
+        /* helper: split a Skeleton packet into as many pages as it needs */
+        void add_packet(std::vector<unsigned char> &aOut, const std::vector<unsigned char> &aPacket, bool aBos, bool aEos)
+        {
+            size_t segments = aPacket.size() / 255 + 1;
+            size_t done = 0;
+            size_t bodyStart = 0;
+            do {
+                size_t count = std::min<size_t>(segments - done, 255);
+                bool last = (done + count == segments);
+                size_t start = aOut.size();
+
+                aOut.insert(aOut.end(), "OggS", "OggS" + 4);
+                aOut.push_back(0);
+                aOut.push_back((unsigned char)((done > 0 ? 0x01 : 0) | (aBos && done == 0 ? 0x02 : 0) | (aEos && last ? 0x04 : 0)));
+                putLE(aOut, last ? 0 : (uint64_t)-1, 8);  // headers are at granule 0
+                putLE(aOut, skeletonSerial, 4);
+                putLE(aOut, skeletonPageno++, 4);
+                putLE(aOut, 0, 4);                        // CRC, filled in below
+                aOut.push_back((unsigned char)count);
+                size_t bodyLength = 0;
+                for (size_t i = done; i < done + count; i++) {
+                    unsigned char lacing = (i + 1 == segments) ? (unsigned char)(aPacket.size() % 255) : 255;
+                    aOut.push_back(lacing);
+                    bodyLength += lacing;
+                }
+                size_t headerLength = aOut.size() - start;
+                aOut.insert(aOut.end(), aPacket.begin() + bodyStart, aPacket.begin() + bodyStart + bodyLength);
+
+                uint32_t crc = oggCrcUpdate(oggCrcUpdate(0, &aOut[start], headerLength), &aOut[start + headerLength], bodyLength);
+                for (int i = 0; i < 4; i++) {
+                    aOut[start + 22 + i] = (unsigned char)(crc >> (i * 8));
+                }
+                bodyStart += bodyLength;
+                done += count;
+            } while (done < segments);
+        }
+    };
+
+#pragma mark - SkeletonIndexer pimpl bounce methods
+
+    SkeletonIndexer::SkeletonIndexer() :
+        pimpl(new impl())
+    {}
+
+    SkeletonIndexer::~SkeletonIndexer()
+    {}
+
+    bool SkeletonIndexer::write(const std::string &aInputPath, const std::string &aOutputPath)
+    {
+        return pimpl->write(aInputPath, aOutputPath);
+    }
+
+    std::string SkeletonIndexer::getError() const
+    {
+        return pimpl->getError();
+    }
+
+    long SkeletonIndexer::getKeypointCount() const
+    {
+        return pimpl->getKeypointCount();
+    }
+
+}
@@ -0,0 +1,46 @@
+//
+// Platform-independent Ogg Vorbis/Theora/Opus decoder/player base
+//
+// Copyright (c) 2013-2015 Brion Vibber <brion@pobox.com>
+// MIT-style license
+// Please reuse and redistribute with the LICENSE notes intact.
+//
+
+#pragma once
+
+#include <condition_variable>
+#include <mutex>
+
+namespace OGVCore {
+
+	/**
+	 * Lets a worker thread sleep until someone has something for it.
+	 * A wake() that arrives before wait() isn't lost.
+	 */
+	class Waker {
+	public:
+		Waker() :
+			pending_(false)
+		{}
+
+		void wake()
+		{
+			std::lock_guard<std::mutex> lock(mutex_);
+			pending_ = true;
+			condition_.notify_one();
+		}
+
+		void wait()
+		{
+			std::unique_lock<std::mutex> lock(mutex_);
+			condition_.wait(lock, [this] { return pending_; });
+			pending_ = false;
+		}
+
+	private:
+		std::mutex mutex_;
+		std::condition_variable condition_;
+		bool pending_;
+	};
+
+}
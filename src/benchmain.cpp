@@ -0,0 +1,1042 @@
+//
+// Platform-independent Ogg Vorbis/Theora/Opus decoder/player base
+//
+// Copyright (c) 2013-2015 Brion Vibber <brion@pobox.com>
+// MIT-style license
+// Please reuse and redistribute with the LICENSE notes intact.
+//
+
+// C++11
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <new>
+#include <thread>
+#include <vector>
+
+// good ol' C library
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <math.h>
+#include <stdint.h>
+
+// And our own headers.
+#include <OGVCore.h>
+#include "OGVCore/AudioGovernor.h"
+#include "OGVCore/AudioKernels.h"
+#include "OGVCore/AudioPool.h"
+#include "OGVCore/FramePool.h"
+#include "OGVCore/KeyframeIndex.h"
+#include "OGVCore/MappedFile.h"
+#include "OGVCore/OggCrc.h"
+#include "OGVCore/OggPageParser.h"
+#include "OGVCore/Resampler.h"
+#include "OGVCore/SeekCache.h"
+#include "OGVCore/Seeker.h"
+#include "OGVCore/SegmentPipeline.h"
+#include "OGVCore/SidecarIndex.h"
+#include "OGVCore/Waker.h"
+
+#ifdef OGVCORE_BENCH_CODECS
+#include "testclip.h"
+#endif
+
+using namespace OGVCore;
+
+// Count heap allocations so the benchmarks can report them per operation.
+// Every form of new and delete goes through the same pair, so they match.
+static std::atomic<long> allocationCount(0);
+
+static void *countedAlloc(size_t aSize)
+{
+	allocationCount++;
+	void *p = malloc(aSize ? aSize : 1);
+	if (!p) {
+		throw std::bad_alloc();
+	}
+	return p;
+}
+
+static void countedFree(void *aPointer)
+{
+	free(aPointer);
+}
+
+void *operator new(size_t aSize)
+{
+	return countedAlloc(aSize);
+}
+
+void *operator new[](size_t aSize)
+{
+	return countedAlloc(aSize);
+}
+
+void operator delete(void *aPointer) noexcept
+{
+	countedFree(aPointer);
+}
+
+void operator delete[](void *aPointer) noexcept
+{
+	countedFree(aPointer);
+}
+
+void operator delete(void *aPointer, size_t) noexcept
+{
+	countedFree(aPointer);
+}
+
+void operator delete[](void *aPointer, size_t) noexcept
+{
+	countedFree(aPointer);
+}
+
+static double now()
+{
+	return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static void benchCrc()
+{
+	// Roughly a page's worth, so per-call overhead shows up too.
+	const size_t pageSize = 4096;
+	const size_t total = (size_t)1 << 30;
+	std::vector<unsigned char> data(pageSize);
+	for (size_t i = 0; i < pageSize; i++) {
+		data[i] = (unsigned char)rand();
+	}
+
+	printf("CRC kernels (selected: %s)\n", oggCrcKernelName(oggCrcSelectedKernel()));
+	for (int k = 0; k < OGG_CRC_KERNEL_COUNT; k++) {
+		OggCrcKernel kernel = (OggCrcKernel)k;
+		if (!oggCrcKernelAvailable(kernel)) {
+			printf("  %-10s unavailable\n", oggCrcKernelName(kernel));
+			continue;
+		}
+		uint32_t crc = 0;
+		double start = now();
+		for (size_t done = 0; done < total; done += pageSize) {
+			crc = oggCrcUpdateWith(kernel, crc, data.data(), pageSize);
+		}
+		double elapsed = now() - start;
+		printf("  %-10s %6.2f GB/s (%08x)\n", oggCrcKernelName(kernel), total / elapsed / 1e9, crc);
+	}
+}
+
+// Stand-in for one decode step: checksum a frame-sized buffer the slow way.
+static void fakeDecodeStep(const std::vector<unsigned char> &aFrame)
+{
+	static std::atomic<uint32_t> sink(0);
+	sink += oggCrcUpdateWith(OGG_CRC_BYTEWISE, 0, aFrame.data(), aFrame.size());
+}
+
+// Each simulated decoder keeps one step in flight, resubmitting itself,
+// the same way Decoder::startDecodeAhead(depth, scheduler) does.
+struct FakeDecoder {
+	DecoderScheduler *scheduler;
+	const std::vector<unsigned char> *frame;
+	int remaining;
+	std::atomic<int> *running;
+	Waker *done;
+
+	void step()
+	{
+		fakeDecodeStep(*frame);
+		if (--remaining > 0) {
+			scheduler->submit([this] { step(); });
+		} else if (--*running == 0) {
+			done->wake();
+		}
+	}
+};
+
+static void benchScheduler()
+{
+	// Same total work at every decoder count, so frames/sec compare directly.
+	const int totalFrames = 20000;
+	std::vector<unsigned char> frame(16384);
+	for (size_t i = 0; i < frame.size(); i++) {
+		frame[i] = (unsigned char)rand();
+	}
+
+	DecoderScheduler scheduler;
+	printf("Decoder scheduler (%d workers), aggregate frames/sec\n", scheduler.workerCount());
+	printf("  %8s %12s %12s %10s\n", "decoders", "scheduler", "thread-each", "stolen");
+	const int counts[] = { 1, 10, 100, 1000 };
+	for (int count : counts) {
+		int perDecoder = totalFrames / count;
+
+		std::atomic<int> running(count);
+		Waker done;
+		std::vector<FakeDecoder> decoders(count);
+		long stolenBefore = scheduler.getStats().tasksStolen;
+		double start = now();
+		for (auto &decoder : decoders) {
+			decoder.scheduler = &scheduler;
+			decoder.frame = &frame;
+			decoder.remaining = perDecoder;
+			decoder.running = &running;
+			decoder.done = &done;
+			scheduler.submit([&decoder] { decoder.step(); });
+		}
+		while (running > 0) {
+			done.wait();
+		}
+		double pooled = perDecoder * count / (now() - start);
+		long stolen = scheduler.getStats().tasksStolen - stolenBefore;
+
+		start = now();
+		std::vector<std::thread> threads;
+		for (int i = 0; i < count; i++) {
+			threads.emplace_back([&frame, perDecoder] {
+				for (int n = 0; n < perDecoder; n++) {
+					fakeDecodeStep(frame);
+				}
+			});
+		}
+		for (auto &thread : threads) {
+			thread.join();
+		}
+		double threaded = perDecoder * count / (now() - start);
+
+		printf("  %8d %12.0f %12.0f %10ld\n", count, pooled, threaded, stolen);
+	}
+}
+
+static void benchSegmentPipeline()
+{
+	// Long segments, as a coarse Skeleton split gives; each frame costs
+	// a fake decode step plus the copy into the worker's pool.
+	const size_t segments = 32;
+	const int framesPerSegment = 240;
+	const size_t cap = 16;
+	FrameLayout layout(Size(640, 360), Size(640, 360), Point(0, 0), Point(1, 1), 1.0, 30.0);
+	std::vector<unsigned char> plane(640 * 360);
+	for (size_t i = 0; i < plane.size(); i++) {
+		plane[i] = (unsigned char)rand();
+	}
+	PlaneBuffer Y(plane.data(), 640, 360);
+	PlaneBuffer C(plane.data(), 320, 180);
+	std::vector<unsigned char> work(4096);
+
+	printf("Segment pipeline, %d segments of %d 640x360 frames, frames/sec and peak frames queued\n",
+	       (int)segments, framesPerSegment);
+	printf("  %7s %16s %8s %16s %8s\n", "threads", "uncapped", "queued", "capped", "queued");
+	const int counts[] = { 1, 2, 4, 8 };
+	for (int threads : counts) {
+		double rate[2];
+		size_t peak[2];
+		for (int capped = 0; capped < 2; capped++) {
+			std::vector<std::unique_ptr<FramePool>> pools;
+			for (int i = 0; i < threads; i++) {
+				pools.emplace_back(new FramePool(0, false));
+			}
+			// Uncapped, segments ahead of delivery buffer whole, as before.
+			SegmentPipeline pipeline(segments, threads, threads * 2, capped ? cap : framesPerSegment);
+			double start = now();
+			long frames = pipeline.run([&](size_t, int aWorker, const SegmentPipeline::Emit &aEmit) {
+				for (int n = 0; n < framesPerSegment; n++) {
+					fakeDecodeStep(work);
+					aEmit(pools[aWorker]->copyFrame(layout, n / 30.0, 0, Y, C, C));
+				}
+			}, [](FrameBuffer &) {});
+			rate[capped] = frames / (now() - start);
+			peak[capped] = pipeline.peakQueued();
+		}
+		printf("  %7d %16.0f %8d %16.0f %8d\n", threads, rate[0], (int)peak[0], rate[1], (int)peak[1]);
+	}
+}
+
+static void benchOpusOutput()
+{
+	// 20ms packets at 48kHz, the usual Opus framing.
+	const int frames = 960;
+	const int packets = 100000;
+	const int layouts[] = { 2, 6, 8 };
+
+	printf("Opus output path, packets/sec and allocations/packet\n");
+	for (int channels : layouts) {
+		AudioLayout layout(channels, 48000);
+		std::vector<float> decoded(frames * channels);
+		for (size_t i = 0; i < decoded.size(); i++) {
+			decoded[i] = (float)rand() / RAND_MAX;
+		}
+
+		// Before: fresh scratch, a planar copy, then a vector per channel.
+		long allocationsBefore = allocationCount;
+		double start = now();
+		for (int n = 0; n < packets; n++) {
+			std::vector<float> output(decoded.size());
+			memcpy(output.data(), decoded.data(), sizeof(float) * decoded.size());
+			std::vector<float> pcm(frames * channels);
+			std::vector<float *> pcmp(channels);
+			for (int c = 0; c < channels; c++) {
+				pcmp[c] = pcm.data() + c * frames;
+				for (int i = 0; i < frames; i++) {
+					pcmp[c][i] = output[i * channels + c];
+				}
+			}
+			// The old AudioBuffer held a vector per channel.
+			std::shared_ptr<std::vector<std::vector<float>>> buffer(new std::vector<std::vector<float>>());
+			for (int c = 0; c < channels; c++) {
+				buffer->emplace_back(pcmp[c], pcmp[c] + frames);
+			}
+		}
+		double legacyRate = packets / (now() - start);
+		double legacyAllocations = (double)(allocationCount - allocationsBefore) / packets;
+
+		// After: persistent scratch, SIMD deinterleave into one pooled block.
+		AudioPool pool;
+		std::vector<float> output(decoded.size());
+		std::vector<float *> planes(channels);
+		std::shared_ptr<AudioBuffer> held;
+		pool.acquire(layout, frames);
+		allocationsBefore = allocationCount;
+		start = now();
+		for (int n = 0; n < packets; n++) {
+			memcpy(output.data(), decoded.data(), sizeof(float) * decoded.size());
+			std::shared_ptr<AudioBuffer> buffer = pool.acquire(layout, frames);
+			for (int c = 0; c < channels; c++) {
+				planes[c] = buffer->channel(c);
+			}
+			audioDeinterleave(output.data(), channels, frames, planes.data());
+			// Consumer keeps the previous packet alive, like an AudioFeeder queue would.
+			held = buffer;
+		}
+		double pooledRate = packets / (now() - start);
+		double pooledAllocations = (double)(allocationCount - allocationsBefore) / packets;
+
+		printf("  %d ch  before %9.0f/s %5.2f allocs   after %9.0f/s %5.2f allocs\n",
+		       channels, legacyRate, legacyAllocations, pooledRate, pooledAllocations);
+	}
+}
+
+static void benchAudioConvert()
+{
+	// A second of 48kHz stereo, with some overs to exercise the clipping.
+	const size_t count = 48000 * 2;
+	const int passes = 2000;
+	std::vector<float> input(count);
+	for (size_t i = 0; i < count; i++) {
+		input[i] = 2.4f * rand() / RAND_MAX - 1.2f;
+	}
+	std::vector<int16_t> reference(count);
+	audioConvertWith(AUDIO_CONVERT_SCALAR, input.data(), count, AUDIO_SAMPLE_S16, reference.data(), nullptr);
+
+	const AudioSampleFormat formats[] = { AUDIO_SAMPLE_S16, AUDIO_SAMPLE_S16, AUDIO_SAMPLE_S32 };
+	const bool dithered[] = { false, true, false };
+	std::vector<int32_t> output(count);
+
+	printf("Audio convert kernels (selected: %s), Msamples/sec\n", audioConvertKernelName(audioConvertSelectedKernel()));
+	printf("  %-10s %10s %10s %10s %8s\n", "kernel", "s16", "s16+dither", "s32", "s16 ok");
+	for (int k = 0; k < AUDIO_CONVERT_KERNEL_COUNT; k++) {
+		AudioConvertKernel kernel = (AudioConvertKernel)k;
+		if (!audioConvertKernelAvailable(kernel)) {
+			printf("  %-10s unavailable\n", audioConvertKernelName(kernel));
+			continue;
+		}
+		double rates[3];
+		for (int f = 0; f < 3; f++) {
+			AudioDither dither;
+			double start = now();
+			for (int n = 0; n < passes; n++) {
+				audioConvertWith(kernel, input.data(), count, formats[f], output.data(), dithered[f] ? &dither : nullptr);
+			}
+			rates[f] = (double)count * passes / (now() - start) / 1e6;
+		}
+
+		// Undithered output must match the scalar reference exactly.
+		audioConvertWith(kernel, input.data(), count, AUDIO_SAMPLE_S16, output.data(), nullptr);
+		bool same = memcmp(output.data(), reference.data(), sizeof(int16_t) * count) == 0;
+		printf("  %-10s %10.0f %10.0f %10.0f %8s\n", audioConvertKernelName(kernel), rates[0], rates[1], rates[2], same ? "yes" : "NO");
+	}
+}
+
+static void benchResampler()
+{
+	// Vorbis packets are up to 1024 frames; feed them one at a time, as the decoder does.
+	const int packet = 1024;
+	const int inRates[] = { 44100, 32000, 22050 };
+	const char *qualityNames[] = { "fast", "medium", "best" };
+	std::vector<float> input(packet);
+	for (int i = 0; i < packet; i++) {
+		input[i] = 2.0f * rand() / RAND_MAX - 1.0f;
+	}
+
+	printf("Resampler to 48000 Hz, realtime factor per channel\n");
+	printf("  %-8s %10s %10s %10s\n", "from", qualityNames[0], qualityNames[1], qualityNames[2]);
+	for (int inRate : inRates) {
+		double factors[3];
+		for (int q = 0; q < 3; q++) {
+			Resampler resampler(1, inRate, 48000, (ResampleQuality)q, packet);
+			std::vector<float> output(resampler.maxOutputFrames(packet));
+			const float *in = input.data();
+			float *out = output.data();
+			// Ten minutes of audio.
+			int packets = inRate * 600 / packet;
+			long allocationsBefore = allocationCount;
+			double start = now();
+			for (int n = 0; n < packets; n++) {
+				resampler.process(&in, packet, &out);
+			}
+			double elapsed = now() - start;
+			factors[q] = (double)packets * packet / inRate / elapsed;
+			if (allocationCount != allocationsBefore) {
+				printf("  (%s allocated while streaming)\n", qualityNames[q]);
+			}
+		}
+		printf("  %-8d %9.0fx %9.0fx %9.0fx\n", inRate, factors[0], factors[1], factors[2]);
+	}
+}
+
+struct CountingDelegate : public AudioFeeder::Delegate {
+	std::atomic<long> starved;
+
+	CountingDelegate() : starved(0) {}
+	void onStarved() { starved++; }
+};
+
+static void benchAudioRing()
+{
+	// 48kHz stereo float, device callbacks of 256 frames, Opus-sized writes.
+	const AudioLayout layout(2, 48000);
+	const int callback = 256;
+	const int packet = 960;
+	const long total = 48000L * 60;
+	AudioRing ring(layout, AUDIO_SAMPLE_FLOAT, 48000 / 5, packet);
+	CountingDelegate delegate;
+	ring.setDelegate(&delegate);
+
+	std::vector<float> decoded(packet * 2);
+	for (size_t i = 0; i < decoded.size(); i++) {
+		decoded[i] = (float)rand() / RAND_MAX;
+	}
+
+	std::atomic<long> readerAllocations(0);
+	double start = now();
+	std::thread reader([&] {
+		std::vector<float> output(callback * 2);
+		long frames = 0;
+		long before = allocationCount;
+		while (frames < total) {
+			// A real device waits for its period; spin until one is buffered.
+			if (ring.readableFrames() < callback && total - frames >= callback) {
+				std::this_thread::yield();
+				continue;
+			}
+			frames += ring.read(output.data(), callback);
+		}
+		readerAllocations = allocationCount - before;
+	});
+	long written = 0;
+	while (written < total) {
+		void *space = ring.beginWrite(packet);
+		if (!space) {
+			std::this_thread::yield();
+			continue;
+		}
+		memcpy(space, decoded.data(), sizeof(float) * decoded.size());
+		ring.commitWrite(packet);
+		written += packet;
+	}
+	reader.join();
+	double elapsed = now() - start;
+
+	printf("Audio ring, 48kHz stereo float through %d-frame reads\n", callback);
+	printf("  %.0fx realtime, %ld short reads, %ld starved callbacks, %ld reader allocations\n",
+	       total / 48000.0 / elapsed, ring.getUnderruns(), delegate.starved.load(), readerAllocations.load());
+}
+
+static void benchAudioGovernor()
+{
+	// Simulated clock: playback drains 1s per second, timers fire up to
+	// 20ms late, and decoding a batch costs 2% of its duration.
+	const double watermarks[][2] = {{0.05, 0.1}, {0.1, 0.5}, {0.25, 1.0}, {0.5, 2.0}};
+	const double minutes = 10;
+
+	printf("Audio governor, %.0f simulated minutes\n", minutes);
+	printf("  %-10s %10s %10s %10s  %s\n", "watermarks", "wakeups/s", "underruns", "batch", "buffered time at wakeup, %");
+	for (size_t i = 0; i < sizeof(watermarks) / sizeof(watermarks[0]); i++) {
+		AudioGovernor governor(watermarks[i][0], watermarks[i][1]);
+		double clock = 0;
+		double level = 0;
+		srand(1);
+		while (clock < minutes * 60) {
+			double batch = governor.wake(clock, level);
+			if (batch > 0) {
+				double cost = batch * 0.02;
+				level = std::max(level - cost, 0.0) + batch;
+				clock += cost;
+			}
+			double next = clock + governor.refilled(clock, level) + 0.02 * rand() / RAND_MAX;
+			level -= next - clock;
+			if (level < 0) {
+				level = 0;
+				governor.starved();
+			}
+			clock = next;
+		}
+
+		AudioGovernorStats stats = governor.stats(clock);
+		char label[32];
+		snprintf(label, sizeof(label), "%.2f-%.2f", stats.lowWater, stats.highWater);
+		printf("  %-10s %10.2f %10ld %9.0fms ", label, stats.wakeupsPerSecond, stats.underruns,
+		       stats.batches ? stats.secondsDecoded / stats.batches * 1000 : 0.0);
+		for (size_t bin = 0; bin < stats.bufferedHistogram.size(); bin++) {
+			printf(" %3.0f", 100.0 * stats.bufferedHistogram[bin] / stats.wakeups);
+		}
+		printf("\n");
+	}
+}
+
+struct SyntheticPage {
+	int64_t offset;
+	int64_t end;
+	double time;   // of the page's last sample
+};
+
+/* A variable-bitrate file: each 10s scene runs between 0.3x and 1.7x the mean rate, in 4-8KB pages */
+static std::vector<SyntheticPage> syntheticFile(double aSeconds, double aMeanBitrate)
+{
+	std::vector<SyntheticPage> pages;
+	int64_t offset = 0;
+	double time = 0;
+	double rate = aMeanBitrate / 8;
+	while (time < aSeconds) {
+		if (fmod(time, 10.0) < 0.05) {
+			rate = aMeanBitrate / 8 * (0.3 + 1.4 * rand() / RAND_MAX);
+		}
+		int64_t size = 4096 + rand() % 4096;
+		time += size / rate;
+		pages.push_back({offset, offset + size, time});
+		offset += size;
+	}
+	return pages;
+}
+
+/* the first page starting at or after aOffset, as a probe would read up to */
+static const SyntheticPage &probePage(const std::vector<SyntheticPage> &aPages, int64_t aOffset)
+{
+	auto page = std::lower_bound(aPages.begin(), aPages.end(), aOffset,
+		[](const SyntheticPage &aPage, int64_t aValue) { return aPage.offset < aValue; });
+	return (page == aPages.end()) ? aPages.back() : *page;
+}
+
+static void benchSeek()
+{
+	const double hours[] = {1, 10};
+	const int seeks = 500;
+
+	printf("Seeking in a 2Mbps VBR file, %d targets, probes and KB fetched per seek\n", seeks);
+	printf("  %-6s %-13s %6s %6s %9s %14s\n", "length", "search", "probes", "max", "KB", "KB to target");
+	for (double h : hours) {
+		srand(1);
+		std::vector<SyntheticPage> pages = syntheticFile(h * 3600, 2000000);
+		int64_t length = pages.back().end;
+		double duration = pages.back().time;
+
+		for (int interpolate = 0; interpolate < 2; interpolate++) {
+			long probes = 0;
+			int maxProbes = 0;
+			double fetched = 0;
+			double linear = 0;
+			for (int i = 0; i < seeks; i++) {
+				double target = duration * rand() / RAND_MAX;
+				int n = 0;
+				int64_t result;
+				if (interpolate) {
+					Seeker seeker(length, 0, duration, target);
+					for (int64_t offset = seeker.start(); offset >= 0;) {
+						const SyntheticPage &page = probePage(pages, offset);
+						fetched += page.end - offset;
+						offset = seeker.report(page.offset, page.end, page.time);
+					}
+					n = seeker.probes();
+					result = seeker.result();
+				} else {
+					// The old midpoint bisection, stopping at the same width.
+					int64_t lo = 0;
+					int64_t hi = length;
+					int64_t widest = 0;
+					while (hi - lo > std::max<int64_t>(widest, 282)) {
+						int64_t offset = lo + (hi - lo) / 2;
+						const SyntheticPage &page = probePage(pages, offset);
+						fetched += page.end - offset;
+						widest = std::max(widest, page.end - page.offset);
+						if (page.time <= target) {
+							lo = page.end;
+						} else {
+							hi = offset;
+						}
+						n++;
+					}
+					result = lo;
+				}
+				probes += n;
+				maxProbes = std::max(maxProbes, n);
+				// Then decode forward to the page holding the target.
+				int64_t reach = result;
+				while (reach < length && probePage(pages, reach).time < target) {
+					reach = probePage(pages, reach).end;
+				}
+				linear += reach - result;
+			}
+			char label[16];
+			snprintf(label, sizeof(label), "%.0fh %.1fGB", h, length / 1e9);
+			printf("  %-6s %-13s %6.1f %6d %9.1f %14.1f%s\n", label, interpolate ? "interpolate" : "bisect",
+			       (double)probes / seeks, maxProbes, fetched / seeks / 1024, linear / seeks / 1024,
+			       (!interpolate && length > INT32_MAX) ? "  (past int offsets)" : "");
+		}
+	}
+}
+
+/* One seek as Player does it, feeding aCache if given; returns the probes taken */
+static int scrubSeek(const std::vector<SyntheticPage> &aPages, SeekCache *aCache, double aTarget)
+{
+	Seeker seeker(aPages.back().end, 0, aPages.back().time, aTarget);
+	if (aCache) {
+		aCache->narrow(seeker, aTarget);
+	}
+	for (int64_t offset = seeker.start(); offset >= 0;) {
+		const SyntheticPage &page = probePage(aPages, offset);
+		if (aCache) {
+			aCache->addProbe(offset, page.time);
+		}
+		// Player reports the page bounds Decoder::firstTimestampedPage() gives.
+		offset = seeker.report(page.offset, page.end, page.time);
+	}
+
+	// Play on a couple of seconds from the result, noting pages passed.
+	int64_t reach = seeker.result();
+	while (reach < aPages.back().end && probePage(aPages, reach).time < aTarget + 2) {
+		const SyntheticPage &page = probePage(aPages, reach);
+		if (aCache) {
+			aCache->addPassed(page.end, page.time);
+		}
+		reach = page.end;
+	}
+	return seeker.probes();
+}
+
+static void benchSeekScrub()
+{
+	const size_t capacities[] = {0, 64, 1024};
+	const int windows[] = {10, 100, 1000, 5000};
+	const int windowCount = sizeof(windows) / sizeof(windows[0]);
+
+	printf("Scrubbing a 1h 2Mbps VBR file, mean probes per seek over the session\n");
+	printf("  %-12s", "cache");
+	for (int w = 0; w < windowCount; w++) {
+		char label[16];
+		snprintf(label, sizeof(label), "to %d", windows[w]);
+		printf(" %8s", label);
+	}
+	printf("\n");
+	for (size_t capacity : capacities) {
+		srand(1);
+		std::vector<SyntheticPage> pages = syntheticFile(3600, 2000000);
+		double duration = pages.back().time;
+		std::unique_ptr<SeekCache> cache(capacity ? new SeekCache(capacity) : nullptr);
+
+		char label[16];
+		snprintf(label, sizeof(label), capacity ? "%zu entries" : "none", capacity);
+		printf("  %-12s", label);
+		double target = duration / 2;
+		long probes = 0;
+		int seek = 0;
+		for (int w = 0; w < windowCount; w++) {
+			for (; seek < windows[w]; seek++) {
+				// Mostly dragging the playhead about, with the odd jump.
+				if (rand() % 10 == 0) {
+					target = duration * rand() / RAND_MAX;
+				} else {
+					target += 120.0 * rand() / RAND_MAX - 60;
+				}
+				target = std::min(std::max(target, 0.0), duration);
+				probes += scrubSeek(pages, cache.get(), target);
+			}
+			printf(" %8.2f", (double)probes / seek);
+			probes = 0;
+		}
+		printf("\n");
+	}
+}
+
+/* Append one page holding a single packet of aBodyLength filler bytes */
+static void appendPage(std::vector<unsigned char> &aFile, uint32_t aSerial, uint32_t aPageno,
+                       int64_t aGranule, bool aBos, size_t aBodyLength)
+{
+	unsigned char header[27 + 255];
+	int segments = (int)(aBodyLength / 255) + 1;
+	memcpy(header, "OggS", 4);
+	header[4] = 0;
+	header[5] = aBos ? 0x02 : 0;
+	for (int i = 0; i < 8; i++) {
+		header[6 + i] = (unsigned char)((uint64_t)aGranule >> (i * 8));
+	}
+	for (int i = 0; i < 4; i++) {
+		header[14 + i] = (unsigned char)(aSerial >> (i * 8));
+		header[18 + i] = (unsigned char)(aPageno >> (i * 8));
+		header[22 + i] = 0;
+	}
+	header[26] = (unsigned char)segments;
+	memset(header + 27, 255, segments - 1);
+	header[27 + segments - 1] = (unsigned char)(aBodyLength % 255);
+
+	size_t headerLength = 27 + segments;
+	size_t start = aFile.size();
+	aFile.insert(aFile.end(), header, header + headerLength);
+	aFile.resize(start + headerLength + aBodyLength, (unsigned char)aPageno);
+	uint32_t crc = oggCrcUpdate(oggCrcUpdate(0, &aFile[start], headerLength), &aFile[start + headerLength], aBodyLength);
+	for (int i = 0; i < 4; i++) {
+		aFile[start + 22 + i] = (unsigned char)(crc >> (i * 8));
+	}
+}
+
+static void benchKeyframeIndex()
+{
+	// 30fps Theora-style video, a keyframe every 64 frames, with a page
+	// of 48kHz audio every 8 frames; page cache warm.
+	const size_t target = (size_t)512 << 20;
+	const int shift = 6;
+	const uint32_t video = 1, audio = 2;
+	std::vector<unsigned char> file;
+	file.reserve(target + (1 << 20));
+	uint32_t videoPage = 0, audioPage = 0;
+	appendPage(file, video, videoPage++, 0, true, 42);
+	appendPage(file, audio, audioPage++, 0, true, 30);
+	appendPage(file, video, videoPage++, 0, false, 3000);
+	appendPage(file, audio, audioPage++, 0, false, 4000);
+	int64_t frames = 0, keyframe = 0, keyframes = 0;
+	srand(1);
+	while (file.size() < target) {
+		frames++;
+		if ((frames - 1) % 64 == 0) {
+			keyframe = frames;
+			keyframes++;
+		}
+		size_t size = (keyframe == frames) ? 30000 + rand() % 20000 : 2000 + rand() % 10000;
+		appendPage(file, video, videoPage++, (keyframe << shift) | (frames - keyframe), false, size);
+		if (frames % 8 == 0) {
+			appendPage(file, audio, audioPage++, frames * 1600, false, 4000 + rand() % 1000);
+		}
+	}
+
+	char path[] = "/tmp/ogvcorebench-XXXXXX";
+	int fd = mkstemp(path);
+	if (fd < 0 || write(fd, file.data(), file.size()) != (ssize_t)file.size()) {
+		printf("Keyframe index: couldn't write a temp file\n");
+		return;
+	}
+	close(fd);
+	std::vector<unsigned char>().swap(file);
+	MappedFile mapped;
+	bool opened = mapped.open(path);
+	unlink(path);
+	if (!opened) {
+		printf("Keyframe index: couldn't map the temp file\n");
+		return;
+	}
+
+	printf("Keyframe index of a %.0fMB mapped file, %lld frames\n", mapped.length() / 1e6, (long long)frames);
+	double start = now();
+	KeyframeIndex index(video, shift, 30.0, 1);
+	index.scan(mapped.data(), mapped.length());
+	double elapsed = now() - start;
+	printf("  header scan     %6.2f GB/s, %zu keypoints of %lld, %.1fs long\n",
+	       mapped.length() / elapsed / 1e9, index.size(), (long long)keyframes, index.duration());
+
+	// What reading every byte costs, for comparison.
+	start = now();
+	OggPageParser parser(mapped.data(), mapped.length());
+	OggPageView page;
+	long pages = 0;
+	while (parser.nextPage(page) != 0) {
+		pages++;
+	}
+	elapsed = now() - start;
+	printf("  checked walk    %6.2f GB/s, %ld pages\n", mapped.length() / elapsed / 1e9, pages);
+
+	const int lookups = 1000000;
+	int64_t sum = 0;
+	start = now();
+	for (int i = 0; i < lookups; i++) {
+		sum += index.keypointOffset(index.duration() * (i % 1000) / 1000);
+	}
+	elapsed = now() - start;
+	printf("  lookup          %6.0f ns (%lld)\n", elapsed / lookups * 1e9, (long long)(sum & 0xff));
+
+	// Saved beside the file, then reopened as on the next load.
+	char sidecarPath[] = "/tmp/ogvcorebench-XXXXXX";
+	fd = mkstemp(sidecarPath);
+	if (fd < 0) {
+		return;
+	}
+	close(fd);
+	if (!SidecarIndex::write(sidecarPath, mapped, { &index })) {
+		printf("  sidecar         couldn't be written\n");
+		unlink(sidecarPath);
+		return;
+	}
+	start = now();
+	SidecarIndex sidecar;
+	bool valid = sidecar.open(sidecarPath, mapped);
+	int64_t first = sidecar.keypointOffset(video, index.duration() / 2);
+	elapsed = now() - start;
+	unlink(sidecarPath);
+	int mismatches = 0;
+	for (int i = 0; i < 1000; i++) {
+		double time = index.duration() * i / 1000;
+		mismatches += sidecar.keypointOffset(video, time) != index.keypointOffset(time);
+	}
+	start = now();
+	sum = 0;
+	for (int i = 0; i < lookups; i++) {
+		sum += sidecar.keypointOffset(video, index.duration() * (i % 1000) / 1000);
+	}
+	double lookupTime = now() - start;
+	printf("  sidecar reopen  %6.0f us to a first answer, %s, %d mismatches\n",
+	       elapsed * 1e6, valid && first >= 0 ? "valid" : "INVALID", mismatches);
+	printf("  sidecar lookup  %6.0f ns (%lld)\n", lookupTime / lookups * 1e9, (long long)(sum & 0xff));
+}
+
+#ifdef OGVCORE_BENCH_CODECS
+
+// Stand-in for a network read: copy the next bytes of a looped clip.
+static void readFromNetwork(const std::vector<unsigned char> &aClip, size_t aPosition, unsigned char *aDest, size_t aLength)
+{
+	while (aLength > 0) {
+		size_t offset = aPosition % aClip.size();
+		size_t length = std::min(aLength, aClip.size() - offset);
+		memcpy(aDest, aClip.data() + offset, length);
+		aDest += length;
+		aPosition += length;
+		aLength -= length;
+	}
+}
+
+static void benchDecoderInput()
+{
+	const size_t chunkSize = 64 * 1024;
+	const size_t total = (size_t)256 << 20;
+	std::vector<unsigned char> clip = makeTestClip(300, 30, 320, 240);
+	std::vector<unsigned char> readBuffer(chunkSize);
+
+	printf("Decoder input, 64KB network reads, video off so only copy-in and demux are timed\n");
+	for (int path = 0; path < 2; path++) {
+		static const char *names[] = { "receiveInput(ptr)", "acquire/commit" };
+		Decoder decoder;
+		decoder.receiveInput(clip.data(), clip.size());
+		while (!decoder.frameReady() && decoder.process()) {
+			// read the headers
+		}
+		// The looped clip's repeated headers and frames are dropped unparsed.
+		decoder.setVideoEnabled(false);
+		long pagesBefore = decoder.getDemuxStats().pagesDiscarded;
+
+		double start = now();
+		for (size_t done = 0; done < total; done += chunkSize) {
+			if (path == 0) {
+				// The backend reads into its own buffer, then hands it over.
+				readFromNetwork(clip, done, readBuffer.data(), chunkSize);
+				decoder.receiveInput(readBuffer.data(), chunkSize);
+			} else {
+				// The backend reads straight into the sync buffer.
+				unsigned char *dest = decoder.acquireInputBuffer(chunkSize);
+				readFromNetwork(clip, done, dest, chunkSize);
+				decoder.commitInputBuffer(chunkSize);
+			}
+			while (decoder.process()) {
+				// demux everything that came in
+			}
+		}
+		double elapsed = now() - start;
+		long pages = decoder.getDemuxStats().pagesDiscarded - pagesBefore;
+		printf("  %-18s %6.2f GB/s, %8.0f pages/sec\n", names[path], total / elapsed / 1e9, pages / elapsed);
+	}
+}
+
+// Map a clip from a temp file and read its headers, as a player would before decoding.
+static bool openClip(Decoder &aDecoder, const std::vector<unsigned char> &aClip)
+{
+	char path[] = "/tmp/ogvcorebench-XXXXXX";
+	int fd = mkstemp(path);
+	if (fd < 0 || write(fd, aClip.data(), aClip.size()) != (ssize_t)aClip.size()) {
+		return false;
+	}
+	close(fd);
+	bool opened = aDecoder.openFile(path);
+	unlink(path);
+	if (!opened) {
+		return false;
+	}
+	while (!aDecoder.frameReady() && aDecoder.process()) {
+		// read the headers
+	}
+	return aDecoder.frameReady();
+}
+
+static void benchDecodeSegments()
+{
+	const int frames = 600;
+	std::vector<unsigned char> clip = makeTestClip(frames, 30, 320, 240);
+	Decoder decoder;
+	if (!openClip(decoder, clip)) {
+		printf("Segment decode: couldn't open the clip\n");
+		return;
+	}
+
+	printf("decodeSegments, %d 320x240 frames in GOPs of 30, frames/sec\n", frames);
+	printf("  %7s %12s %8s\n", "threads", "frames/sec", "speedup");
+	const int counts[] = { 1, 2, 4, 8 };
+	double single = 0;
+	for (int threads : counts) {
+		double start = now();
+		long decoded = decoder.decodeSegments(threads, [](FrameBuffer &) {});
+		double rate = decoded / (now() - start);
+		if (threads == 1) {
+			single = rate;
+		}
+		printf("  %7d %12.0f %7.2fx%s\n", threads, rate, rate / single,
+		       decoded == frames ? "" : "  (frames missing)");
+	}
+}
+
+// Seek to the last frame of a long GOP, decoding up from its keyframe
+// as Player's linear seek does, with skipFrame() and with decodeFrame().
+static void benchSeekSkip()
+{
+	const int interval = 240;
+	const int seeks = 10;
+	std::vector<unsigned char> clip = makeTestClip(interval, interval, 640, 360);
+	Decoder decoder;
+	if (!openClip(decoder, clip)) {
+		printf("Seek skip: couldn't open the clip\n");
+		return;
+	}
+	int64_t keyframe = -1;
+	OggPageParser parser(clip.data(), clip.size());
+	OggPageView page;
+	while (keyframe < 0 && parser.nextPage(page) > 0) {
+		// A Theora data packet with the keyframe bit clear.
+		if (page.bodyLength > 0 && !(page.body[0] & 0xc0)) {
+			keyframe = (int64_t)page.offset;
+		}
+	}
+	if (keyframe < 0) {
+		printf("Seek skip: no keyframe in the clip\n");
+		return;
+	}
+	double target = (interval - 1) / 30.0;
+
+	printf("Seek %d frames into a 640x360 GOP, ms per seek\n", interval - 1);
+	for (int skip = 0; skip < 2; skip++) {
+		long frames = 0;
+		double start = now();
+		for (int n = 0; n < seeks; n++) {
+			decoder.flush();
+			decoder.seekFile(keyframe);
+			while (true) {
+				if (!decoder.frameReady()) {
+					if (!decoder.process()) {
+						break;
+					}
+				} else if (decoder.frameTimestamp() < target) {
+					if (skip) {
+						decoder.skipFrame();
+					} else {
+						decoder.decodeFrame([](FrameBuffer &) {});
+					}
+					frames++;
+				} else {
+					break;
+				}
+			}
+		}
+		double elapsed = now() - start;
+		printf("  %-12s %8.2f ms, %ld frames passed\n", skip ? "skipFrame" : "decodeFrame",
+		       elapsed / seeks * 1e3, frames / seeks);
+	}
+}
+
+// Decode a whole A/V file through decode-ahead, popping as fast as it
+// comes, once with one worker and once split into demux, video and audio.
+static void benchSplitDecodeAhead(const char *aPath)
+{
+	const int depth = 8;
+	printf("Decode-ahead of %s, depth %d, wall clock\n", aPath, depth);
+	printf("  %-7s %9s %8s %10s %12s %10s\n", "mode", "seconds", "frames", "frames/sec", "audio secs", "producer");
+	for (int split = 0; split < 2; split++) {
+		Decoder decoder;
+		if (!decoder.openFile(aPath)) {
+			printf("  couldn't open the file\n");
+			return;
+		}
+		long frames = 0;
+		double audio = 0;
+		double start = now();
+		double last = start;
+		decoder.startDecodeAhead(depth, split != 0);
+		// The workers just go idle at the end, so stop once nothing has come for a while.
+		while (now() - last < 0.5) {
+			bool got = false;
+			while (std::shared_ptr<FrameBuffer> frame = decoder.popFrame()) {
+				frames++;
+				got = true;
+			}
+			while (std::shared_ptr<AudioBuffer> buffer = decoder.popAudio()) {
+				audio += (double)buffer->sampleCount / buffer->layout.sampleRate;
+				got = true;
+			}
+			if (got) {
+				last = now();
+			} else {
+				std::this_thread::yield();
+			}
+		}
+		DecodeAheadStats stats = decoder.getDecodeAheadStats();
+		decoder.stopDecodeAhead();
+		double elapsed = last - start;
+		if (frames == 0 && audio == 0) {
+			printf("  nothing decoded; is it an Ogg file?\n");
+			return;
+		}
+		printf("  %-7s %9.3f %8ld %10.1f %12.2f %10ld\n", split ? "split" : "single",
+		       elapsed, frames, frames / elapsed, audio, stats.producerStalls);
+	}
+}
+
+#endif
+
+int main(int argc, char **argv) {
+	benchCrc();
+	benchScheduler();
+	benchSegmentPipeline();
+	benchOpusOutput();
+	benchAudioConvert();
+	benchResampler();
+	benchAudioRing();
+	benchAudioGovernor();
+	benchSeek();
+	benchSeekScrub();
+	benchKeyframeIndex();
+#ifdef OGVCORE_BENCH_CODECS
+	benchDecoderInput();
+	benchDecodeSegments();
+	benchSeekSkip();
+	if (argc > 1) {
+		// Needs a real A/V file; there's no audio encoder to generate one.
+		benchSplitDecodeAhead(argv[1]);
+	}
+#else
+	if (argc > 1) {
+		printf("Ignoring %s; build ogvcorecodecbench to decode files\n", argv[1]);
+	}
+#endif
+	return 0;
+}
@@ -0,0 +1,27 @@
+//
+// Platform-independent Ogg Vorbis/Theora/Opus decoder/player base
+//
+// Copyright (c) 2013-2015 Brion Vibber <brion@pobox.com>
+// MIT-style license
+// Please reuse and redistribute with the LICENSE notes intact.
+//
+
+#include <stdio.h>
+#include <OGVCore.h>
+
+int main(int argc, char **argv) {
+	if (argc != 3) {
+		fprintf(stderr, "usage: %s input.ogg output.ogg\n", argv[0]);
+		fprintf(stderr, "Copies an Ogg file, adding a Skeleton 4 keypoint index for fast seeking.\n");
+		return 1;
+	}
+
+	OGVCore::SkeletonIndexer indexer;
+	if (!indexer.write(argv[1], argv[2])) {
+		fprintf(stderr, "%s: %s\n", argv[1], indexer.getError().c_str());
+		return 1;
+	}
+	printf("%s: %ld keypoints\n", argv[2], indexer.getKeypointCount());
+
+	return 0;
+}
@@ -0,0 +1,106 @@
+//
+// Platform-independent Ogg Vorbis/Theora/Opus decoder/player base
+//
+// Copyright (c) 2013-2015 Brion Vibber <brion@pobox.com>
+// MIT-style license
+// Please reuse and redistribute with the LICENSE notes intact.
+//
+
+#include <ogg/ogg.h>
+#include <theora/theoraenc.h>
+
+#include "testclip.h"
+
+namespace OGVCore {
+
+	static void appendPage(std::vector<unsigned char> &aFile, const ogg_page &aPage)
+	{
+		aFile.insert(aFile.end(), aPage.header, aPage.header + aPage.header_len);
+		aFile.insert(aFile.end(), aPage.body, aPage.body + aPage.body_len);
+	}
+
+	std::vector<unsigned char> makeTestClip(int aFrames, int aKeyframeInterval, int aWidth, int aHeight)
+	{
+		th_info info;
+		th_info_init(&info);
+		info.frame_width = (aWidth + 15) & ~15;
+		info.frame_height = (aHeight + 15) & ~15;
+		info.pic_width = aWidth;
+		info.pic_height = aHeight;
+		info.pic_x = 0;
+		info.pic_y = 0;
+		info.colorspace = TH_CS_UNSPECIFIED;
+		info.pixel_fmt = TH_PF_420;
+		info.target_bitrate = 0;
+		info.quality = 32;
+		info.fps_numerator = 30;
+		info.fps_denominator = 1;
+		info.aspect_numerator = 1;
+		info.aspect_denominator = 1;
+		// The granulepos has to be able to count a whole GOP.
+		info.keyframe_granule_shift = 1;
+		while ((1 << info.keyframe_granule_shift) < aKeyframeInterval) {
+			info.keyframe_granule_shift++;
+		}
+
+		th_enc_ctx *encoder = th_encode_alloc(&info);
+		ogg_uint32_t interval = aKeyframeInterval;
+		th_encode_ctl(encoder, TH_ENCCTL_SET_KEYFRAME_FREQUENCY_FORCE, &interval, sizeof(interval));
+
+		std::vector<unsigned char> file;
+		ogg_stream_state stream;
+		ogg_stream_init(&stream, 0x7e57c11b);
+		ogg_page page;
+		ogg_packet packet;
+
+		th_comment comment;
+		th_comment_init(&comment);
+		bool first = true;
+		while (th_encode_flushheader(encoder, &comment, &packet) > 0) {
+			ogg_stream_packetin(&stream, &packet);
+			if (first) {
+				// The BOS page holds the identification header alone.
+				while (ogg_stream_flush(&stream, &page)) {
+					appendPage(file, page);
+				}
+				first = false;
+			}
+		}
+		while (ogg_stream_flush(&stream, &page)) {
+			appendPage(file, page);
+		}
+		th_comment_clear(&comment);
+
+		std::vector<unsigned char> planes[3];
+		th_ycbcr_buffer ycbcr;
+		for (int i = 0; i < 3; i++) {
+			int shift = i ? 1 : 0;
+			ycbcr[i].width = info.frame_width >> shift;
+			ycbcr[i].height = info.frame_height >> shift;
+			ycbcr[i].stride = ycbcr[i].width;
+			planes[i].assign(ycbcr[i].stride * ycbcr[i].height, 128);
+			ycbcr[i].data = planes[i].data();
+		}
+		for (int n = 0; n < aFrames; n++) {
+			// A gradient that slides a little every frame, so frames differ.
+			for (int y = 0; y < ycbcr[0].height; y++) {
+				for (int x = 0; x < ycbcr[0].width; x++) {
+					ycbcr[0].data[y * ycbcr[0].stride + x] = (unsigned char)(x * 4 + y * 2 + n * 3);
+				}
+			}
+			th_encode_ycbcr_in(encoder, ycbcr);
+			while (th_encode_packetout(encoder, n == aFrames - 1, &packet) > 0) {
+				ogg_stream_packetin(&stream, &packet);
+				while (ogg_stream_flush(&stream, &page)) {
+					appendPage(file, page);
+				}
+			}
+		}
+
+		ogg_stream_clear(&stream);
+		th_encode_free(encoder);
+		th_info_clear(&info);
+		return file;
+	}
+
+}
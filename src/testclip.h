@@ -0,0 +1,25 @@
+//
+// Platform-independent Ogg Vorbis/Theora/Opus decoder/player base
+//
+// Copyright (c) 2013-2015 Brion Vibber <brion@pobox.com>
+// MIT-style license
+// Please reuse and redistribute with the LICENSE notes intact.
+//
+
+#pragma once
+
+#include <vector>
+
+namespace OGVCore {
+
+	/**
+	 * Encode a small Theora-only Ogg clip at 30fps for the tests and
+	 * benchmarks, so they need no sample files. Every frame goes on a
+	 * page of its own, so each GOP spans many pages.
+	 *
+	 * @param aKeyframeInterval frames from one keyframe to the next
+	 */
+	std::vector<unsigned char> makeTestClip(int aFrames, int aKeyframeInterval,
+	                                        int aWidth = 64, int aHeight = 48);
+
+}
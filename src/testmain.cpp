@@ -6,8 +6,148 @@
 // Please reuse and redistribute with the LICENSE notes intact.
 //
 
+#include <algorithm>
+#include <chrono>
+#include <memory>
+#include <thread>
+#include <vector>
+
 #include <stdio.h>
+#include <string.h>
+
 #include <OGVCore.h>
+#include "OGVCore/OggPageParser.h"
+#include "testclip.h"
+
+using namespace OGVCore;
+
+static int failures = 0;
+
+static void check(bool aCondition, const char *aWhat)
+{
+	if (!aCondition) {
+		printf("FAIL: %s\n", aWhat);
+		failures++;
+	}
+}
+
+static double now()
+{
+	return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static bool ascending(const std::vector<double> &aTimes)
+{
+	for (size_t i = 1; i < aTimes.size(); i++) {
+		if (!(aTimes[i] > aTimes[i - 1])) {
+			return false;
+		}
+	}
+	return true;
+}
+
+// Feed a clip in small odd-sized writes while the decode-ahead worker
+// demuxes, so ogg_sync_buffer() keeps shifting and growing the sync
+// buffer under pages the worker has just pulled out.
+static void testInputWhileDemuxing(bool aSplit)
+{
+	const int frames = 300;
+	std::vector<unsigned char> clip = makeTestClip(frames, 30);
+
+	Decoder decoder;
+	decoder.startDecodeAhead(4, aSplit);
+	std::vector<double> times;
+	size_t offset = 0;
+	unsigned seed = 1;
+	double deadline = now() + 30;
+	while ((int)times.size() < frames && now() < deadline) {
+		if (offset < clip.size()) {
+			seed = seed * 1103515245 + 12345;
+			size_t length = std::min<size_t>(1 + (seed >> 16) % 700, clip.size() - offset);
+			unsigned char *dest = decoder.acquireInputBuffer(length);
+			memcpy(dest, clip.data() + offset, length);
+			decoder.commitInputBuffer(length);
+			offset += length;
+		} else {
+			std::this_thread::yield();
+		}
+		while (std::shared_ptr<FrameBuffer> frame = decoder.popFrame()) {
+			times.push_back(frame->timestamp);
+		}
+	}
+	decoder.stopDecodeAhead();
+
+	check((int)times.size() == frames, aSplit ? "split decode-ahead got every frame" : "decode-ahead got every frame");
+	check(ascending(times), "decode-ahead frames came out in order");
+}
+
+// Offset of the page holding the aIndex'th keyframe of a one-frame-per-page clip.
+static int64_t keyframePageOffset(const std::vector<unsigned char> &aClip, int aIndex)
+{
+	OggPageParser parser(aClip.data(), aClip.size());
+	OggPageView page;
+	while (parser.nextPage(page) > 0) {
+		// A Theora data packet with the keyframe bit clear.
+		if (page.bodyLength > 0 && !(page.body[0] & 0xc0) && aIndex-- == 0) {
+			return (int64_t)page.offset;
+		}
+	}
+	return -1;
+}
+
+// Seek as Player does after a keypoint lookup: flush, feed from the
+// keyframe, then skip frames up to the target. The GOP spans dozens of
+// pages, so the skipped frames' packets have to be peeked and demuxed
+// along the way.
+static void testSeekAcrossGop()
+{
+	const int interval = 64;
+	std::vector<unsigned char> clip = makeTestClip(interval * 3, interval);
+	int64_t keyframe = keyframePageOffset(clip, 1);
+	check(keyframe > 0, "found the second keyframe");
+	if (keyframe <= 0) {
+		return;
+	}
+
+	Decoder decoder;
+	decoder.receiveInput(clip.data(), clip.size());
+	while (!decoder.frameReady() && decoder.process()) {
+		// read the headers and peek the first frame
+	}
+	check(decoder.frameReady(), "first frame ready");
+
+	decoder.flush();
+	check(!decoder.frameReady(), "no frame ready after flush");
+	decoder.receiveInput(clip.data() + keyframe, clip.size() - keyframe);
+
+	// Partway into the second GOP, a good many pages past its keyframe.
+	double target = (interval + 40) / 30.0;
+	int steps = 0;
+	int skipped = 0;
+	while (steps++ < 10000) {
+		if (!decoder.frameReady()) {
+			if (!decoder.process()) {
+				break;
+			}
+		} else if (decoder.frameTimestamp() < target) {
+			check(decoder.skipFrame(), "skipped frame decodes");
+			skipped++;
+		} else {
+			break;
+		}
+	}
+	check(steps < 10000, "seek loop finished");
+	check(decoder.frameReady() && decoder.frameTimestamp() >= target &&
+	      decoder.frameTimestamp() < target + 1.5 / 30, "seek landed on the target frame");
+	check(skipped >= 39 && skipped <= 41, "seek skipped from the keyframe");
+
+	double landed = decoder.frameTimestamp();
+	double decoded = -1;
+	decoder.decodeFrame([&decoded](FrameBuffer &aBuffer) {
+		decoded = aBuffer.timestamp;
+	});
+	check(decoded == landed, "decoded frame has the peeked timestamp");
+}
 
 int main() {
 	auto decoder = new OGVCore::Decoder();
@@ -17,5 +157,10 @@ int main() {
 	printf("Hello! %p\n", decoder);
 	delete decoder;
 
-	return 0;
+	testInputWhileDemuxing(false);
+	testInputWhileDemuxing(true);
+	testSeekAcrossGop();
+
+	printf("%s\n", failures ? "Some tests failed." : "All tests passed.");
+	return failures ? 1 : 0;
 }